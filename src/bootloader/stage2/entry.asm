@@ -22,11 +22,28 @@ entry:
     mov bp, sp
 
     ; set a VBE graphics mode (e.g., 1024x768x32bpp)
+    ; the kernel converts at present time, so lower depths work too
     mov ax, 1920    ; width
     mov bx, 1080    ; height
     mov cl, 32      ; bpp
     call vbe_set_mode
+    jnc .vbe_done
+    mov ax, 1920
+    mov bx, 1080
+    mov cl, 24
+    call vbe_set_mode
+    jnc .vbe_done
+    mov ax, 1920
+    mov bx, 1080
+    mov cl, 16
+    call vbe_set_mode
+    jnc .vbe_done
+    mov ax, 1920
+    mov bx, 1080
+    mov cl, 15
+    call vbe_set_mode
     ; jc .vbe_error ; uncomment to handle VBE errors
+.vbe_done:
 
     ; switch to protected mode
     call EnableA20          ; 2 - Enable A20 gate
@@ -51,6 +68,8 @@ entry:
 
     ; --- Draw a test pixel from assembly ---
     ; Draw a RED pixel at (x=50, y=50) to verify VBE mode
+    cmp byte [vbe_screen.bpp], 32
+    jne .skip_test_pixel
     mov edi, [vbe_screen.physical_buffer]   ; Get framebuffer base address
     movzx eax, word [vbe_screen.pitch]      ; eax = bytes per scanline (pitch)
     mov ebx, 50                             ; y = 50
@@ -60,6 +79,7 @@ entry:
     add eax, ebx                            ; eax = y * pitch + x * 4
     add edi, eax                            ; edi = framebuffer + offset
     mov dword [edi], 0x00FF0000             ; Draw a red pixel (0x00RRGGBB)
+.skip_test_pixel:
     ; --- End of test pixel code ---
    
     ; clear bss (uninitialized data)
@@ -267,6 +287,12 @@ vbe_set_mode:
     mov [vbe_screen.pitch], ax
     mov al, [mode_info_block.bpp]
     mov [vbe_screen.bpp], al
+    mov ax, [mode_info_block.red_mask]      ; size and position
+    mov [vbe_screen.red_mask], ax
+    mov ax, [mode_info_block.green_mask]
+    mov [vbe_screen.green_mask], ax
+    mov ax, [mode_info_block.blue_mask]
+    mov [vbe_screen.blue_mask], ax
 
     ; Set the mode
     mov ax, 0x4F02
@@ -352,4 +378,10 @@ vbe_screen:
     .height           dw 0
     .pitch            dw 0
     .bpp              db 0
-    .physical_buffer  dd 0
\ No newline at end of file
+    .physical_buffer  dd 0
+    .red_mask         db 0
+    .red_position     db 0
+    .green_mask       db 0
+    .green_position   db 0
+    .blue_mask        db 0
+    .blue_position    db 0
\ No newline at end of file
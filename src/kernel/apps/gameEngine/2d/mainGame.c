@@ -4,22 +4,13 @@
 #include "memory.h"
 #include "heap.h"
 #include "string.h"
-#include <arch/i686/io.h>
+#include <arch/i686/keyboard.h>
 #include "time.h"
 
 #include "gameAssets.h"
 
 extern uint32_t* g_BackBuffer;
 
-// Implementation of graphics_draw_rect to resolve the linker error
-void graphics_draw_rect(int x, int y, int w, int h, uint32_t color) {
-    for (int i = 0; i < h; i++) {
-        for (int j = 0; j < w; j++) {
-            draw_pixel(x + j, y + i, color);
-        }
-    }
-}
-
 static bool is_solid(GameState2D* state, int x, int y) {
     int tx = x / (TILE_SIZE * 100);
     int ty = y / (TILE_SIZE * 100);
@@ -104,14 +95,14 @@ static void render2d(GameState2D* state) {
     for (int x = 0; x < MAP_W; x++) {
         for (int y = 0; y < MAP_H; y++) {
             if (state->map[x][y] == TILE_SOLID) {
-                graphics_draw_rect(x * TILE_SIZE, state->screen_h - (y + 1) * TILE_SIZE, 
+                graphics_fill_rect(x * TILE_SIZE, state->screen_h - (y + 1) * TILE_SIZE, 
                                  TILE_SIZE, TILE_SIZE, get_tile_color(TILE_SOLID));
             }
         }
     }
 
     // Draw Player
-    graphics_draw_rect(state->player.x / 100, state->screen_h - (state->player.y / 100) - (state->player.height / 100),
+    graphics_fill_rect(state->player.x / 100, state->screen_h - (state->player.y / 100) - (state->player.height / 100),
                      state->player.width / 100, state->player.height / 100, 0x00FF0000);
 }
 
@@ -135,39 +126,38 @@ void game2d_run() {
     state->player.width = 20 * 100;
     state->player.height = 30 * 100;
 
-    graphics_set_double_buffering(true);
-    i686_outb(0x21, i686_inb(0x21) | 0x02); // Mask IRQ1
+    if (!graphics_app_begin()) {
+        free(state);
+        return;
+    }
+    graphics_set_page_flipping(true); // Falls back to copying if unsupported
+    keyboard_flush_events(); // Whatever was typed to start the game
 
+    uint64_t next_frame = time_now_ns();
     while (1) {
+        state->back_buffer = g_BackBuffer; // Moves between VRAM pages when flipping
         graphics_clear_buffer(0x00222222);
         
         update_physics2d(state);
         render2d(state);
         graphics_swap_buffer();
-        sleep_ms(16); // Cap at ~60 FPS for consistent physics
+        time_pace(&next_frame, GAME2D_FRAME_NS); // 60 FPS for consistent physics
         
         // Continuous Input Handling (Walking)
-        if (state->key_states[0x1E]) state->player.vx -= PHYSICS_WALK_FORCE; // A
-        if (state->key_states[0x20]) state->player.vx += PHYSICS_WALK_FORCE; // D
+        if (keyboard_key_down(KEYCODE_A)) state->player.vx -= PHYSICS_WALK_FORCE; // A
+        if (keyboard_key_down(KEYCODE_D)) state->player.vx += PHYSICS_WALK_FORCE; // D
 
         // Input Handling
-        while (i686_inb(0x64) & 0x01) {
-            uint8_t sc = i686_inb(0x60);
-            if (sc == 0x01) goto end_2d;
-
-            if (sc & 0x80) {
-                // Key Release (Break Code)
-                state->key_states[sc & 0x7F] = false;
-            } else {
-                // Key Press (Make Code)
-                state->key_states[sc] = true;
-                if (sc == 0x39) state->player.jump_buffer_timer = 5; // Trigger jump buffer on press
-            }
+        key_event_t event;
+        while (keyboard_read_event(&event)) {
+            if (!event.pressed) continue;
+            if (event.key == KEYCODE_ESCAPE) goto end_2d;
+            if (event.key == KEYCODE_SPACE) state->player.jump_buffer_timer = 5; // Trigger jump buffer on press
         }
     }
 
 end_2d:
-    i686_outb(0x21, i686_inb(0x21) & ~0x02);
+    keyboard_flush_events(); // Keys meant for the game don't reach the shell
     free(state);
-    graphics_set_double_buffering(false);
+    graphics_app_end();
 }
\ No newline at end of file
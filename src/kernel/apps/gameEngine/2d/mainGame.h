@@ -16,6 +16,9 @@
 #define PHYSICS_WALL_JUMP_OUT    850
 #define PHYSICS_TERMINAL_VELOCITY -1600
 
+// Physics steps once per frame, so the frame rate is fixed
+#define GAME2D_FRAME_NS          (1000000000 / 60)
+
 typedef struct {
     int x, y;       // Position (scaled by 100)
     int vx, vy;     // Velocity
@@ -32,7 +35,6 @@ typedef struct {
     Player2D player;
     int screen_w, screen_h;
     uint32_t* back_buffer;
-    bool key_states[256];
 } GameState2D;
 
 // Block types
@@ -5,8 +5,8 @@
 #include "memory.h"
 #include "heap.h"
 #include "string.h"
-#include <arch/i686/io.h>
 #include <arch/i686/keyboard.h>
+#include "time.h"
 
 extern uint32_t* g_BackBuffer;
 
@@ -171,13 +171,16 @@ static void render_world(GameState* state) {
     static int dy_offsets[] = { 0,  0,  0,  0, -1,  1};
     static int dz_offsets[] = {-1,  0,  1,  0,  0,  0};
 
+    // Projected corners of the block being drawn, gone with the frame
+    Point2D* projected = (Point2D*)arena_alloc(state->frame_arena, 8 * sizeof(Point2D));
+    if (!projected) return;
+
     for (int bx = 0; bx < WORLD_W; bx++) {
         for (int by = 0; by < WORLD_H; by++) {
             for (int bz = 0; bz < WORLD_D; bz++) {
                 BlockType type = state->map[bx][by][bz];
                 if (type == BLOCK_AIR) continue;
 
-                Point2D projected[8];
                 int visible_count = 0;
 
                 // Transform all 8 vertices of the block
@@ -258,6 +261,12 @@ void game_engine_run() {
     state->screen_h = g_vbe_screen->height;
     state->z_buffer = (uint32_t*)malloc(state->screen_w * state->screen_h * sizeof(uint32_t));
     state->back_buffer = g_BackBuffer;
+    state->frame_arena = arena_create(16 * 1024);
+    if (!state->frame_arena) {
+        free(state->z_buffer);
+        free(state);
+        return;
+    }
 
     // Init World: A solid 5x5 platform
     memset(state->map, 0, sizeof(state->map));
@@ -274,63 +283,69 @@ void game_engine_run() {
     state->player.angleY = 32; // Look forward
     state->player.vx = state->player.vy = state->player.vz = 0;
 
-    graphics_set_double_buffering(true);
-    i686_outb(0x21, i686_inb(0x21) | 0x02); // Mask IRQ1
+    if (!graphics_app_begin()) {
+        arena_destroy(state->frame_arena);
+        free(state->z_buffer);
+        free(state);
+        return;
+    }
+    graphics_set_page_flipping(true); // Falls back to copying if unsupported
+    keyboard_flush_events(); // Whatever was typed to start the game
 
+    uint64_t next_frame = time_now_ns();
     while (1) {
+        arena_reset(state->frame_arena);
+        state->back_buffer = g_BackBuffer; // Moves between VRAM pages when flipping
         graphics_clear_buffer(0x0088CCFF); // Sky Blue
         memset(state->z_buffer, 0xFF, state->screen_w * state->screen_h * sizeof(uint32_t));
 
         update_physics(state);
         render_world(state);
         graphics_swap_buffer();
-        sleep_ms(4); // cap framerate
+        time_pace(&next_frame, GAME3D_FRAME_NS); // cap framerate
 
         // Handle continuous movement based on held keys
         int speed = 200;
         int sinY = sin_table[state->player.angleY % 64];
         int cosY = cos_table[state->player.angleY % 64];
 
-        if (state->key_states[0x11]) { // W
+        if (keyboard_key_down(KEYCODE_W)) {
             state->player.vx += (sinY * speed) / 128;
             state->player.vz += (cosY * speed) / 128;
         }
-        if (state->key_states[0x1F]) { // S
+        if (keyboard_key_down(KEYCODE_S)) {
             state->player.vx -= (sinY * speed) / 128;
             state->player.vz -= (cosY * speed) / 128;
         }
-        if (state->key_states[0x1E]) { // A
+        if (keyboard_key_down(KEYCODE_A)) {
             state->player.vx -= (cosY * speed) / 128;
             state->player.vz += (sinY * speed) / 128;
         }
-        if (state->key_states[0x20]) { // D
+        if (keyboard_key_down(KEYCODE_D)) {
             state->player.vx += (cosY * speed) / 128;
             state->player.vz -= (sinY * speed) / 128;
         }
-        if (state->key_states[0x4B]) state->player.angleY = (state->player.angleY + 63) % 64; // Turn Left
-        if (state->key_states[0x4D]) state->player.angleY = (state->player.angleY + 1) % 64;  // Turn Right
-
-        // Input Handling: Drain the buffer to prevent lag/unintended jumps
-        while (i686_inb(0x64) & 0x01) {
-            uint8_t sc = i686_inb(0x60);
-            if (sc == 0x01) goto end_game; // ESC
-
-            if (sc & 0x80) {
-                state->key_states[sc & 0x7F] = false;
-            } else {
-                state->key_states[sc] = true;
-                // Jumping remains event-based for better control
-                if (sc == 0x39 && state->player.on_ground) {
-                    state->player.vy = 800;
-                    state->player.on_ground = false;
-                }
+        if (keyboard_key_down(KEYCODE_LEFT)) state->player.angleY = (state->player.angleY + 63) % 64; // Turn Left
+        if (keyboard_key_down(KEYCODE_RIGHT)) state->player.angleY = (state->player.angleY + 1) % 64;  // Turn Right
+
+        // Input Handling: Drain the events to prevent lag/unintended jumps
+        key_event_t event;
+        while (keyboard_read_event(&event)) {
+            if (!event.pressed) continue;
+            if (event.key == KEYCODE_ESCAPE) goto end_game;
+
+            // Jumping remains event-based for better control
+            if (event.key == KEYCODE_SPACE && state->player.on_ground) {
+                state->player.vy = 800;
+                state->player.on_ground = false;
             }
         }
     }
 
 end_game:
-    i686_outb(0x21, i686_inb(0x21) & ~0x02);
+    keyboard_flush_events(); // Keys meant for the game don't reach the shell
+    arena_destroy(state->frame_arena);
     free(state->z_buffer);
     free(state);
-    graphics_set_double_buffering(false);
+    graphics_app_end();
 }
\ No newline at end of file
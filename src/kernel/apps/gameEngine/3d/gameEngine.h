@@ -1,6 +1,7 @@
 #pragma once
 #include "stdint.h"
 #include "stdbool.h"
+#include "arena.h"
 
 // World Dimensions
 #define WORLD_W 10
@@ -8,6 +9,9 @@
 #define WORLD_D 10
 #define BLOCK_SIZE 40
 
+// Frame rate cap (250 FPS)
+#define GAME3D_FRAME_NS (1000000000 / 250)
+
 typedef enum {
     BLOCK_AIR = 0,
     BLOCK_GRASS,
@@ -29,8 +33,8 @@ typedef struct {
     Player player;
     uint32_t* z_buffer;
     uint32_t* back_buffer;
+    arena_t* frame_arena;   // Scratch memory reset at the start of every frame
     int screen_w, screen_h;
-    bool key_states[256];
 } GameState;
 
 // --- Core Functions ---
@@ -91,8 +91,20 @@ void bmp_view(const char* filename) {
     int rowSize = ((width * infoHeader.biBitCount + 31) / 32) * 4;
     
     uint8_t* rowBuffer = (uint8_t*)malloc(rowSize);
-    if (!rowBuffer) {
+    uint32_t* pixelRow = (uint32_t*)malloc(width * sizeof(uint32_t));
+    if (!rowBuffer || !pixelRow) {
         printf("BMP: Out of memory (row buffer).\n");
+        free(rowBuffer);
+        free(pixelRow);
+        FAT_Close(&g_Disk, fd);
+        return;
+    }
+
+    // Draw on a surface of our own so the console comes back untouched
+    if (!graphics_app_begin()) {
+        printf("BMP: Out of memory (app surface).\n");
+        free(rowBuffer);
+        free(pixelRow);
         FAT_Close(&g_Disk, fd);
         return;
     }
@@ -119,19 +131,18 @@ void bmp_view(const char* filename) {
             uint8_t r = rowBuffer[offset + 2];
             
             // Combine to 0x00RRGGBB
-            uint32_t color = (r << 16) | (g << 8) | b;
-            draw_pixel(startX + x, drawY, color);
+            pixelRow[x] = (r << 16) | (g << 8) | b;
         }
+        graphics_blit(startX, drawY, pixelRow, width, 1, width);
     }
 
-    if (g_DoubleBufferEnabled) {
-        graphics_swap_buffer();
-    }
+    graphics_swap_buffer();
 
     free(rowBuffer);
+    free(pixelRow);
     FAT_Close(&g_Disk, fd);
 
     // Wait for user input to exit
     getch();
-    clrscr(); // Restore console
+    graphics_app_end(); // Restore console
 }
\ No newline at end of file
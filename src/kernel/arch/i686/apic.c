@@ -0,0 +1,158 @@
+#include "apic.h"
+#include "cpu.h"
+#include "isr.h"
+#include "paging.h"
+#include "smp.h"
+#include <stddef.h>
+#include <sync/spinlock.h>
+
+static volatile uint32_t* g_ApicRegs = NULL;
+static bool g_TscDeadline = false;
+
+static inline uint32_t i686_APIC_Read(uint32_t reg)
+{
+    return g_ApicRegs[reg / 4];
+}
+
+static inline void i686_APIC_Write(uint32_t reg, uint32_t value)
+{
+    g_ApicRegs[reg / 4] = value;
+}
+
+static void i686_APIC_TimerInterrupt(Registers* regs)
+{
+    // Waking the CPU out of hlt is the whole job
+    i686_APIC_SendEndOfInterrupt();
+}
+
+static void i686_APIC_SpuriousInterrupt(Registers* regs)
+{
+    // Spurious interrupts are not in service, so no EOI
+}
+
+// The part every CPU does for its own APIC
+static void i686_APIC_EnableLocal()
+{
+    // Accept every priority and switch the APIC on
+    i686_APIC_Write(APIC_REG_TPR, 0);
+    i686_APIC_Write(APIC_REG_SVR, APIC_SVR_ENABLE | APIC_SPURIOUS_VECTOR);
+
+    // Timer stays masked until someone arms it
+    i686_APIC_Write(APIC_REG_TIMER_DIVIDE, APIC_TIMER_DIVIDE_16);
+    i686_APIC_Write(APIC_REG_LVT_TIMER, APIC_LVT_MASKED | APIC_TIMER_VECTOR);
+    i686_SMP_This()->apic_timer_mode = APIC_LVT_MASKED | APIC_TIMER_VECTOR;
+}
+
+bool i686_APIC_Initialize()
+{
+    if (!i686_CPU_HasFeature(CPUID_EDX_APIC) || !i686_CPU_HasFeature(CPUID_EDX_MSR)) return false;
+
+    uint64_t base_msr = i686_ReadMSR(APIC_BASE_MSR);
+    if (!(base_msr & APIC_BASE_ENABLE)) {
+        base_msr |= APIC_BASE_ENABLE;
+        i686_WriteMSR(APIC_BASE_MSR, base_msr);
+    }
+
+    // The register page sits above the identity map; it must never be cached
+    uint32_t base = (uint32_t)base_msr & 0xFFFFF000;
+    i686_Paging_Map_Range_Cached(base, base, 4096, PAGING_CACHE_UNCACHED);
+    g_ApicRegs = (volatile uint32_t*)base;
+
+    i686_ISR_RegisterHandler(APIC_TIMER_VECTOR, i686_APIC_TimerInterrupt);
+    i686_ISR_RegisterHandler(APIC_SPURIOUS_VECTOR, i686_APIC_SpuriousInterrupt);
+
+    i686_APIC_EnableLocal();
+
+    g_TscDeadline = (g_CpuInfo.features_ecx & CPUID_ECX_TSC_DEADLINE) != 0;
+    return true;
+}
+
+void i686_APIC_InitializeAP()
+{
+    uint64_t base_msr = i686_ReadMSR(APIC_BASE_MSR);
+    if (!(base_msr & APIC_BASE_ENABLE)) {
+        i686_WriteMSR(APIC_BASE_MSR, base_msr | APIC_BASE_ENABLE);
+    }
+    i686_APIC_EnableLocal();
+}
+
+bool i686_APIC_IsEnabled()
+{
+    return g_ApicRegs != NULL;
+}
+
+uint32_t i686_APIC_GetId()
+{
+    return g_ApicRegs ? i686_APIC_Read(APIC_REG_ID) >> 24 : 0;
+}
+
+void i686_APIC_SendEndOfInterrupt()
+{
+    i686_APIC_Write(APIC_REG_EOI, 0);
+}
+
+// The high half must not change under us between the two writes, hence the
+// cli: an IRQ on this CPU could send an IPI of its own in between
+static void i686_APIC_SendICR(uint32_t apic_id, uint32_t command)
+{
+    if (!g_ApicRegs) return;
+
+    uint32_t flags = irq_save();
+    i686_APIC_Write(APIC_REG_ICR_HIGH, apic_id << 24);
+    i686_APIC_Write(APIC_REG_ICR_LOW, command);
+    while (i686_APIC_Read(APIC_REG_ICR_LOW) & APIC_ICR_PENDING) {
+        __asm__ volatile("pause");
+    }
+    irq_restore(flags);
+}
+
+void i686_APIC_SendIPI(uint32_t apic_id, uint8_t vector)
+{
+    i686_APIC_SendICR(apic_id, APIC_ICR_FIXED | APIC_ICR_ASSERT | vector);
+}
+
+void i686_APIC_SendInit(uint32_t apic_id)
+{
+    i686_APIC_SendICR(apic_id, APIC_ICR_INIT | APIC_ICR_ASSERT | APIC_ICR_LEVEL);
+}
+
+void i686_APIC_SendStartup(uint32_t apic_id, uint32_t page)
+{
+    i686_APIC_SendICR(apic_id, APIC_ICR_STARTUP | APIC_ICR_ASSERT | (page & 0xFF));
+}
+
+// Rewriting the LVT is an uncached MMIO write; skip it when nothing changes.
+// Each CPU has its own LVT, so the last value is kept per CPU.
+static inline void i686_APIC_SetTimerMode(uint32_t lvt)
+{
+    PerCpu* cpu = i686_SMP_This();
+    if (cpu->apic_timer_mode == lvt) return;
+    i686_APIC_Write(APIC_REG_LVT_TIMER, lvt);
+    cpu->apic_timer_mode = lvt;
+}
+
+void i686_APIC_TimerOneShot(uint32_t count)
+{
+    if (!g_ApicRegs) return;
+    i686_APIC_SetTimerMode(APIC_LVT_TIMER_ONESHOT | APIC_TIMER_VECTOR);
+    i686_APIC_Write(APIC_REG_TIMER_INITIAL, count);
+}
+
+uint32_t i686_APIC_TimerRemaining()
+{
+    return g_ApicRegs ? i686_APIC_Read(APIC_REG_TIMER_CURRENT) : 0;
+}
+
+bool i686_APIC_HasTscDeadline()
+{
+    return g_ApicRegs && g_TscDeadline;
+}
+
+void i686_APIC_TimerDeadline(uint64_t tsc)
+{
+    if (!g_ApicRegs || !g_TscDeadline) return;
+    i686_APIC_SetTimerMode(APIC_LVT_TIMER_TSC_DEADLINE | APIC_TIMER_VECTOR);
+    // The mode change must land before the deadline MSR is written
+    __asm__ volatile("mfence" : : : "memory");
+    i686_WriteMSR(APIC_TSC_DEADLINE_MSR, tsc);
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <stdint.h>
+#include "stdbool.h"
+
+// Local APIC (xAPIC, memory mapped)
+
+#define APIC_BASE_MSR               0x1B
+#define APIC_BASE_ENABLE            (1 << 11)
+#define APIC_TSC_DEADLINE_MSR       0x6E0
+
+#define APIC_REG_ID                 0x020
+#define APIC_REG_VERSION            0x030
+#define APIC_REG_TPR                0x080
+#define APIC_REG_EOI                0x0B0
+#define APIC_REG_SVR                0x0F0
+#define APIC_REG_ICR_LOW            0x300
+#define APIC_REG_ICR_HIGH           0x310
+#define APIC_REG_LVT_TIMER          0x320
+#define APIC_REG_TIMER_INITIAL      0x380
+#define APIC_REG_TIMER_CURRENT      0x390
+#define APIC_REG_TIMER_DIVIDE       0x3E0
+
+#define APIC_SVR_ENABLE             (1 << 8)
+#define APIC_LVT_MASKED             (1 << 16)
+#define APIC_LVT_TIMER_ONESHOT      (0 << 17)
+#define APIC_LVT_TIMER_TSC_DEADLINE (2 << 17)
+#define APIC_TIMER_DIVIDE_16        0x3
+
+#define APIC_ICR_FIXED              (0 << 8)
+#define APIC_ICR_INIT               (5 << 8)
+#define APIC_ICR_STARTUP            (6 << 8)
+#define APIC_ICR_PENDING            (1 << 12)
+#define APIC_ICR_ASSERT             (1 << 14)
+#define APIC_ICR_LEVEL              (1 << 15)
+
+// CPUID leaf 1 ECX
+#define CPUID_ECX_TSC_DEADLINE      (1 << 24)
+
+// Above the remapped PIC range (0x20-0x2F)
+#define APIC_TIMER_VECTOR           0x40
+#define APIC_SPURIOUS_VECTOR        0xFF
+
+// Maps and software-enables the local APIC. Legacy PIC interrupts keep
+// arriving through LINT0 until i686_IRQ_SwitchToIOAPIC. Returns false if
+// there's no APIC.
+bool i686_APIC_Initialize();
+// Enables the calling application processor's own APIC, set up like the
+// boot CPU's. The registers sit at the same address on every CPU.
+void i686_APIC_InitializeAP();
+bool i686_APIC_IsEnabled();
+uint32_t i686_APIC_GetId();
+void i686_APIC_SendEndOfInterrupt();
+
+// Inter-processor interrupts, addressed by APIC id. They return once the
+// local APIC has sent the message.
+void i686_APIC_SendIPI(uint32_t apic_id, uint8_t vector);
+void i686_APIC_SendInit(uint32_t apic_id);
+// Starts a CPU that got an INIT in real mode at page * 0x1000
+void i686_APIC_SendStartup(uint32_t apic_id, uint32_t page);
+
+// The timer counts down at the bus clock / 16 and interrupts on
+// APIC_TIMER_VECTOR when it reaches zero. A count of 0 stops it.
+void i686_APIC_TimerOneShot(uint32_t count);
+uint32_t i686_APIC_TimerRemaining();
+
+// TSC-deadline mode: interrupts once the TSC passes `tsc`, 0 disarms.
+// Only when the CPU has it (i686_APIC_HasTscDeadline).
+bool i686_APIC_HasTscDeadline();
+void i686_APIC_TimerDeadline(uint64_t tsc);
@@ -0,0 +1,27 @@
+#include "bga.h"
+#include "io.h"
+
+uint16_t i686_BGA_Read(uint16_t index)
+{
+    i686_outw(BGA_PORT_INDEX, index);
+    return i686_inw(BGA_PORT_DATA);
+}
+
+void i686_BGA_Write(uint16_t index, uint16_t value)
+{
+    i686_outw(BGA_PORT_INDEX, index);
+    i686_outw(BGA_PORT_DATA, value);
+}
+
+bool i686_BGA_IsAvailable()
+{
+    uint16_t id = i686_BGA_Read(BGA_INDEX_ID);
+    return id >= BGA_ID0 && id <= BGA_ID5;
+}
+
+uint32_t i686_BGA_GetVideoMemory()
+{
+    // The VRAM size register only exists from revision 0xB0C5 onwards
+    if (i686_BGA_Read(BGA_INDEX_ID) < BGA_ID5) return 0;
+    return (uint32_t)i686_BGA_Read(BGA_INDEX_VIDEO_MEMORY_64K) * 64 * 1024;
+}
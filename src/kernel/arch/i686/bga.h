@@ -0,0 +1,30 @@
+#pragma once
+#include <stdint.h>
+#include "stdbool.h"
+
+// Bochs Graphics Adapter (the "dispi" interface of QEMU std VGA and Bochs)
+
+#define BGA_PORT_INDEX              0x1CE
+#define BGA_PORT_DATA               0x1CF
+
+#define BGA_INDEX_ID                0x0
+#define BGA_INDEX_XRES              0x1
+#define BGA_INDEX_YRES              0x2
+#define BGA_INDEX_BPP               0x3
+#define BGA_INDEX_ENABLE            0x4
+#define BGA_INDEX_BANK              0x5
+#define BGA_INDEX_VIRT_WIDTH        0x6
+#define BGA_INDEX_VIRT_HEIGHT       0x7
+#define BGA_INDEX_X_OFFSET          0x8
+#define BGA_INDEX_Y_OFFSET          0x9
+#define BGA_INDEX_VIDEO_MEMORY_64K  0xA
+
+#define BGA_ID0                     0xB0C0
+#define BGA_ID5                     0xB0C5
+
+bool i686_BGA_IsAvailable();
+uint16_t i686_BGA_Read(uint16_t index);
+void i686_BGA_Write(uint16_t index, uint16_t value);
+
+// Total VRAM in bytes, or 0 if the adapter doesn't report it
+uint32_t i686_BGA_GetVideoMemory();
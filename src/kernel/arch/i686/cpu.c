@@ -0,0 +1,59 @@
+#include "cpu.h"
+#include "stdio.h"
+#include "memory.h"
+
+#define CR0_MP          (1 << 1)
+#define CR0_EM          (1 << 2)
+#define CR4_OSFXSR      (1 << 9)
+#define CR4_OSXMMEXCPT  (1 << 10)
+
+cpu_info_t g_CpuInfo;
+
+static void i686_CPU_EnableSSE()
+{
+    uint32_t cr0, cr4;
+
+    // FPU present, monitor it, no emulation
+    __asm__ volatile("mov %%cr0, %0" : "=r"(cr0));
+    cr0 &= ~CR0_EM;
+    cr0 |= CR0_MP;
+    __asm__ volatile("mov %0, %%cr0" : : "r"(cr0));
+
+    // Tell the CPU we save state with fxsave and handle SIMD exceptions
+    __asm__ volatile("mov %%cr4, %0" : "=r"(cr4));
+    cr4 |= CR4_OSFXSR | CR4_OSXMMEXCPT;
+    __asm__ volatile("mov %0, %%cr4" : : "r"(cr4));
+
+    __asm__ volatile("fninit");
+    g_CpuInfo.sse_enabled = true;
+}
+
+void i686_CPU_Initialize()
+{
+    uint32_t eax, ebx, ecx, edx;
+
+    i686_CPUID(0, &eax, &ebx, &ecx, &edx);
+    memcpy(&g_CpuInfo.vendor[0], &ebx, 4);
+    memcpy(&g_CpuInfo.vendor[4], &edx, 4);
+    memcpy(&g_CpuInfo.vendor[8], &ecx, 4);
+    g_CpuInfo.vendor[12] = '\0';
+
+    if (eax >= 1) {
+        i686_CPUID(1, &eax, &ebx, &ecx, &edx);
+        g_CpuInfo.family = (eax >> 8) & 0xF;
+        g_CpuInfo.model = (eax >> 4) & 0xF;
+        if (g_CpuInfo.family == 0xF) g_CpuInfo.family += (eax >> 20) & 0xFF;
+        if (g_CpuInfo.family >= 0x6) g_CpuInfo.model |= ((eax >> 16) & 0xF) << 4;
+        g_CpuInfo.features_edx = edx;
+        g_CpuInfo.features_ecx = ecx;
+    }
+
+    if (i686_CPU_HasFeature(CPUID_EDX_FXSR) && i686_CPU_HasFeature(CPUID_EDX_SSE)) {
+        i686_CPU_EnableSSE();
+    }
+}
+
+bool i686_CPU_HasFeature(uint32_t edx_bit)
+{
+    return (g_CpuInfo.features_edx & edx_bit) != 0;
+}
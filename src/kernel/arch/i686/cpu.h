@@ -0,0 +1,73 @@
+#pragma once
+#include <stdint.h>
+#include "stdbool.h"
+
+// CPUID leaf 1 EDX feature bits
+#define CPUID_EDX_TSC     (1 << 4)
+#define CPUID_EDX_MSR     (1 << 5)
+#define CPUID_EDX_APIC    (1 << 9)
+#define CPUID_EDX_MTRR    (1 << 12)
+#define CPUID_EDX_PAT     (1 << 16)
+#define CPUID_EDX_FXSR    (1 << 24)
+#define CPUID_EDX_SSE     (1 << 25)
+#define CPUID_EDX_SSE2    (1 << 26)
+
+typedef struct {
+    char vendor[13];
+    uint32_t family;
+    uint32_t model;
+    uint32_t features_edx;      // CPUID.1:EDX
+    uint32_t features_ecx;      // CPUID.1:ECX
+    bool sse_enabled;           // CR0/CR4 set up so SSE instructions may be used
+} cpu_info_t;
+
+extern cpu_info_t g_CpuInfo;
+
+void i686_CPU_Initialize();
+bool i686_CPU_HasFeature(uint32_t edx_bit);
+
+static inline void i686_CPUID(uint32_t leaf, uint32_t* eax, uint32_t* ebx, uint32_t* ecx, uint32_t* edx)
+{
+    __asm__ volatile("cpuid" : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx) : "a"(leaf), "c"(0));
+}
+
+static inline uint64_t i686_ReadMSR(uint32_t msr)
+{
+    uint32_t lo, hi;
+    __asm__ volatile("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline void i686_WriteMSR(uint32_t msr, uint64_t value)
+{
+    __asm__ volatile("wrmsr" : : "c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)) : "memory");
+}
+
+static inline uint64_t i686_ReadTSC()
+{
+    uint32_t lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+// Spill/reload xmm0-xmm3 around kernel SSE code (64 bytes). Interrupts don't
+// save SSE state, so anything using those registers must leave them as found.
+static inline void i686_SSE_Save(uint8_t* area)
+{
+    __asm__ volatile(
+        "movdqu %%xmm0, 0(%0)\n\t"
+        "movdqu %%xmm1, 16(%0)\n\t"
+        "movdqu %%xmm2, 32(%0)\n\t"
+        "movdqu %%xmm3, 48(%0)\n\t"
+        : : "r"(area) : "memory");
+}
+
+static inline void i686_SSE_Restore(const uint8_t* area)
+{
+    __asm__ volatile(
+        "movdqu 0(%0), %%xmm0\n\t"
+        "movdqu 16(%0), %%xmm1\n\t"
+        "movdqu 32(%0), %%xmm2\n\t"
+        "movdqu 48(%0), %%xmm3\n\t"
+        : : "r"(area) : "memory");
+}
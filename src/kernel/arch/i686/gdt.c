@@ -2,6 +2,7 @@
 #include <stdint.h>
 #include "memory.h"
 #include "stdio.h"
+#include "smp.h"
 // NOTES:
 
 // LOOK AT BOOTLOADER ENTRY.ASM
@@ -34,11 +35,14 @@ typedef struct {
     uint16_t trap, iomap_base;
 } __attribute__((packed)) TSSEntry;
 
-static TSSEntry g_TSS;
+// Each CPU has its own TSS, and with it its own GDT: a busy TSS descriptor
+// can't be shared, and the per-CPU segment differs anyway
+static TSSEntry g_TSS[SMP_MAX_CPUS];
 
 void i686_TSS_SetStack(uint32_t kernelSS, uint32_t kernelESP) {
-    g_TSS.ss0 = kernelSS;
-    g_TSS.esp0 = kernelESP;
+    TSSEntry* tss = &g_TSS[i686_SMP_CpuIndex()];
+    tss->ss0 = kernelSS;
+    tss->esp0 = kernelESP;
 }
 
 typedef enum
@@ -75,22 +79,25 @@ typedef enum
 } GDT_FLAGS;
 
 // Helper macros
-#define GDT_LIMIT_LOW(limit)                (limit & 0xFFFF)
-#define GDT_BASE_LOW(base)                  (base & 0xFFFF)
-#define GDT_BASE_MIDDLE(base)               ((base >> 16) & 0xFF)
-#define GDT_FLAGS_LIMIT_HI(limit, flags)    (((limit >> 16) & 0xF) | (flags & 0xF0))
-#define GDT_BASE_HIGH(base)                 ((base >> 24) & 0xFF)
+#define GDT_LIMIT_LOW(limit)                ((limit) & 0xFFFF)
+#define GDT_BASE_LOW(base)                  ((base) & 0xFFFF)
+#define GDT_BASE_MIDDLE(base)               (((base) >> 16) & 0xFF)
+#define GDT_FLAGS_LIMIT_HI(limit, flags)    ((((limit) >> 16) & 0xF) | ((flags) & 0xF0))
+#define GDT_BASE_HIGH(base)                 (((base) >> 24) & 0xFF)
 
 #define GDT_ENTRY(base, limit, access, flags) {                     \
     GDT_LIMIT_LOW(limit),                                           \
     GDT_BASE_LOW(base),                                             \
     GDT_BASE_MIDDLE(base),                                          \
-    access,                                                         \
+    (access),                                                       \
     GDT_FLAGS_LIMIT_HI(limit, flags),                               \
     GDT_BASE_HIGH(base)                                             \
 }
 
-GDTEntry g_GDT[6] = {
+#define GDT_ENTRIES 7
+
+// The entries every CPU's GDT starts with; the TSS and per-CPU ones are filled in per CPU
+static const GDTEntry g_GDTTemplate[GDT_ENTRIES] = {
     // NULL descriptor
     GDT_ENTRY(0, 0, 0, 0),
 
@@ -119,28 +126,56 @@ GDTEntry g_GDT[6] = {
               GDT_FLAG_32BIT | GDT_FLAG_GRANULARITY_4K),
 
     // TSS segment
+    GDT_ENTRY(0, 0, 0, 0), // Placeholder
+
+    // Per-CPU data segment, loaded into gs
     GDT_ENTRY(0, 0, 0, 0) // Placeholder
 };
 
-GDTDescriptor g_GDTDescriptor = { sizeof(g_GDT) - 1, g_GDT};
+GDTEntry g_GDT[SMP_MAX_CPUS][GDT_ENTRIES];
+GDTDescriptor g_GDTDescriptor[SMP_MAX_CPUS];
 
 void __attribute__((cdecl)) i686_GDT_Load(GDTDescriptor* descriptor, uint16_t codeSegment, uint16_t dataSegment);
 
-void i686_GDT_Initialize()
+void i686_GDT_InitializeCpu(uint32_t cpu)
 {
+    GDTEntry* gdt = g_GDT[cpu];
+    TSSEntry* tss = &g_TSS[cpu];
+    PerCpu* percpu = &g_PerCpu[cpu];
+
+    memcpy(gdt, g_GDTTemplate, sizeof(g_GDTTemplate));
+
     // Initialize TSS
-    memset(&g_TSS, 0, sizeof(g_TSS));
-    g_TSS.ss0 = i686_GDT_DATA_SEGMENT;
-    g_TSS.iomap_base = sizeof(g_TSS);
+    memset(tss, 0, sizeof(TSSEntry));
+    tss->ss0 = i686_GDT_DATA_SEGMENT;
+    tss->iomap_base = sizeof(TSSEntry);
 
-    uint32_t tss_base = (uint32_t)&g_TSS;
-    uint32_t tss_limit = sizeof(g_TSS) - 1;
+    uint32_t tss_base = (uint32_t)tss;
+    uint32_t tss_limit = sizeof(TSSEntry) - 1;
 
     // Set TSS gate manually because the macro doesn't handle the weird TSS access byte easily
-    g_GDT[5] = (GDTEntry)GDT_ENTRY(tss_base, tss_limit, GDT_ACCESS_PRESENT | GDT_ACCESS_RING3 | GDT_ACCESS_DESCRIPTOR_TSS | 0x09, 0);
+    gdt[5] = (GDTEntry)GDT_ENTRY(tss_base, tss_limit, GDT_ACCESS_PRESENT | GDT_ACCESS_RING3 | GDT_ACCESS_DESCRIPTOR_TSS | 0x09, 0);
+
+    percpu->self = percpu;
+    percpu->index = cpu;
+    uint32_t percpu_base = (uint32_t)percpu;
+    uint32_t percpu_limit = sizeof(PerCpu) - 1;
+    gdt[6] = (GDTEntry)GDT_ENTRY(percpu_base, percpu_limit,
+                                 GDT_ACCESS_PRESENT | GDT_ACCESS_RING0 | GDT_ACCESS_DATA_SEGMENT | GDT_ACCESS_DATA_WRITEABLE,
+                                 GDT_FLAG_32BIT | GDT_FLAG_GRANULARITY_1B);
+
+    g_GDTDescriptor[cpu].Limit = sizeof(g_GDT[cpu]) - 1;
+    g_GDTDescriptor[cpu].Ptr = gdt;
+    i686_GDT_Load(&g_GDTDescriptor[cpu], i686_GDT_CODE_SEGMENT, i686_GDT_DATA_SEGMENT);
 
-    i686_GDT_Load(&g_GDTDescriptor, i686_GDT_CODE_SEGMENT, i686_GDT_DATA_SEGMENT);
-    
     // Load TSS register
     __asm__ volatile("ltr %%ax" : : "a" (i686_GDT_TSS_SEGMENT));
+
+    // The ISR stubs keep gs on this from here on
+    __asm__ volatile("mov %%ax, %%gs" : : "a" (i686_GDT_PERCPU_SEGMENT));
+}
+
+void i686_GDT_Initialize()
+{
+    i686_GDT_InitializeCpu(0);
 }
\ No newline at end of file
@@ -7,7 +7,11 @@
 #define i686_GDT_USER_CODE_SEGMENT (0x18 | 3)
 #define i686_GDT_USER_DATA_SEGMENT (0x20 | 3)
 #define i686_GDT_TSS_SEGMENT 0x28
+#define i686_GDT_PERCPU_SEGMENT 0x30    // based at this CPU's PerCpu (smp.h)
 
+// Sets up and loads the boot CPU's GDT and TSS
 void i686_GDT_Initialize();
+// The same for CPU `cpu`, which must be the one calling
+void i686_GDT_InitializeCpu(uint32_t cpu);
 void i686_TSS_SetStack(uint32_t kernelSS, uint32_t kernelESP);
 void i686_EnterUserMode(void* entryPoint, void* userStack);
\ No newline at end of file
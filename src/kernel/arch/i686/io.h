@@ -11,6 +11,18 @@ uint8_t __attribute__((cdecl)) i686_DisableInterrupts();
 void __attribute__((cdecl)) i686_iowait();
 void __attribute__((cdecl)) i686_Panic();
 
+static inline void i686_outw(uint16_t port, uint16_t value)
+{
+    __asm__ __volatile__("outw %0, %1" : : "a"(value), "Nd"(port));
+}
+
+static inline uint16_t i686_inw(uint16_t port)
+{
+    uint16_t value;
+    __asm__ __volatile__("inw %1, %0" : "=a"(value) : "Nd"(port));
+    return value;
+}
+
 static inline void i686_insw(uint16_t port, void* buffer, uint32_t count)
 {
     // Reads 'count' 16-bit values from I/O port 'port' into 'buffer'.
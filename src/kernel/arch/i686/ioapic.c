@@ -0,0 +1,102 @@
+#include "ioapic.h"
+#include "paging.h"
+#include <stddef.h>
+
+typedef struct {
+    volatile uint32_t* regs;
+    uint32_t gsi_base;
+    uint32_t pins;
+} IOAPIC;
+
+static IOAPIC g_IOAPICs[IOAPIC_MAX];
+static int g_IOAPICCount = 0;
+
+static uint32_t i686_IOAPIC_Read(IOAPIC* ioapic, uint32_t reg)
+{
+    ioapic->regs[0] = reg;          // IOREGSEL
+    return ioapic->regs[4];         // IOWIN at +0x10
+}
+
+static void i686_IOAPIC_Write(IOAPIC* ioapic, uint32_t reg, uint32_t value)
+{
+    ioapic->regs[0] = reg;
+    ioapic->regs[4] = value;
+}
+
+static IOAPIC* i686_IOAPIC_Find(uint32_t gsi, uint32_t* pin)
+{
+    for (int i = 0; i < g_IOAPICCount; i++)
+    {
+        IOAPIC* ioapic = &g_IOAPICs[i];
+        if (gsi >= ioapic->gsi_base && gsi < ioapic->gsi_base + ioapic->pins)
+        {
+            *pin = gsi - ioapic->gsi_base;
+            return ioapic;
+        }
+    }
+    return NULL;
+}
+
+bool i686_IOAPIC_Add(uint8_t id, uint32_t address, uint32_t gsi_base)
+{
+    if (g_IOAPICCount >= IOAPIC_MAX) return false;
+
+    // Registers sit above the identity map and must never be cached
+    i686_Paging_Map_Range_Cached(address & 0xFFFFF000, address & 0xFFFFF000, 4096, PAGING_CACHE_UNCACHED);
+
+    IOAPIC* ioapic = &g_IOAPICs[g_IOAPICCount];
+    ioapic->regs = (volatile uint32_t*)address;
+    ioapic->gsi_base = gsi_base;
+    ioapic->pins = ((i686_IOAPIC_Read(ioapic, IOAPIC_REG_VERSION) >> 16) & 0xFF) + 1;
+
+    for (uint32_t pin = 0; pin < ioapic->pins; pin++)
+    {
+        i686_IOAPIC_Write(ioapic, IOAPIC_REG_REDIRECTION + pin * 2, IOAPIC_REDIR_MASKED);
+        i686_IOAPIC_Write(ioapic, IOAPIC_REG_REDIRECTION + pin * 2 + 1, 0);
+    }
+
+    g_IOAPICCount++;
+    return true;
+}
+
+bool i686_IOAPIC_Available()
+{
+    return g_IOAPICCount > 0;
+}
+
+bool i686_IOAPIC_Route(uint32_t gsi, uint8_t vector, uint8_t dest, bool active_low, bool level)
+{
+    uint32_t pin;
+    IOAPIC* ioapic = i686_IOAPIC_Find(gsi, &pin);
+    if (!ioapic) return false;
+
+    // Fixed delivery, physical destination
+    uint32_t low = vector | IOAPIC_REDIR_MASKED;
+    if (active_low) low |= IOAPIC_REDIR_ACTIVE_LOW;
+    if (level) low |= IOAPIC_REDIR_LEVEL;
+
+    i686_IOAPIC_Write(ioapic, IOAPIC_REG_REDIRECTION + pin * 2, IOAPIC_REDIR_MASKED);
+    i686_IOAPIC_Write(ioapic, IOAPIC_REG_REDIRECTION + pin * 2 + 1, (uint32_t)dest << 24);
+    i686_IOAPIC_Write(ioapic, IOAPIC_REG_REDIRECTION + pin * 2, low);
+    return true;
+}
+
+void i686_IOAPIC_Mask(uint32_t gsi)
+{
+    uint32_t pin;
+    IOAPIC* ioapic = i686_IOAPIC_Find(gsi, &pin);
+    if (!ioapic) return;
+
+    uint32_t reg = IOAPIC_REG_REDIRECTION + pin * 2;
+    i686_IOAPIC_Write(ioapic, reg, i686_IOAPIC_Read(ioapic, reg) | IOAPIC_REDIR_MASKED);
+}
+
+void i686_IOAPIC_Unmask(uint32_t gsi)
+{
+    uint32_t pin;
+    IOAPIC* ioapic = i686_IOAPIC_Find(gsi, &pin);
+    if (!ioapic) return;
+
+    uint32_t reg = IOAPIC_REG_REDIRECTION + pin * 2;
+    i686_IOAPIC_Write(ioapic, reg, i686_IOAPIC_Read(ioapic, reg) & ~IOAPIC_REDIR_MASKED);
+}
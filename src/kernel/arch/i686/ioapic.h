@@ -0,0 +1,25 @@
+#pragma once
+#include <stdint.h>
+#include "stdbool.h"
+
+// I/O APIC: routes global system interrupts (GSIs) to local APIC vectors
+
+#define IOAPIC_MAX                  4
+
+#define IOAPIC_REG_ID               0x00
+#define IOAPIC_REG_VERSION          0x01
+#define IOAPIC_REG_REDIRECTION      0x10    // two registers per pin
+
+#define IOAPIC_REDIR_ACTIVE_LOW     (1 << 13)
+#define IOAPIC_REDIR_LEVEL          (1 << 15)
+#define IOAPIC_REDIR_MASKED         (1 << 16)
+
+// Maps an I/O APIC and masks all its pins. Returns false if the table is full.
+bool i686_IOAPIC_Add(uint8_t id, uint32_t address, uint32_t gsi_base);
+bool i686_IOAPIC_Available();
+
+// Sends `gsi` to `vector` on the CPU with local APIC id `dest`. The pin
+// stays masked until i686_IOAPIC_Unmask. Returns false if no I/O APIC has it.
+bool i686_IOAPIC_Route(uint32_t gsi, uint8_t vector, uint8_t dest, bool active_low, bool level);
+void i686_IOAPIC_Mask(uint32_t gsi);
+void i686_IOAPIC_Unmask(uint32_t gsi);
@@ -1,6 +1,9 @@
 #include "irq.h"
 #include "pic.h"
+#include "apic.h"
+#include "ioapic.h"
 #include "io.h"
+#include "smp.h"
 #include <stddef.h>
 #include "stdio.h"
 
@@ -8,31 +11,86 @@
 
 IRQHandler g_IRQHandlers[16];
 
+typedef struct {
+    uint32_t gsi;
+    bool active_low;
+    bool level;
+} IsaRoute;
+
+static IsaRoute g_IsaRoutes[16];
+static bool g_UseIOAPIC = false;
+
+static IRQHandler g_VectorHandlers[256];
+
+static void (*g_TailHandler)() = NULL;
+
 void i686_IRQ_Handler(Registers* regs)
 {
     int irq = regs->interrupt - PIC_REMAP_OFFSET;
-    
-    uint8_t pic_isr = i686_PIC_ReadInServiceRegister();
-    uint8_t pic_irr = i686_PIC_ReadIrqRequestRegister();
 
     if (g_IRQHandlers[irq] != NULL)
     {
         // handle IRQ
         g_IRQHandlers[irq](regs);
     }
+    else if (g_UseIOAPIC)
+    {
+        printf("Unhandled IRQ %d\n", irq);
+    }
     else
     {
+        // Only worth the port reads when something went wrong
+        uint8_t pic_isr = i686_PIC_ReadInServiceRegister();
+        uint8_t pic_irr = i686_PIC_ReadIrqRequestRegister();
         printf("Unhandled IRQ %d  ISR=%x  IRR=%x...\n", irq, pic_isr, pic_irr);
     }
 
     // send EOI
-    i686_PIC_SendEndOfInterrupt(irq);
+    if (g_UseIOAPIC)
+        i686_APIC_SendEndOfInterrupt();
+    else
+        i686_PIC_SendEndOfInterrupt(irq);
+
+    i686_IRQ_RunTail();
+}
+
+static void i686_IRQ_VectorHandler(Registers* regs)
+{
+    g_VectorHandlers[regs->interrupt](regs);
+    i686_APIC_SendEndOfInterrupt();
+    i686_IRQ_RunTail();
+}
+
+void i686_IRQ_SetTailHandler(void (*tail)())
+{
+    g_TailHandler = tail;
+}
+
+void i686_IRQ_RunTail()
+{
+    // Per CPU; nested interrupts don't switch threads, so this stays the
+    // same CPU's block until the tail is done
+    PerCpu* cpu = i686_SMP_This();
+    if (g_TailHandler == NULL || cpu->in_tail)
+        return;
+
+    cpu->in_tail = true;
+    i686_EnableInterrupts();
+    g_TailHandler();
+    // Cleared before cli: an IRQ in between runs its own round instead of
+    // leaving its work for an interrupt that may be a long way off
+    cpu->in_tail = false;
+    i686_DisableInterrupts();
 }
 
 void i686_IRQ_Initialize()
 {
     i686_PIC_Configure(PIC_REMAP_OFFSET, PIC_REMAP_OFFSET + 8);
 
+    // Identity ISA wiring until ACPI says otherwise
+    for (int i = 0; i < 16; i++)
+        g_IsaRoutes[i].gsi = i;
+
     // register ISR handlers for each of the 16 irq lines
     for (int i = 0; i < 16; i++)
         i686_ISR_RegisterHandler(PIC_REMAP_OFFSET + i, i686_IRQ_Handler);
@@ -41,5 +99,80 @@ void i686_IRQ_Initialize()
 void i686_IRQ_RegisterHandler(int irq, IRQHandler handler)
 {
     g_IRQHandlers[irq] = handler;
-    i686_PIC_Unmask(irq);
-}
\ No newline at end of file
+    i686_IRQ_Unmask(irq);
+}
+
+void i686_IRQ_Mask(int irq)
+{
+    if (g_UseIOAPIC)
+        i686_IOAPIC_Mask(g_IsaRoutes[irq].gsi);
+    else
+        i686_PIC_Mask(irq);
+}
+
+void i686_IRQ_Unmask(int irq)
+{
+    if (g_UseIOAPIC)
+        i686_IOAPIC_Unmask(g_IsaRoutes[irq].gsi);
+    else
+        i686_PIC_Unmask(irq);
+}
+
+void i686_IRQ_SetIsaRoute(int irq, uint32_t gsi, bool active_low, bool level)
+{
+    g_IsaRoutes[irq].gsi = gsi;
+    g_IsaRoutes[irq].active_low = active_low;
+    g_IsaRoutes[irq].level = level;
+}
+
+bool i686_IRQ_SwitchToIOAPIC()
+{
+    if (g_UseIOAPIC || !i686_IOAPIC_Available() || !i686_APIC_IsEnabled()) return false;
+
+    uint8_t dest = (uint8_t)i686_APIC_GetId();
+    for (int i = 0; i < 16; i++)
+    {
+        // IRQ2 is the 8259 cascade; its GSI usually belongs to the timer override
+        if (i == 2 && g_IsaRoutes[i].gsi == 2) continue;
+        IsaRoute* route = &g_IsaRoutes[i];
+        i686_IOAPIC_Route(route->gsi, PIC_REMAP_OFFSET + i, dest, route->active_low, route->level);
+    }
+
+    i686_PIC_Disable();
+    g_UseIOAPIC = true;
+
+    // Lines that already have a handler keep working
+    for (int i = 0; i < 16; i++)
+        if (g_IRQHandlers[i] != NULL)
+            i686_IOAPIC_Unmask(g_IsaRoutes[i].gsi);
+
+    return true;
+}
+
+bool i686_IRQ_UsingIOAPIC()
+{
+    return g_UseIOAPIC;
+}
+
+int i686_IRQ_AllocateVector(IRQHandler handler)
+{
+    if (!i686_APIC_IsEnabled()) return -1;
+
+    for (int vector = IRQ_VECTOR_FIRST; vector <= IRQ_VECTOR_LAST; vector++)
+    {
+        if (g_VectorHandlers[vector] == NULL)
+        {
+            g_VectorHandlers[vector] = handler;
+            i686_ISR_RegisterHandler(vector, i686_IRQ_VectorHandler);
+            return vector;
+        }
+    }
+    return -1;
+}
+
+void i686_IRQ_FreeVector(int vector)
+{
+    if (vector < IRQ_VECTOR_FIRST || vector > IRQ_VECTOR_LAST) return;
+    i686_ISR_RegisterHandler(vector, NULL);
+    g_VectorHandlers[vector] = NULL;
+}
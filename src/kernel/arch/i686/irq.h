@@ -1,7 +1,33 @@
 #pragma once
 #include "isr.h"
+#include "stdbool.h"
 
 typedef void (*IRQHandler)(Registers* regs);
 
+// Vectors handed out to MSI/MSI-X devices, above APIC_TIMER_VECTOR
+#define IRQ_VECTOR_FIRST        0x50
+#define IRQ_VECTOR_LAST         0x7F
+
 void i686_IRQ_Initialize();
-void i686_IRQ_RegisterHandler(int irq, IRQHandler handler);
\ No newline at end of file
+void i686_IRQ_RegisterHandler(int irq, IRQHandler handler);
+void i686_IRQ_Mask(int irq);
+void i686_IRQ_Unmask(int irq);
+
+// Runs after the EOI of each IRQ with interrupts enabled, for work that
+// shouldn't hold up the interrupt controller. An IRQ arriving while it runs
+// leaves its work to it rather than starting another round.
+void i686_IRQ_SetTailHandler(void (*tail)());
+void i686_IRQ_RunTail();
+
+// Where ISA IRQ `irq` is wired on the I/O APICs (from the ACPI MADT)
+void i686_IRQ_SetIsaRoute(int irq, uint32_t gsi, bool active_low, bool level);
+// Moves the ISA IRQs from the 8259 to the I/O APICs, delivered to this CPU's
+// local APIC on the same vectors. The 8259 is masked for good.
+bool i686_IRQ_SwitchToIOAPIC();
+bool i686_IRQ_UsingIOAPIC();
+
+// Claims a free vector for a message-signalled device and installs `handler`
+// on it; the local APIC EOI is sent for it. Returns -1 if none are left or
+// there's no local APIC to deliver to.
+int i686_IRQ_AllocateVector(IRQHandler handler);
+void i686_IRQ_FreeVector(int vector);
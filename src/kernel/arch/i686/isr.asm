@@ -1,6 +1,7 @@
 [bits 32]
 
 extern i686_ISR_Handler
+extern i686_ISR_Switched
 
 ; cpu pushes to the stack: ss, esp, eflags, cs, eip
 
@@ -36,16 +37,26 @@ isr_common:
     mov ds, ax
     mov es, ax
     mov fs, ax
+    mov ax, 0x30        ; and this CPU's per-CPU segment (i686_GDT_PERCPU_SEGMENT)
     mov gs, ax
     
+    cld                 ; C code expects DF clear (memmove may be interrupted mid-copy)
     push esp            ; pass pointer to stack to C, so we can access all the pushed information
     call i686_ISR_Handler
-    add esp, 4
+    cmp eax, [esp]      ; the frame we came in with?
+    mov esp, eax        ; resume the frame C hands back; a different thread's after a switch
+    je .resume
+    call i686_ISR_Switched  ; now off the old stack, so its thread may run elsewhere
 
+.resume:
     pop eax             ; restore old segment
     mov ds, ax
     mov es, ax
     mov fs, ax
+    cmp ax, 0x10        ; back to the kernel: gs stays the per-CPU segment
+    jne .set_gs
+    mov ax, 0x30
+.set_gs:
     mov gs, ax
 
     popa                ; pop what we pushed with pusha
@@ -2,10 +2,13 @@
 #include "idt.h"
 #include "gdt.h"
 #include "io.h"
+#include "smp.h"
 #include <stdio.h>
 #include <stddef.h>
 
 ISRHandler g_ISRHandlers[256];
+static ISRExitHandler g_ISRExitHandler = NULL;
+static ISRSwitchedHandler g_ISRSwitchedHandler = NULL;
 
 static const char* const g_Exceptions[] = {
     "Divide by zero error",
@@ -51,8 +54,11 @@ void i686_ISR_Initialize()
         i686_IDT_EnableGate(i);
 }
 
-void __attribute__((cdecl)) i686_ISR_Handler(Registers* regs)
+Registers* __attribute__((cdecl)) i686_ISR_Handler(Registers* regs)
 {
+    PerCpu* cpu = i686_SMP_This();
+    cpu->isr_depth++;
+
     if (g_ISRHandlers[regs->interrupt] != NULL)
         g_ISRHandlers[regs->interrupt](regs);
 
@@ -74,10 +80,37 @@ void __attribute__((cdecl)) i686_ISR_Handler(Registers* regs)
         printf("KERNEL PANIC!\n");
         i686_Panic();
     }
+
+    // Nested interrupts (IRQ tails run with interrupts on) return to the
+    // outer one; only the outermost may switch to another frame
+    cpu->isr_depth--;
+    if (cpu->isr_depth == 0 && g_ISRExitHandler != NULL)
+        return g_ISRExitHandler(regs);
+    return regs;
+}
+
+void __attribute__((cdecl)) i686_ISR_Switched()
+{
+    if (g_ISRSwitchedHandler != NULL)
+        g_ISRSwitchedHandler();
 }
 
 void i686_ISR_RegisterHandler(int interrupt, ISRHandler handler)
 {
     g_ISRHandlers[interrupt] = handler;
     i686_IDT_EnableGate(interrupt);
+}
+
+void i686_ISR_SetExitHandler(ISRExitHandler handler, ISRSwitchedHandler switched)
+{
+    g_ISRExitHandler = handler;
+    g_ISRSwitchedHandler = switched;
+}
+
+bool i686_ISR_InInterrupt()
+{
+    // One gs-relative load; a thread that could migrate isn't in an interrupt
+    uint32_t depth;
+    __asm__ volatile("mov %%gs:%c1, %0" : "=r"(depth) : "i"(__builtin_offsetof(PerCpu, isr_depth)));
+    return depth > 0;
 }
\ No newline at end of file
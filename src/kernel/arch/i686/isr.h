@@ -1,5 +1,6 @@
 #pragma once
 #include <stdint.h>
+#include "stdbool.h"
 
 typedef struct 
 {
@@ -11,6 +12,16 @@ typedef struct
 } __attribute__((packed)) Registers;
 
 typedef void (*ISRHandler)(Registers* regs);
+// Picks the frame to return to when the outermost interrupt unwinds
+typedef Registers* (*ISRExitHandler)(Registers* regs);
+// Runs once the stub is on the stack of the frame it switched to
+typedef void (*ISRSwitchedHandler)();
 
 void i686_ISR_Initialize();
-void i686_ISR_RegisterHandler(int interrupt, ISRHandler handler);
\ No newline at end of file
+void i686_ISR_RegisterHandler(int interrupt, ISRHandler handler);
+// Installs the scheduler's hooks; they run with interrupts off, once nothing
+// else is on the interrupt stack. `switched` follows whenever `handler`
+// picked a different frame; until then the old frame's stack is in use.
+void i686_ISR_SetExitHandler(ISRExitHandler handler, ISRSwitchedHandler switched);
+// True inside any handler, including IRQ tails
+bool i686_ISR_InInterrupt();
\ No newline at end of file
@@ -6,33 +6,43 @@
 #include "stdbool.h"
 #include "memory.h"
 #include "string.h"
-#include "pic.h"
+#include <deferred.h>
 #include "stddef.h"
 #include "graphics.h"
+#include "time.h"
 #include <misc/noCrash.h>
+#include <sync/spinlock.h>
+#include <sched/wait.h>
+#include <sched/thread.h>
 
 #include "screen_defs.h"
 
-typedef enum {
-    INPUT_MODE_NONE,
-    INPUT_MODE_GETS,  // Waiting for gets()
-    INPUT_MODE_GETCH, // Waiting for getch()
-} InputMode;
-static volatile InputMode g_CurrentInputMode = INPUT_MODE_NONE;
+// --- Event ring ---
+// The IRQ handler is the only producer and whoever holds g_InputLock the
+// only consumer, so head and tail each have a single writer and the IRQ
+// never waits for a reader.
+#define KEYBOARD_RING_SIZE  128     // power of two
+#define KEYBOARD_RING_MASK  (KEYBOARD_RING_SIZE - 1)
+static key_event_t g_Ring[KEYBOARD_RING_SIZE];
+static volatile uint32_t g_RingHead = 0;    // next slot the IRQ fills
+static volatile uint32_t g_RingTail = 0;    // next slot a reader takes
+static volatile uint32_t g_RingDropped = 0;
+
+// Which keys are down, one bit per key code. Written only by the IRQ.
+static volatile uint32_t g_KeyState[256 / 32];
+
+// --- Waiting readers ---
+// Readers check the ring and block under g_InputLock; the wake-up takes it
+// too, so an event can't slip in between the check and the block.
+static spinlock_t g_InputLock = SPINLOCK_INIT_NAMED("keyboard");
+static wait_queue_t g_InputWaiters = WAIT_QUEUE_INIT;
+// Set by keyboard_poke() to wake gets() without a key; under g_InputLock
+static bool g_ReaderPoked = false;
 
 // --- Static variables for buffered input ---
 #define INPUT_BUFFER_SIZE 256
 static char g_InputBuffer[INPUT_BUFFER_SIZE];
 static int g_InputBufferIndex = 0;
-static volatile bool g_InputLineReady = false;
-
-// --- Static variables for single character input (getch) ---
-static volatile int g_CharBuffer = -1; // -1 means empty
-static volatile bool g_CharReady = false;
-
-static bool g_ShiftPressed = false;
-static bool g_CtrlPressed = false;
-static bool g_AltGrPressed = false;
 
 // --- Command History ---
 static char (*g_HistoryBuffer)[256] = NULL;
@@ -44,9 +54,9 @@ static int g_HistoryNavIndex = -1; // How far back we are in history. -1 = not n
 extern uint8_t* g_ScreenBuffer;
 extern int g_ScreenX, g_ScreenY;
 
-#define KEYBOARD_DATA_PORT 0x60
-
-static int extended = 0; // Track extended key prefix
+#define KEYBOARD_DATA_PORT  0x60
+#define SCANCODE_EXTENDED   0xE0
+#define SCANCODE_RELEASE    0x80
 
 // Scancode to ASCII mapping
 static const char scancode_ascii[128] = {
@@ -92,122 +102,69 @@ static void redraw_input_line() {
     setcursor(prompt_len + g_InputBufferIndex, g_ScreenY);
 }
 
-void keyboard_irq_handler(Registers* regs) {
-    uint8_t scancode = i686_inb(KEYBOARD_DATA_PORT);
+// --- Producer (IRQ) ---
 
-    // Handle shift press/release
-    if (scancode == 0x2A || scancode == 0x36) { // Left or Right Shift pressed
-        g_ShiftPressed = true;
-        i686_PIC_SendEndOfInterrupt(1);
-        return; // Return after sending EOI
-    } else if (scancode == 0xAA || scancode == 0xB6) { // Left or Right Shift released
-        g_ShiftPressed = false;
-        i686_PIC_SendEndOfInterrupt(1);
-        return; // Return after sending EOI
-    } else if (scancode == 0x1D) { // Ctrl pressed
-        g_CtrlPressed = true;
-        i686_PIC_SendEndOfInterrupt(1);
-        return; // Return after sending EOI
-    } else if (scancode == 0x9D) { // Ctrl released
-        g_CtrlPressed = false;
-        i686_PIC_SendEndOfInterrupt(1);
-        return; // Return after sending EOI
-    } else if (scancode == 0xE0) {
-        extended = 1;
-        i686_PIC_SendEndOfInterrupt(1);
-        return; // Return after sending EOI
-    }
+static inline bool keyboard_state_test(uint8_t key) {
+    return (g_KeyState[key >> 5] >> (key & 31)) & 1;
+}
 
-    if (extended) {
-        switch (scancode) {
-            case 0x38: // AltGr pressed
-                g_AltGrPressed = true;
-                break;
-            case 0xB8: // AltGr released
-                g_AltGrPressed = false;
-                break;
-            case 0x48: // Up Arrow
-                g_CharBuffer = KEY_UP; g_CharReady = true;
-                break;
-            case 0x50: // Down Arrow
-                g_CharBuffer = KEY_DOWN; g_CharReady = true;
-                break;
-            case 0x4B: // Left Arrow
-                g_CharBuffer = KEY_LEFT; g_CharReady = true;
-                break;
-            case 0x4D: // Right Arrow
-                g_CharBuffer = KEY_RIGHT; g_CharReady = true;
-                break;
-            case 0x49: // Page Up
-                g_CharBuffer = KEY_PAGE_UP; g_CharReady = true;
-                break;
-            case 0x51: // Page Down
-                g_CharBuffer = KEY_PAGE_DOWN; g_CharReady = true;
-                break;
-            case 0x53: // Delete
-                g_CharBuffer = KEY_DELETE; g_CharReady = true;
-        }
-        extended = 0;
-        i686_PIC_SendEndOfInterrupt(1);
-        return; // Return after sending EOI
-    }
+static uint8_t keyboard_modifiers() {
+    uint8_t modifiers = 0;
+    if (keyboard_state_test(KEYCODE_LSHIFT) || keyboard_state_test(KEYCODE_RSHIFT)) modifiers |= KEY_MOD_SHIFT;
+    if (keyboard_state_test(KEYCODE_LCTRL) || keyboard_state_test(KEYCODE_RCTRL)) modifiers |= KEY_MOD_CTRL;
+    if (keyboard_state_test(KEYCODE_ALTGR)) modifiers |= KEY_MOD_ALTGR;
+    return modifiers;
+}
 
-    // Ignore key release codes
-    if (scancode & 0x80) {
+static void keyboard_wake(void* arg) {
+    // Anyone who saw an empty ring is queued by the time we get the lock
+    uint32_t flags = spin_lock_irqsave(&g_InputLock);
+    spin_unlock_irqrestore(&g_InputLock, flags);
+    wait_queue_wake_all(&g_InputWaiters);
+}
+
+void keyboard_poke() {
+    uint32_t flags = spin_lock_irqsave(&g_InputLock);
+    g_ReaderPoked = true;
+    spin_unlock_irqrestore(&g_InputLock, flags);
+    wait_queue_wake_all(&g_InputWaiters);
+}
+
+void keyboard_irq_handler(Registers* regs) {
+    static bool extended = false; // previous byte was the E0 prefix; IRQs don't nest
+
+    uint8_t scancode = i686_inb(KEYBOARD_DATA_PORT);
+    if (scancode == SCANCODE_EXTENDED) {
+        extended = true;
         return;
     }
 
+    key_event_t event;
+    event.key = (scancode & ~SCANCODE_RELEASE) | (extended ? KEYCODE_EXTENDED : 0);
+    event.pressed = !(scancode & SCANCODE_RELEASE);
+    event.repeat = event.pressed && keyboard_state_test(event.key);
+    extended = false;
+
+    uint32_t bit = 1u << (event.key & 31);
+    if (event.pressed) {
+        g_KeyState[event.key >> 5] |= bit;
+    } else {
+        g_KeyState[event.key >> 5] &= ~bit;
+    }
+    event.modifiers = keyboard_modifiers();
+    event.time_ns = time_now_ns();
 
-    char c;
-    if (g_CtrlPressed)
-        c = scancode_ascii[scancode] & 0x1F; // Create control character
-    else if (g_AltGrPressed)
-        c = scancode_ascii_altgr[scancode];
-    else if (g_ShiftPressed)
-        c = scancode_ascii_shifted[scancode];
-    else
-        c = scancode_ascii[scancode];
-
-    if (g_CurrentInputMode == INPUT_MODE_GETCH || g_CurrentInputMode == INPUT_MODE_NONE) {
-        if (c != 0 || g_CharBuffer != -1) { // Pass through printable chars or special keys
-            if (!g_CharReady) {
-                if (c != 0) g_CharBuffer = c; // Prioritize special keys set earlier
-                g_CharReady = true;
-            }
-        }
-    } else if (g_CurrentInputMode == INPUT_MODE_GETS) {
-        // Handle special keys first
-        if (g_CharBuffer == KEY_DELETE) {
-            if (g_InputBufferIndex < strlen(g_InputBuffer)) {
-                memmove(&g_InputBuffer[g_InputBufferIndex], &g_InputBuffer[g_InputBufferIndex + 1], strlen(g_InputBuffer) - g_InputBufferIndex);
-                redraw_input_line();
-            }
-            g_CharBuffer = -1; // Consume the delete key
-            g_CharReady = false; 
-        }
-        // Now handle printable characters
-        else if (!g_InputLineReady) {
-            if (c == '\n') {
-                g_InputBuffer[g_InputBufferIndex] = '\0';
-                g_InputLineReady = true;
-                g_HistoryNavIndex = -1; // Reset history navigation on enter
-                putc('\n');
-            } else if (c == '\b') {
-                if (g_InputBufferIndex > 0) {
-                    g_InputBufferIndex--;
-                    // Let putc handle backspace logic on screen
-                    putc('\b');
-                }
-            } else if (c != 0) {
-                if (g_InputBufferIndex < INPUT_BUFFER_SIZE - 1) {
-                    g_InputBuffer[g_InputBufferIndex++] = c;
-                    putc(c); // Echo character
-                }
-            }
-        }
+    uint32_t head = g_RingHead;
+    if (head - __atomic_load_n(&g_RingTail, __ATOMIC_ACQUIRE) == KEYBOARD_RING_SIZE) {
+        // Full: the key state above is still right, only the event is lost
+        g_RingDropped++;
+        return;
     }
+    g_Ring[head & KEYBOARD_RING_MASK] = event;
+    __atomic_store_n(&g_RingHead, head + 1, __ATOMIC_RELEASE);
 
-    i686_PIC_SendEndOfInterrupt(1); // test**
+    // Waking readers keeps until after the EOI
+    deferred_queue(keyboard_wake, NULL);
 }
 
 void i686_Keyboard_Initialize(char (*history_buffer)[256], int* history_count, int* history_index, int history_size) {
@@ -218,57 +175,187 @@ void i686_Keyboard_Initialize(char (*history_buffer)[256], int* history_count, i
     i686_IRQ_RegisterHandler(1, keyboard_irq_handler);
 }
 
-void gets(char* buffer, int size) {
-    g_CurrentInputMode = INPUT_MODE_GETS;
-
-    while (!g_InputLineReady) {
-        pixelLoop();             // Keep the animation running while waiting
-        
-        // If double buffering is on, we must swap to see the pixelLoop updates
-        if (g_DoubleBufferEnabled) {
-            graphics_swap_buffer();
+// --- Consumers ---
+
+// The oldest event, left in the ring. g_InputLock held.
+static bool keyboard_peek_locked(key_event_t* event) {
+    uint32_t tail = g_RingTail;
+    if (tail == __atomic_load_n(&g_RingHead, __ATOMIC_ACQUIRE)) return false;
+    *event = g_Ring[tail & KEYBOARD_RING_MASK];
+    return true;
+}
+
+// g_InputLock held
+static void keyboard_pop_locked() {
+    __atomic_store_n(&g_RingTail, g_RingTail + 1, __ATOMIC_RELEASE);
+}
+
+// Sleeps until the ring has something in it, or with `pokeable` until
+// keyboard_poke() too. Called and returns with g_InputLock held and
+// interrupts off.
+static void keyboard_wait_locked(bool pokeable) {
+    key_event_t event;
+    while (!keyboard_peek_locked(&event) && !(pokeable && g_ReaderPoked)) {
+        if (thread_is_running()) {
+            wait_queue_wait(&g_InputWaiters, &g_InputLock);
+        } else {
+            // No scheduler to block in; halt until the next interrupt
+            spin_unlock(&g_InputLock);
+            __asm__ volatile("sti\n\thlt\n\tcli");
+            spin_lock(&g_InputLock);
         }
+    }
+}
 
-        __asm__ volatile("hlt"); // Wait for an interrupt
+// What getch() returns for an event, or 0 if it doesn't type anything
+// (releases, modifiers, keys without a mapping)
+static int keyboard_translate(const key_event_t* event) {
+    if (!event->pressed) return 0;
+
+    if (event->key & KEYCODE_EXTENDED) {
+        switch (event->key) {
+            case KEYCODE_UP:        return KEY_UP;
+            case KEYCODE_DOWN:      return KEY_DOWN;
+            case KEYCODE_LEFT:      return KEY_LEFT;
+            case KEYCODE_RIGHT:     return KEY_RIGHT;
+            case KEYCODE_PAGE_UP:   return KEY_PAGE_UP;
+            case KEYCODE_PAGE_DOWN: return KEY_PAGE_DOWN;
+            case KEYCODE_DELETE:    return KEY_DELETE;
+        }
+        return 0;
     }
 
-    __asm__ volatile("cli"); // Disable interrupts for critical section
+    char c;
+    if (event->modifiers & KEY_MOD_CTRL)
+        c = scancode_ascii[event->key] & 0x1F; // Create control character
+    else if (event->modifiers & KEY_MOD_ALTGR)
+        c = scancode_ascii_altgr[event->key];
+    else if (event->modifiers & KEY_MOD_SHIFT)
+        c = scancode_ascii_shifted[event->key];
+    else
+        c = scancode_ascii[event->key];
+    return (uint8_t)c;
+}
 
-    int i;
-    for (i = 0; g_InputBuffer[i] != '\0' && i < size - 1; i++) {
-        buffer[i] = g_InputBuffer[i];
-    }
-    buffer[i] = '\0';
+bool keyboard_read_event(key_event_t* event) {
+    uint32_t flags = spin_lock_irqsave(&g_InputLock);
+    bool got = keyboard_peek_locked(event);
+    if (got) keyboard_pop_locked();
+    spin_unlock_irqrestore(&g_InputLock, flags);
+    return got;
+}
 
-    g_InputBufferIndex = 0;
-    memset(g_InputBuffer, 0, sizeof(g_InputBuffer)); // CRITICAL: Clear buffer for next use
-    g_InputLineReady = false;
+void keyboard_wait_event(key_event_t* event) {
+    uint32_t flags = spin_lock_irqsave(&g_InputLock);
+    keyboard_wait_locked(false);
+    keyboard_peek_locked(event);
+    keyboard_pop_locked();
+    spin_unlock_irqrestore(&g_InputLock, flags);
+}
 
-    g_CurrentInputMode = INPUT_MODE_NONE;
+void keyboard_flush_events() {
+    uint32_t flags = spin_lock_irqsave(&g_InputLock);
+    __atomic_store_n(&g_RingTail, __atomic_load_n(&g_RingHead, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+    spin_unlock_irqrestore(&g_InputLock, flags);
+}
 
-    __asm__ volatile("sti"); // Re-enable interrupts
+bool keyboard_key_down(uint8_t key) {
+    return keyboard_state_test(key);
 }
 
-int getch() {
-    g_CurrentInputMode = INPUT_MODE_GETCH;
+uint32_t keyboard_dropped_events() {
+    return g_RingDropped;
+}
 
-    while (!g_CharReady) {
-        __asm__ volatile("hlt"); // Wait for a key press
+// getch(), except that with `pokeable` a keyboard_poke() makes it return 0
+static int keyboard_getch(bool pokeable) {
+    console_flush(); // Whatever was printed last must be visible while we wait
+
+    uint32_t flags = spin_lock_irqsave(&g_InputLock);
+    int c = 0;
+    while (c == 0) {
+        key_event_t event;
+        keyboard_wait_locked(pokeable);
+        if (!keyboard_peek_locked(&event)) {
+            g_ReaderPoked = false;
+            break;
+        }
+        keyboard_pop_locked();
+        c = keyboard_translate(&event);
     }
+    spin_unlock_irqrestore(&g_InputLock, flags);
+    return c;
+}
 
-    __asm__ volatile("cli"); // Disable interrupts for critical section
+void gets(char* buffer, int size) {
+    // The timer only pokes us; the indicator is drawn here, in the thread
+    // that owns the console, so it never races a render or a scroll
+    pixelLoop_start();
 
-    int c = g_CharBuffer;
-    g_CharReady = false;
-    g_CharBuffer = -1;
+    g_InputBufferIndex = 0;
+    memset(g_InputBuffer, 0, sizeof(g_InputBuffer));
+
+    for (;;) {
+        int c = keyboard_getch(true);
+        if (c == 0) {
+            // An app owns the screen; leave its frame alone
+            if (!graphics_app_active()) {
+                pixelLoop();
+                // Only dirty tiles are copied, so this is normally just the dots
+                if (g_DoubleBufferEnabled) graphics_swap_buffer();
+            }
+        } else if (c == '\n') {
+            putc('\n');
+            break;
+        } else if (c == KEY_DELETE) {
+            if (g_InputBufferIndex < strlen(g_InputBuffer)) {
+                memmove(&g_InputBuffer[g_InputBufferIndex], &g_InputBuffer[g_InputBufferIndex + 1], strlen(g_InputBuffer) - g_InputBufferIndex);
+                redraw_input_line();
+            }
+        } else if (c == '\b') {
+            if (g_InputBufferIndex > 0) {
+                g_InputBuffer[--g_InputBufferIndex] = '\0';
+                // Let putc handle backspace logic on screen
+                putc('\b');
+            }
+        } else if (c > 0 && c < KEY_UP) {
+            if (g_InputBufferIndex < INPUT_BUFFER_SIZE - 1) {
+                g_InputBuffer[g_InputBufferIndex++] = (char)c;
+                putc((char)c); // Echo character
+            }
+        }
+    }
+    g_HistoryNavIndex = -1; // Reset history navigation on enter
+
+    int i;
+    for (i = 0; g_InputBuffer[i] != '\0' && i < size - 1; i++) {
+        buffer[i] = g_InputBuffer[i];
+    }
+    buffer[i] = '\0';
 
-    g_CurrentInputMode = INPUT_MODE_NONE;
+    g_InputBufferIndex = 0;
+    memset(g_InputBuffer, 0, sizeof(g_InputBuffer)); // CRITICAL: Clear buffer for next use
 
-    __asm__ volatile("sti"); // Re-enable interrupts
+    pixelLoop_stop();
+}
 
-    return c;
+int getch() {
+    return keyboard_getch(false);
 }
 
 int kbhit() {
-    return g_CharReady;
-}
\ No newline at end of file
+    // Events that wouldn't type anything are dropped on the way, so a
+    // following getch() returns at once
+    uint32_t flags = spin_lock_irqsave(&g_InputLock);
+    key_event_t event;
+    int hit = 0;
+    while (keyboard_peek_locked(&event)) {
+        if (keyboard_translate(&event)) {
+            hit = 1;
+            break;
+        }
+        keyboard_pop_locked();
+    }
+    spin_unlock_irqrestore(&g_InputLock, flags);
+    return hit;
+}
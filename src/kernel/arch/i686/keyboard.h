@@ -1,5 +1,7 @@
 #pragma once
 
+#include <stdint.h>
+#include "stdbool.h"
 #include "isr.h"
 
 // Ensure SCROLLBACK_LINES and SCREEN_WIDTH are defined as macros before this line
@@ -27,12 +29,67 @@ enum {
     KEY_PAGE_DOWN,
 };
 
+// Key codes for the event and key state API: the scancode set 1 make code,
+// plus KEYCODE_EXTENDED for keys sent with the E0 prefix
+#define KEYCODE_EXTENDED    0x80
+#define KEYCODE_ESCAPE      0x01
+#define KEYCODE_W           0x11
+#define KEYCODE_LCTRL       0x1D
+#define KEYCODE_A           0x1E
+#define KEYCODE_S           0x1F
+#define KEYCODE_D           0x20
+#define KEYCODE_LSHIFT      0x2A
+#define KEYCODE_RSHIFT      0x36
+#define KEYCODE_SPACE       0x39
+#define KEYCODE_RCTRL       (KEYCODE_EXTENDED | 0x1D)
+#define KEYCODE_ALTGR       (KEYCODE_EXTENDED | 0x38)
+#define KEYCODE_UP          (KEYCODE_EXTENDED | 0x48)
+#define KEYCODE_PAGE_UP     (KEYCODE_EXTENDED | 0x49)
+#define KEYCODE_LEFT        (KEYCODE_EXTENDED | 0x4B)
+#define KEYCODE_RIGHT       (KEYCODE_EXTENDED | 0x4D)
+#define KEYCODE_DOWN        (KEYCODE_EXTENDED | 0x50)
+#define KEYCODE_PAGE_DOWN   (KEYCODE_EXTENDED | 0x51)
+#define KEYCODE_DELETE      (KEYCODE_EXTENDED | 0x53)
+
+// Modifiers held when an event happened
+#define KEY_MOD_SHIFT       0x01
+#define KEY_MOD_CTRL        0x02
+#define KEY_MOD_ALTGR       0x04
+
+typedef struct {
+    uint64_t time_ns;           // time_now_ns() in the IRQ
+    uint8_t key;                // KEYCODE_*
+    bool pressed;               // false for a release
+    bool repeat;                // typematic repeat of a key already down
+    uint8_t modifiers;          // KEY_MOD_*
+} key_event_t;
+
 void i686_Keyboard_Initialize(char (*history_buffer)[256], int* history_count, int* history_index, int history_size);
 void keyboard_irq_handler(Registers* regs);
 
+// Every press and release goes into a ring filled by the IRQ; all the
+// reading functions below take from it, so mixing them is fine. Only
+// events that don't fit the ring are lost, and keyboard_key_down stays
+// right even then.
+
+// Takes the oldest event without waiting. False if there is none.
+bool keyboard_read_event(key_event_t* event);
+// Takes the oldest event, sleeping until there is one
+void keyboard_wait_event(key_event_t* event);
+// Drops every pending event, e.g. the Enter that started a game
+void keyboard_flush_events();
+// Whether `key` (KEYCODE_*) is held down right now
+bool keyboard_key_down(uint8_t key);
+// Events lost to a full ring since boot
+uint32_t keyboard_dropped_events();
+// Wakes a gets() in progress without a key so it can redraw its indicator.
+// Safe from IRQ and deferred context.
+void keyboard_poke();
+
 // Reads a line of input from the keyboard into the provided buffer.
 void gets(char* buffer, int size);
 
 // Reads a single character or special key code from the keyboard.
 int getch();
-int kbhit();
\ No newline at end of file
+// Whether getch() would return without waiting
+int kbhit();
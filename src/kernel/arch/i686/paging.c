@@ -3,6 +3,32 @@
 #include "stdio.h"
 #include <arch/i686/io.h>
 #include "vbe.h"
+#include "cpu.h"
+#include "apic.h"
+#include "smp.h"
+#include <sync/spinlock.h>
+
+#define MSR_IA32_PAT            0x277
+#define MSR_MTRR_CAP            0xFE
+#define MSR_MTRR_PHYSBASE(n)    (0x200 + 2 * (n))
+#define MSR_MTRR_PHYSMASK(n)    (0x201 + 2 * (n))
+#define MTRR_CAP_WC             (1 << 10)
+#define MTRR_MASK_VALID         (1 << 11)
+#define MTRR_TYPE_WC            0x01
+#define PAT_TYPE_WC             0x01
+
+typedef enum { WC_NONE, WC_PAT, WC_MTRR } wc_method_t;
+static wc_method_t g_WCMethod = WC_NONE;
+
+// The variable MTRR the boot CPU set up, for the other CPUs to copy
+static uint32_t g_WCMtrr;
+static uint64_t g_WCMtrrBase;
+static uint64_t g_WCMtrrMask;
+
+// TLB shootdown state, see i686_Paging_FlushOtherCpus
+static spinlock_t g_ShootdownLock = SPINLOCK_INIT_NAMED("shootdown");
+static volatile uint32_t g_ShootdownPending = 0;
+static volatile bool g_FlushRequested[SMP_MAX_CPUS];
 
 // Statically allocate the initial page directory and one page table
 // Both must be 4KB aligned.
@@ -12,6 +38,11 @@ uint32_t page_directory[1024] __attribute__((aligned(4096)));
 // mapping hardware regions such as high-memory MMIO BARs.
 uint32_t page_tables[1024][1024] __attribute__((aligned(4096)));
 
+// Guards the page table pool and the directory entries that point into it;
+// vmm_alloc and the framebuffer mappings can run on different CPUs at once
+static spinlock_t g_PagingLock = SPINLOCK_INIT_NAMED("paging");
+static int g_PageTablesUsed = 0;
+
 void page_fault_handler(Registers* regs) {
     // The faulting address is stored in CR2
     uint32_t faulting_address;
@@ -23,7 +54,26 @@ void page_fault_handler(Registers* regs) {
     i686_Panic();
 }
 
+static uint32_t paging_cache_flags(paging_cache_t cache) {
+    switch (cache) {
+        case PAGING_CACHE_UNCACHED:
+            return PAGE_NOCACHE | PAGE_WRITETHROUGH;
+        case PAGING_CACHE_WRITE_COMBINING:
+            // With an MTRR (or nothing better) the default PTE bits are left alone
+            return g_WCMethod == WC_PAT ? PAGE_WRITETHROUGH : 0;
+        default:
+            return 0;
+    }
+}
+
 void i686_Paging_Map_Range(uint32_t virt, uint32_t phys, uint32_t size) {
+    i686_Paging_Map_Range_Cached(virt, phys, size, PAGING_CACHE_DEFAULT);
+}
+
+void i686_Paging_Map_Range_Cached(uint32_t virt, uint32_t phys, uint32_t size, paging_cache_t cache) {
+    uint32_t cache_flags = paging_cache_flags(cache);
+
+    uint32_t flags = spin_lock_irqsave(&g_PagingLock);
     for (uint32_t i = 0; i < size; i += 4096) {
         uint32_t v_addr = virt + i;
         uint32_t p_addr = phys + i;
@@ -32,29 +82,195 @@ void i686_Paging_Map_Range(uint32_t virt, uint32_t phys, uint32_t size) {
         uint32_t pt_idx = (v_addr >> 12) & 0x3FF;
 
         if (pd_idx >= 1024) {
-            return;
+            break;
         }
 
         if (!(page_directory[pd_idx] & PAGE_PRESENT)) {
-            static int pt_pool_idx = 0;
-            if (pt_pool_idx >= 1024) {
-                return;
+            if (g_PageTablesUsed >= 1024) {
+                break;
             }
-            uint32_t pt_phys = (uint32_t)page_tables[pt_pool_idx++];
+            uint32_t pt_phys = (uint32_t)page_tables[g_PageTablesUsed++];
             page_directory[pd_idx] = pt_phys | PAGE_PRESENT | PAGE_READWRITE | 0x04; // Add USER bit
         }
 
         uint32_t* table = (uint32_t*)(page_directory[pd_idx] & 0xFFFFF000);
-        table[pt_idx] = p_addr | PAGE_PRESENT | PAGE_READWRITE | 0x04; // Add USER bit
+        table[pt_idx] = p_addr | PAGE_PRESENT | PAGE_READWRITE | 0x04 | cache_flags; // Add USER bit
+    }
+    spin_unlock_irqrestore(&g_PagingLock, flags);
+}
+
+void i686_Paging_Set_Cache(uint32_t virt, uint32_t size, paging_cache_t cache) {
+    uint32_t cache_flags = paging_cache_flags(cache);
+
+    for (uint32_t i = 0; i < size; i += 4096) {
+        uint32_t v_addr = virt + i;
+        uint32_t pde = page_directory[v_addr >> 22];
+        if (!(pde & PAGE_PRESENT)) continue;
+
+        uint32_t* table = (uint32_t*)(pde & 0xFFFFF000);
+        uint32_t* pte = &table[(v_addr >> 12) & 0x3FF];
+        if (!(*pte & PAGE_PRESENT)) continue;
+
+        *pte = (*pte & ~(PAGE_NOCACHE | PAGE_WRITETHROUGH)) | cache_flags;
+        __asm__ volatile("invlpg (%0)" : : "r"(v_addr) : "memory");
+    }
+    i686_Paging_FlushOtherCpus();
+}
+
+// --- TLB shootdown ---
+// Each CPU caches translations on its own. Whoever changes or removes one
+// interrupts the others, which reload cr3, and waits until all have. Only
+// one shootdown runs at a time; a CPU waiting for its turn serves the one
+// in progress, so two of them can't end up waiting on each other.
+
+static void paging_flush_if_requested() {
+    uint32_t cpu = i686_SMP_CpuIndex();
+    if (!g_FlushRequested[cpu]) return;
+    g_FlushRequested[cpu] = false;
+    __asm__ volatile("mov %%cr3, %%eax\n\tmov %%eax, %%cr3" : : : "eax", "memory");
+    __atomic_sub_fetch(&g_ShootdownPending, 1, __ATOMIC_RELEASE);
+}
+
+static void paging_shootdown_interrupt(Registers* regs) {
+    i686_APIC_SendEndOfInterrupt();
+    paging_flush_if_requested();
+}
+
+void i686_Paging_FlushOtherCpus() {
+    uint32_t count = i686_SMP_CpuCount();
+    if (count < 2) return;
+
+    uint32_t flags = irq_save();
+    while (!spin_trylock(&g_ShootdownLock)) {
+        paging_flush_if_requested();
+        __asm__ volatile("pause");
+    }
+
+    uint32_t self = i686_SMP_CpuIndex();
+    g_ShootdownPending = count - 1;
+    for (uint32_t cpu = 0; cpu < count; cpu++) {
+        if (cpu == self) continue;
+        g_FlushRequested[cpu] = true;
+        i686_SMP_SendIPI(cpu, PAGING_SHOOTDOWN_VECTOR);
+    }
+    while (__atomic_load_n(&g_ShootdownPending, __ATOMIC_ACQUIRE)) {
+        __asm__ volatile("pause");
+    }
+
+    spin_unlock(&g_ShootdownLock);
+    irq_restore(flags);
+}
+
+const char* i686_Paging_WC_Method() {
+    switch (g_WCMethod) {
+        case WC_PAT:  return "PAT";
+        case WC_MTRR: return "MTRR";
+        default:      return "none";
+    }
+}
+
+// Reprograms PAT entry 1 (PWT=1, PCD=0) from write-through to write-combining.
+// Nothing else in the kernel sets PWT alone, so the change is safe.
+static bool paging_setup_pat() {
+    if (!i686_CPU_HasFeature(CPUID_EDX_PAT) || !i686_CPU_HasFeature(CPUID_EDX_MSR)) {
+        return false;
+    }
+
+    uint64_t pat = i686_ReadMSR(MSR_IA32_PAT);
+    pat &= ~(0xFFull << 8);
+    pat |= (uint64_t)PAT_TYPE_WC << 8;
+    i686_WriteMSR(MSR_IA32_PAT, pat);
+    return true;
+}
+
+static uint32_t paging_phys_address_bits() {
+    uint32_t eax, ebx, ecx, edx;
+    i686_CPUID(0x80000000, &eax, &ebx, &ecx, &edx);
+    if (eax < 0x80000008) return 36;
+    i686_CPUID(0x80000008, &eax, &ebx, &ecx, &edx);
+    return eax & 0xFF;
+}
+
+static void paging_write_mtrr(uint32_t n, uint64_t base, uint64_t mask) {
+    // Intel's update sequence: caches off and flushed while the MTRR changes
+    uint32_t cr0;
+    uint32_t flags = irq_save();
+    __asm__ volatile("mov %%cr0, %0" : "=r"(cr0));
+    __asm__ volatile("mov %0, %%cr0" : : "r"((cr0 | 0x40000000) & ~0x20000000)); // CD=1, NW=0
+    __asm__ volatile("wbinvd" : : : "memory");
+
+    i686_WriteMSR(MSR_MTRR_PHYSBASE(n), base);
+    i686_WriteMSR(MSR_MTRR_PHYSMASK(n), mask);
+
+    __asm__ volatile("wbinvd" : : : "memory");
+    __asm__ volatile("mov %0, %%cr0" : : "r"(cr0));
+    irq_restore(flags);
+}
+
+// Covers [phys, phys + size) with a write-combining variable-range MTRR.
+// MTRR ranges must be a power of two in size and aligned to it.
+static bool paging_setup_mtrr(uint32_t phys, uint32_t size) {
+    if (!i686_CPU_HasFeature(CPUID_EDX_MTRR) || !i686_CPU_HasFeature(CPUID_EDX_MSR)) {
+        return false;
+    }
+
+    uint64_t cap = i686_ReadMSR(MSR_MTRR_CAP);
+    if (!(cap & MTRR_CAP_WC)) return false;
+
+    uint32_t range = 4096;
+    while (range < size) range <<= 1;
+    if (phys & (range - 1)) return false;
+
+    uint32_t count = cap & 0xFF;
+    for (uint32_t n = 0; n < count; n++) {
+        if (i686_ReadMSR(MSR_MTRR_PHYSMASK(n)) & MTRR_MASK_VALID) continue;
+
+        uint64_t phys_mask = (1ull << paging_phys_address_bits()) - 1;
+        uint64_t mask = (~(uint64_t)(range - 1) & phys_mask & ~0xFFFull) | MTRR_MASK_VALID;
+
+        g_WCMtrr = n;
+        g_WCMtrrBase = phys | MTRR_TYPE_WC;
+        g_WCMtrrMask = mask;
+        paging_write_mtrr(n, g_WCMtrrBase, g_WCMtrrMask);
+        return true;
+    }
+    return false;
+}
+
+void i686_Paging_Unmap_Range(uint32_t virt, uint32_t size) {
+    for (uint32_t i = 0; i < size; i += 4096) {
+        uint32_t v_addr = virt + i;
+        uint32_t pd_idx = v_addr >> 22;
+        uint32_t pt_idx = (v_addr >> 12) & 0x3FF;
+
+        if (!(page_directory[pd_idx] & PAGE_PRESENT)) {
+            continue;
+        }
+
+        // Page tables are never released; they come from a static pool
+        uint32_t* table = (uint32_t*)(page_directory[pd_idx] & 0xFFFFF000);
+        table[pt_idx] = 0;
+        __asm__ volatile("invlpg (%0)" : : "r"(v_addr) : "memory");
     }
 }
 
+uint32_t i686_Paging_Get_Physical(uint32_t virt) {
+    uint32_t pde = page_directory[virt >> 22];
+    if (!(pde & PAGE_PRESENT)) return 0;
+
+    uint32_t* table = (uint32_t*)(pde & 0xFFFFF000);
+    uint32_t pte = table[(virt >> 12) & 0x3FF];
+    if (!(pte & PAGE_PRESENT)) return 0;
+    return (pte & 0xFFFFF000) | (virt & 0xFFF);
+}
+
 void i686_Paging_Initialize() {
     // Clear directory
     for (int i = 0; i < 1024; i++) page_directory[i] = 0;
 
     // Register page fault handler
     i686_ISR_RegisterHandler(14, page_fault_handler);
+    i686_ISR_RegisterHandler(PAGING_SHOOTDOWN_VECTOR, paging_shootdown_interrupt);
 
     // 1. Identity map the first 512MB
     // This covers the kernel, stack, and the 256MB heap
@@ -66,8 +282,15 @@ void i686_Paging_Initialize() {
     if (g_vbe_screen && g_vbe_screen->physical_buffer) {
         uint32_t vbe_phys = g_vbe_screen->physical_buffer;
         uint32_t vbe_size = g_vbe_screen->height * g_vbe_screen->pitch;
-        printf("Paging: Mapping VBE Framebuffer at 0x%x (Size: %u KB)...\n", vbe_phys, vbe_size / 1024);
-        i686_Paging_Map_Range(vbe_phys, vbe_phys, vbe_size);
+        // Cover both pages so page flipping gets the same caching
+        if (paging_setup_pat()) {
+            g_WCMethod = WC_PAT;
+        } else if (paging_setup_mtrr(vbe_phys, vbe_size * 2)) {
+            g_WCMethod = WC_MTRR;
+        }
+        printf("Paging: Mapping VBE Framebuffer at 0x%x (Size: %u KB, write-combining: %s)...\n",
+               vbe_phys, vbe_size / 1024, i686_Paging_WC_Method());
+        i686_Paging_Map_Range_Cached(vbe_phys, vbe_phys, vbe_size, PAGING_CACHE_WRITE_COMBINING);
     }
 
     // 3. Enable Paging
@@ -85,4 +308,13 @@ void i686_Paging_Enable(uint32_t page_directory_phys) {
         : "r"(page_directory_phys)
         : "eax", "memory"
     );
-}
\ No newline at end of file
+}
+
+void i686_Paging_InitializeAP() {
+    // PAT and MTRRs are per CPU, and all of them must agree on the framebuffer
+    if (g_WCMethod == WC_PAT) {
+        paging_setup_pat();
+    } else if (g_WCMethod == WC_MTRR) {
+        paging_write_mtrr(g_WCMtrr, g_WCMtrrBase, g_WCMtrrMask);
+    }
+}
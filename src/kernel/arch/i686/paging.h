@@ -5,7 +5,33 @@
 #define PAGE_PRESENT    0x01
 #define PAGE_READWRITE  0x02
 #define PAGE_USER       0x04
+#define PAGE_WRITETHROUGH 0x08  // PWT, selects PAT entry 1 (reprogrammed to write-combining)
+#define PAGE_NOCACHE    0x10    // PCD, with PWT selects PAT entry 3 (uncached)
+
+// IPI asking the other CPUs to flush their TLBs
+#define PAGING_SHOOTDOWN_VECTOR 0xF1
+
+typedef enum {
+    PAGING_CACHE_DEFAULT,           // write-back RAM
+    PAGING_CACHE_UNCACHED,
+    PAGING_CACHE_WRITE_COMBINING,   // for framebuffers; falls back to an MTRR or UC
+} paging_cache_t;
 
 void i686_Paging_Initialize();
 void i686_Paging_Map_Range(uint32_t virt, uint32_t phys, uint32_t size);
+void i686_Paging_Map_Range_Cached(uint32_t virt, uint32_t phys, uint32_t size, paging_cache_t cache);
+// Changes the caching of an existing mapping (and flushes its TLB entries
+// on every CPU)
+void i686_Paging_Set_Cache(uint32_t virt, uint32_t size, paging_cache_t cache);
+// "PAT", "MTRR" or "none", depending on how write-combining is provided
+const char* i686_Paging_WC_Method();
+// Only flushes this CPU's TLB; follow with i686_Paging_FlushOtherCpus
+void i686_Paging_Unmap_Range(uint32_t virt, uint32_t size);
+// Makes the other CPUs drop their cached translations and waits until they
+// have. Must not be called holding a spinlock another CPU may spin on with
+// interrupts off, as that CPU could never answer.
+void i686_Paging_FlushOtherCpus();
+// Gives an application processor the boot CPU's PAT/MTRR setup
+void i686_Paging_InitializeAP();
+uint32_t i686_Paging_Get_Physical(uint32_t virt);
 void i686_Paging_Enable(uint32_t page_directory_phys);
\ No newline at end of file
@@ -0,0 +1,83 @@
+; Real-mode entry point of the application processors.
+;
+; A startup IPI starts a CPU in real mode at vector * 0x1000, so
+; i686_SMP_StartCpus copies everything from i686_SMP_Trampoline to
+; i686_SMP_TrampolineEnd to SMP_TRAMPOLINE_ADDR and fills in the parameter
+; block at the end. The code runs from that copy; every address in it is
+; computed against SMP_TRAMPOLINE_ADDR rather than where it was linked.
+
+%define TRAMPOLINE_ADDR     0x8000
+%define REL(label)          (TRAMPOLINE_ADDR + ((label) - i686_SMP_Trampoline))
+
+section .text
+
+global i686_SMP_Trampoline
+global i686_SMP_TrampolineParams
+global i686_SMP_TrampolineEnd
+
+[bits 16]
+
+i686_SMP_Trampoline:
+    cli
+    cld
+    xor ax, ax
+    mov ds, ax
+
+    ; flat 32-bit segments until the kernel loads this CPU's own GDT
+    lgdt [REL(trampoline_gdtr)]
+    mov eax, cr0
+    or eax, 1
+    mov cr0, eax
+    jmp dword 0x08:REL(trampoline_32)
+
+[bits 32]
+
+trampoline_32:
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov ss, ax
+    xor ax, ax
+    mov fs, ax
+    mov gs, ax
+
+    ; the boot CPU's paging and FPU/SSE setup; this page is identity mapped,
+    ; so execution carries on here once paging is on
+    mov eax, [REL(params_cr4)]
+    mov cr4, eax
+    mov eax, [REL(params_cr3)]
+    mov cr3, eax
+    mov eax, [REL(params_cr0)]
+    mov cr0, eax
+
+    mov esp, [REL(params_stack)]
+    xor ebp, ebp
+    push dword [REL(params_cpu)]
+    call [REL(params_entry)]
+
+.hang:
+    cli
+    hlt
+    jmp .hang
+
+align 8
+trampoline_gdt:
+    dq 0                            ; null
+    dq 0x00CF9A000000FFFF           ; 0x08: code, base 0, 4 GB
+    dq 0x00CF92000000FFFF           ; 0x10: data, base 0, 4 GB
+
+trampoline_gdtr:
+    dw 3 * 8 - 1
+    dd REL(trampoline_gdt)
+
+; layout must match SmpTrampolineParams in smp.c
+align 4
+i686_SMP_TrampolineParams:
+params_cr0:     dd 0
+params_cr3:     dd 0
+params_cr4:     dd 0
+params_stack:   dd 0
+params_entry:   dd 0                ; void __attribute__((cdecl)) entry(uint32_t cpu)
+params_cpu:     dd 0
+
+i686_SMP_TrampolineEnd:
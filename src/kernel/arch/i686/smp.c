@@ -0,0 +1,138 @@
+#include "smp.h"
+#include "apic.h"
+#include "gdt.h"
+#include "idt.h"
+#include "paging.h"
+#include "memory.h"
+#include "stdio.h"
+#include <stddef.h>
+#include <time.h>
+
+// INIT-SIPI-SIPI timing from the MP specification
+#define SMP_INIT_DELAY_NS       10000000
+#define SMP_SIPI_DELAY_NS       200000
+#define SMP_START_TIMEOUT_NS    100000000
+
+// Layout of the parameter block at the end of the trampoline (smp.asm)
+typedef struct {
+    uint32_t cr0;
+    uint32_t cr3;
+    uint32_t cr4;
+    uint32_t stack;
+    uint32_t entry;
+    uint32_t cpu;
+} __attribute__((packed)) SmpTrampolineParams;
+
+extern uint8_t i686_SMP_Trampoline[];
+extern uint8_t i686_SMP_TrampolineParams[];
+extern uint8_t i686_SMP_TrampolineEnd[];
+
+PerCpu g_PerCpu[SMP_MAX_CPUS];
+
+static volatile uint32_t g_CpuCount = 1;
+static SmpEntry g_ApEntry = NULL;
+
+static void i686_SMP_Delay(uint64_t ns)
+{
+    uint64_t end = time_now_ns() + ns;
+    while (time_now_ns() < end) {
+        __asm__ volatile("pause");
+    }
+}
+
+// Where an AP lands once the trampoline has it in protected mode with paging
+static void __attribute__((cdecl)) i686_SMP_ApMain(uint32_t index)
+{
+    i686_GDT_InitializeCpu(index);
+    // The IDT itself is shared; only the register is per CPU
+    i686_IDT_Initialize();
+    // cr0/cr4 came from the boot CPU, but the FPU itself starts out unset
+    __asm__ volatile("fninit");
+    i686_Paging_InitializeAP();
+    i686_APIC_InitializeAP();
+
+    __atomic_store_n(&g_PerCpu[index].online, true, __ATOMIC_RELEASE);
+    g_ApEntry();
+
+    for (;;) {
+        __asm__ volatile("cli\n\thlt");
+    }
+}
+
+static bool i686_SMP_StartCpu(uint32_t index, uint8_t apic_id)
+{
+    PerCpu* cpu = &g_PerCpu[index];
+    cpu->stack = (uint8_t*)malloc(SMP_AP_STACK_SIZE);
+    if (!cpu->stack) return false;
+    cpu->apic_id = apic_id;
+
+    SmpTrampolineParams* params = (SmpTrampolineParams*)(SMP_TRAMPOLINE_ADDR +
+        (i686_SMP_TrampolineParams - i686_SMP_Trampoline));
+    params->stack = ((uint32_t)cpu->stack + SMP_AP_STACK_SIZE) & ~15u;
+    params->cpu = index;
+
+    i686_APIC_SendInit(apic_id);
+    i686_SMP_Delay(SMP_INIT_DELAY_NS);
+
+    // The second SIPI is only for CPUs that missed the first
+    for (int attempt = 0; attempt < 2; attempt++) {
+        i686_APIC_SendStartup(apic_id, SMP_TRAMPOLINE_ADDR >> 12);
+        i686_SMP_Delay(SMP_SIPI_DELAY_NS);
+        if (__atomic_load_n(&cpu->online, __ATOMIC_ACQUIRE)) return true;
+    }
+
+    uint64_t end = time_now_ns() + SMP_START_TIMEOUT_NS;
+    while (time_now_ns() < end) {
+        if (__atomic_load_n(&cpu->online, __ATOMIC_ACQUIRE)) return true;
+        __asm__ volatile("pause");
+    }
+
+    // Its stack stays allocated; the CPU might still turn up and use it
+    return false;
+}
+
+uint32_t i686_SMP_StartCpus(const uint8_t* apic_ids, int count, SmpEntry entry)
+{
+    if (!i686_APIC_IsEnabled()) return g_CpuCount;
+
+    uint32_t self = i686_APIC_GetId();
+    g_PerCpu[0].apic_id = self;
+    g_PerCpu[0].online = true;
+    g_ApEntry = entry;
+
+    memcpy((void*)SMP_TRAMPOLINE_ADDR, i686_SMP_Trampoline, i686_SMP_TrampolineEnd - i686_SMP_Trampoline);
+
+    SmpTrampolineParams* params = (SmpTrampolineParams*)(SMP_TRAMPOLINE_ADDR +
+        (i686_SMP_TrampolineParams - i686_SMP_Trampoline));
+    __asm__ volatile("mov %%cr0, %0" : "=r"(params->cr0));
+    __asm__ volatile("mov %%cr3, %0" : "=r"(params->cr3));
+    __asm__ volatile("mov %%cr4, %0" : "=r"(params->cr4));
+    params->entry = (uint32_t)i686_SMP_ApMain;
+
+    // One at a time: they all share the trampoline's parameters
+    for (int i = 0; i < count && g_CpuCount < SMP_MAX_CPUS; i++) {
+        if (apic_ids[i] == self) continue;
+
+        uint32_t index = g_CpuCount;
+        if (i686_SMP_StartCpu(index, apic_ids[i])) {
+            __atomic_store_n(&g_CpuCount, index + 1, __ATOMIC_RELEASE);
+        } else {
+            printf("SMP: CPU with APIC id %u did not start\n", apic_ids[i]);
+            // Its index may still be in use if it turns up late, so stop here
+            break;
+        }
+    }
+
+    printf("SMP: %u CPU%s online\n", g_CpuCount, g_CpuCount == 1 ? "" : "s");
+    return g_CpuCount;
+}
+
+uint32_t i686_SMP_CpuCount()
+{
+    return __atomic_load_n(&g_CpuCount, __ATOMIC_ACQUIRE);
+}
+
+void i686_SMP_SendIPI(uint32_t index, uint8_t vector)
+{
+    i686_APIC_SendIPI(g_PerCpu[index].apic_id, vector);
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <stdint.h>
+#include "stdbool.h"
+
+// Multiprocessor bring-up and per-CPU data.
+//
+// Every CPU has its own GDT whose i686_GDT_PERCPU_SEGMENT entry is based at
+// that CPU's PerCpu block, and keeps gs loaded with it in the kernel. The
+// same selector therefore reaches different memory on each CPU, and a field
+// read with a single gs-relative load is right even if the thread migrates
+// right after. Anything else taken from the block needs interrupts off.
+
+#define SMP_MAX_CPUS            8
+#define SMP_TRAMPOLINE_ADDR     0x8000      // page below 1 MB the SIPI vector points at
+#define SMP_AP_STACK_SIZE       (16 * 1024)
+
+typedef struct PerCpu {
+    struct PerCpu* self;        // gs:0, so a pointer to the block is one load
+    uint32_t index;             // 0 for the boot CPU
+    void* thread;               // the scheduler's current thread
+    uint32_t isr_depth;
+    uint32_t apic_id;
+    uint32_t apic_timer_mode;   // LVT timer value last written
+    volatile bool in_tail;
+    volatile bool online;
+    uint8_t* stack;             // boot stack of an AP
+} PerCpu;
+
+typedef void (*SmpEntry)();
+
+extern PerCpu g_PerCpu[SMP_MAX_CPUS];
+
+static inline PerCpu* i686_SMP_This()
+{
+    PerCpu* cpu;
+    __asm__ volatile("mov %%gs:%c1, %0" : "=r"(cpu) : "i"(__builtin_offsetof(PerCpu, self)));
+    return cpu;
+}
+
+static inline uint32_t i686_SMP_CpuIndex()
+{
+    uint32_t index;
+    __asm__ volatile("mov %%gs:%c1, %0" : "=r"(index) : "i"(__builtin_offsetof(PerCpu, index)));
+    return index;
+}
+
+static inline void* i686_SMP_CurrentThread()
+{
+    void* thread;
+    __asm__ volatile("mov %%gs:%c1, %0" : "=r"(thread) : "i"(__builtin_offsetof(PerCpu, thread)));
+    return thread;
+}
+
+static inline void i686_SMP_SetCurrentThread(void* thread)
+{
+    __asm__ volatile("mov %0, %%gs:%c1" : : "r"(thread), "i"(__builtin_offsetof(PerCpu, thread)) : "memory");
+}
+
+// Starts every listed processor other than the boot CPU with INIT-SIPI-SIPI.
+// Each one sets up its own GDT/TSS, IDT, PAT and local APIC, then calls
+// entry() with interrupts off; entry must not return. Needs the local APIC,
+// the heap and a calibrated time_now_ns(). Returns how many CPUs are now
+// online, the boot CPU included.
+uint32_t i686_SMP_StartCpus(const uint8_t* apic_ids, int count, SmpEntry entry);
+uint32_t i686_SMP_CpuCount();
+
+// Interrupts CPU `index` on `vector`
+void i686_SMP_SendIPI(uint32_t index, uint8_t vector);
@@ -0,0 +1,104 @@
+#include "arena.h"
+#include "memory.h"
+
+// Chunks are carved from the global heap once and then reused across resets,
+// so a steady-state arena never touches the heap's free list.
+
+static size_t arena_align(size_t value) {
+    return (value + (ARENA_ALIGNMENT - 1)) & ~(size_t)(ARENA_ALIGNMENT - 1);
+}
+
+#define ARENA_HEADER_SIZE arena_align(sizeof(arena_chunk_t))
+
+static arena_chunk_t* arena_new_chunk(size_t size) {
+    arena_chunk_t* chunk = (arena_chunk_t*)malloc(ARENA_HEADER_SIZE + size);
+    if (!chunk) {
+        return NULL;
+    }
+    chunk->next = NULL;
+    chunk->size = size;
+    chunk->used = 0;
+    return chunk;
+}
+
+static void* arena_chunk_data(arena_chunk_t* chunk) {
+    return (uint8_t*)chunk + ARENA_HEADER_SIZE;
+}
+
+arena_t* arena_create(size_t chunk_size) {
+    arena_t* arena = (arena_t*)malloc(sizeof(arena_t));
+    if (!arena) {
+        return NULL;
+    }
+
+    arena->chunk_size = arena_align(chunk_size ? chunk_size : 4096);
+    arena->first = arena_new_chunk(arena->chunk_size);
+    if (!arena->first) {
+        free(arena);
+        return NULL;
+    }
+    arena->current = arena->first;
+    return arena;
+}
+
+void* arena_alloc(arena_t* arena, size_t size) {
+    if (!arena || size == 0) {
+        return NULL;
+    }
+
+    size = arena_align(size);
+    arena_chunk_t* chunk = arena->current;
+
+    // Fast path: bump inside the current chunk
+    if (chunk->used + size <= chunk->size) {
+        void* ptr = (uint8_t*)arena_chunk_data(chunk) + chunk->used;
+        chunk->used += size;
+        return ptr;
+    }
+
+    // Reuse the next chunk retained from before the last reset if it fits,
+    // otherwise splice a fresh chunk in right after the current one.
+    arena_chunk_t* next = chunk->next;
+    if (!next || size > next->size) {
+        size_t new_size = size > arena->chunk_size ? size : arena->chunk_size;
+        next = arena_new_chunk(new_size);
+        if (!next) {
+            return NULL;
+        }
+        next->next = chunk->next;
+        chunk->next = next;
+    }
+
+    next->used = size;
+    arena->current = next;
+    return arena_chunk_data(next);
+}
+
+void arena_reset(arena_t* arena) {
+    if (!arena) {
+        return;
+    }
+
+    // Only chunks up to `current` can have been used since the last reset
+    arena_chunk_t* chunk = arena->first;
+    while (chunk) {
+        chunk->used = 0;
+        if (chunk == arena->current) break;
+        chunk = chunk->next;
+    }
+    arena->current = arena->first;
+}
+
+void arena_destroy(arena_t* arena) {
+    if (!arena) {
+        return;
+    }
+
+    arena_chunk_t* chunk = arena->first;
+    while (chunk) {
+        arena_chunk_t* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    free(arena);
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// A bump-pointer region allocator for short-lived scratch memory.
+// Allocations are O(1) and never freed individually; the whole arena is
+// released at once with arena_reset() (keeps the memory) or arena_destroy().
+
+#define ARENA_ALIGNMENT 8
+
+typedef struct arena_chunk {
+    struct arena_chunk* next;
+    size_t size;                // usable bytes after the chunk header
+    size_t used;                // bytes handed out from this chunk
+} arena_chunk_t;
+
+typedef struct {
+    arena_chunk_t* first;       // first chunk in the chain
+    arena_chunk_t* current;     // chunk we are currently bumping from
+    size_t chunk_size;          // default size of newly added chunks
+} arena_t;
+
+arena_t* arena_create(size_t chunk_size);
+void* arena_alloc(arena_t* arena, size_t size);
+void arena_reset(arena_t* arena);
+void arena_destroy(arena_t* arena);
@@ -8,6 +8,8 @@
 #include <arch/i686/paging.h>
 
 #define HDA_GCTL_OFFSET      0x08
+#define HDA_INTCTL           0x20
+#define HDA_INTSTS           0x24
 #define HDA_CORB_BASE_L      0x40
 #define HDA_CORB_BASE_U      0x44
 #define HDA_CORB_WRITE_PTR   0x48
@@ -33,6 +35,13 @@
 #define HDA_STREAM_BDPL      0x18
 #define HDA_STREAM_BDPU      0x1C
 
+#define HDA_INTCTL_GIE       (1u << 31)
+#define HDA_INTCTL_STREAM0   (1u << 0)
+#define HDA_STREAM_IOCE      (1u << 2)
+// Stream status sits in the top byte of the control dword
+#define HDA_STREAM_BCIS      (1u << 26)
+#define HDA_STREAM_STS_ALL   (0x1Cu << 24)
+
 typedef struct {
     uint32_t addr;
     uint32_t size;
@@ -44,6 +53,7 @@ static volatile uint32_t* g_hda_mmio = 0;
 static uint8_t* g_hda_stream_buffer = 0;
 static hda_buffer_desc_t* g_hda_bdl = 0;
 static uint32_t g_hda_stream_size = 0;
+static int g_hda_vector = -1;
 
 static uint32_t hda_reg_read(uint32_t offset) {
     if (!g_hda_mmio) {
@@ -59,6 +69,18 @@ static void hda_reg_write(uint32_t offset, uint32_t value) {
     g_hda_mmio[offset / 4] = value;
 }
 
+// Runs on the vector pci_setup_interrupt gave us; nothing else shares it
+static void hda_interrupt(Registers* regs) {
+    uint32_t intsts = hda_reg_read(HDA_INTSTS);
+    if (intsts & HDA_INTCTL_STREAM0) {
+        uint32_t ctl = hda_reg_read(HDA_STREAM_BASE + HDA_STREAM_CTL);
+        hda_reg_write(HDA_STREAM_BASE + HDA_STREAM_CTL, (ctl & 0x00FFFFFF) | HDA_STREAM_STS_ALL);
+        if (ctl & HDA_STREAM_BCIS) {
+            g_hda_playing = false;
+        }
+    }
+}
+
 static bool hda_wait_for_bit(uint32_t offset, uint32_t mask, bool expected, int timeout) {
     while (timeout-- > 0) {
         uint32_t value = hda_reg_read(offset);
@@ -165,6 +187,15 @@ void hda_init(pci_device_t* dev) {
     hda_setup_ring_buffers();
     hda_reset_stream();
 
+    // With its own MSI vector the end of a buffer is reported instead of polled
+    g_hda_vector = pci_setup_interrupt(dev, hda_interrupt);
+    if (g_hda_vector >= 0) {
+        hda_reg_write(HDA_INTCTL, HDA_INTCTL_GIE | HDA_INTCTL_STREAM0);
+        printf("HDA: interrupts on vector 0x%x\n", g_hda_vector);
+    } else {
+        printf("HDA: no MSI, playback is polled\n");
+    }
+
     g_hda_initialized = true;
 }
 
@@ -245,7 +276,7 @@ bool hda_play_pcm(const uint8_t* data,
     hda_reg_write(stream_offset + HDA_STREAM_FMT, format);
     hda_reg_write(stream_offset + HDA_STREAM_BDPL, (uint32_t)g_hda_bdl);
     hda_reg_write(stream_offset + HDA_STREAM_BDPU, 0);
-    hda_reg_write(stream_offset + HDA_STREAM_CTL, 0x00000001);
+    hda_reg_write(stream_offset + HDA_STREAM_CTL, 0x00000001 | (g_hda_vector >= 0 ? HDA_STREAM_IOCE : 0));
 
     g_hda_playing = true;
     printf(
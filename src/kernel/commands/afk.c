@@ -7,14 +7,25 @@
 
 #include "arch/i686/keyboard.h"
 #include "mm8Splash.h"
+#include "graphics.h"
+#include "glyph.h"
 
 void afk()
 {   
-    mm8Splash();
+    // Shown on an app surface, so the console comes back untouched
+    if (!graphics_app_begin()) {
+        printf("Error: Not enough memory for the app surface.\n");
+        getch();
+        return;
+    }
+
+    int y = mm8Splash_draw(10, 40, 0x00FFFFFF);
+    glyph_draw_string(10, y + 40, "Hello I am AFK for the moment", 0x00FFFFFF, 8, 8);
+    glyph_draw_string(10, y + 60, "Press any key to continue...", 0x00CCCCCC, 8, 8);
+    graphics_swap_buffer();
 
-    printf("\n\n\nHello I am AFK for the moment\n\n\n\n\n");
-    printf("Press any key to continue...\n");
     getch(); // Wait for any keypress
+    graphics_app_end();
     printf("Welcome back!\n");
     return;
 }
\ No newline at end of file
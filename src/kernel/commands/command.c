@@ -19,19 +19,29 @@
 #include "stdlib.h"
 #include "ctype.h"
 #include "heap.h"
+#include "arena.h"
 
 #include <apps/gameEngine/3d/gameEngine.h>
 #include <apps/gameEngine/2d/mainGame.h>
 
 #include "threeD/rand1.h"
 #include <arch/i686/gdt.h> // For i686_EnterUserMode
+#include <arch/i686/paging.h>
+#include "vbe.h"
 
 #include "time.h"
+#include <sched/thread.h>
+#include <arch/i686/smp.h>
+#include <sync/lockstat.h>
 
 #include <apps/imageview/bmp.h>
 #include "randomBits/wav/wav.h"
 #include "audio/hda/hda.h"
 
+// Scratch arena handed to every command; reset when the command returns
+#define COMMAND_SCRATCH_SIZE (64 * 1024)
+static arena_t* g_CommandArena = NULL;
+
 // Prototypes for HAL functions
 void HAL_Speaker_Play(uint32_t frequency);
 void HAL_Speaker_Stop();
@@ -58,8 +68,16 @@ static void handle_help() {
     printf(" - bot [query]: Talk to the MM8 Assistant bot.\n");
     printf(" - cube: Runs a 3D rotating cube test.\n");
     printf(" - memory: Show heap memory usage statistics.\n");
+    printf(" - heapstat [N]: Heap profile with size histogram and top N call sites.\n");
+    printf(" - membench: Measure memcpy/memset bandwidth for each CPU variant.\n");
+    printf(" - fbbench: Compare framebuffer fill/copy speed uncached vs write-combining.\n");
+    printf(" - fps: Toggle a frames-per-second overlay on top of the shell and apps.\n");
+    printf(" - threads: List kernel threads with their state and CPU time.\n");
+    printf(" - cpus: Show each processor's load, switches and run queue.\n");
+    printf(" - locks [reset]: Show lock contention, most contended first, or zero the counters.\n");
     printf(" - bmp [file]: View a BMP image file. Example: bmp /image.bmp (Work in Progress)\n");
     printf(" - uptime: Show the system uptime.\n");
+    printf(" - time [command]: Run a command and show how long it took.\n");
     printf(" - beep [freq]: Play a sound at the specified frequency.\n");
     printf(" - play [freq:ms,...]: Play a sequence of notes. Example: play 440:200,880:100\n");
     printf(" - jingle: Play a short melody.\n");
@@ -120,9 +138,16 @@ static void handle_read(const char* input) {
         return;
     }
 
-    char buffer[513]; // Read 512 bytes at a time
+    // Read in large chunks from the per-command scratch arena to cut FAT calls
+    const uint32_t chunk = 4096;
+    char* buffer = (char*)command_scratch_alloc(chunk + 1);
+    if (!buffer) {
+        printf("read: Out of memory\n");
+        FAT_Close(&g_Disk, file);
+        return;
+    }
     uint32_t bytes_read;
-    while ((bytes_read = FAT_Read(&g_Disk, file, 512, buffer)) > 0) {
+    while ((bytes_read = FAT_Read(&g_Disk, file, chunk, buffer)) > 0) {
         buffer[bytes_read] = '\0';
         printf("%s", buffer);
     }
@@ -162,6 +187,266 @@ static void handle_memory() {
     printf("  Overhead:   %u bytes\n", total - used - free_mem);
 }
 
+static void heapstat_sort(heap_callsite_t* sites, int count, bool by_rate) {
+    // Insertion sort, descending; the table is small
+    for (int i = 1; i < count; i++) {
+        heap_callsite_t key = sites[i];
+        uint32_t key_val = by_rate ? key.total_allocs : key.live_bytes;
+        int j = i - 1;
+        while (j >= 0 && (by_rate ? sites[j].total_allocs : sites[j].live_bytes) < key_val) {
+            sites[j + 1] = sites[j];
+            j--;
+        }
+        sites[j + 1] = key;
+    }
+}
+
+static void handle_heapstat(const char* input) {
+    int top = 8;
+    if (input[8] == ' ') {
+        top = atoi(input + 9);
+        if (top <= 0) top = 8;
+    }
+
+    heap_stats_t stats;
+    heap_get_detailed_stats(&stats);
+
+    printf("Heap Profile:\n");
+    printf("  Used:        %u bytes in %u blocks (peak %u)\n", stats.used, stats.used_blocks, stats.peak_used);
+    printf("  Free:        %u bytes in %u blocks\n", stats.free, stats.free_blocks);
+    printf("  Cached:      %u bytes in per-CPU magazines\n", stats.cached);
+    printf("  Large:       %u bytes in %u mappings (%u/%u frames)\n", stats.large_used, stats.large_blocks, stats.frames_used, stats.frames_total);
+    printf("  Largest free block: %u bytes\n", stats.largest_free);
+    printf("  Fragmentation: %u.%u%%\n", stats.fragmentation_permille / 10, stats.fragmentation_permille % 10);
+    printf("  Calls: %u malloc, %u free, %u failed\n", stats.alloc_count, stats.free_count, stats.fail_count);
+
+    printf("\nAllocation sizes:\n");
+    uint32_t limit = 16;
+    for (int i = 0; i < HEAP_HISTOGRAM_BUCKETS; i++) {
+        if (stats.histogram[i]) {
+            if (i == HEAP_HISTOGRAM_BUCKETS - 1) printf("  >%7u: %u\n", limit / 2, stats.histogram[i]);
+            else printf("  <=%6u: %u\n", limit, stats.histogram[i]);
+        }
+        limit <<= 1;
+    }
+
+    heap_callsite_t* sites = (heap_callsite_t*)command_scratch_alloc(HEAP_CALLSITE_SLOTS * sizeof(heap_callsite_t));
+    if (!sites) return;
+    int count = heap_get_callsites(sites, HEAP_CALLSITE_SLOTS);
+    if (count == 0) {
+        printf("\nCall-site tracking is disabled (HEAP_TRACK_CALLERS).\n");
+        return;
+    }
+    if (top > count) top = count;
+
+    uint32_t uptime_s = get_uptime_seconds();
+    if (uptime_s == 0) uptime_s = 1;
+
+    printf("\nTop %d call sites by live bytes:\n", top);
+    printf("  caller           live  blocks    allocs\n");
+    heapstat_sort(sites, count, false);
+    for (int i = 0; i < top; i++) {
+        printf("  0x%08x %10u %7u %9u\n", (uint32_t)sites[i].caller, sites[i].live_bytes,
+               sites[i].live_blocks, sites[i].total_allocs);
+    }
+
+    printf("\nTop %d call sites by allocation rate:\n", top);
+    heapstat_sort(sites, count, true);
+    for (int i = 0; i < top; i++) {
+        printf("  0x%08x %9u allocs  %6u/s  %10u bytes total\n", (uint32_t)sites[i].caller,
+               sites[i].total_allocs, sites[i].total_allocs / uptime_s, (uint32_t)sites[i].total_bytes);
+    }
+    printf("\nResolve callers against build/kernel.map.\n");
+}
+
+#define MEMBENCH_LARGE (8 * 1024 * 1024)
+#define MEMBENCH_SMALL 4096
+#define MEMBENCH_MS    200
+
+// Repeats one copy or fill for about MEMBENCH_MS and returns MB/s
+static uint32_t membench_run(const memory_impl_t* impl, bool copy, uint8_t* dst, const uint8_t* src, size_t size) {
+    uint64_t bytes = 0;
+    uint32_t start = get_uptime_ms();
+    uint32_t elapsed;
+    do {
+        if (copy) impl->copy(dst, src, size);
+        else impl->set(dst, 0x5A, size);
+        bytes += size;
+        elapsed = get_uptime_ms() - start;
+    } while (elapsed < MEMBENCH_MS);
+    return (uint32_t)((bytes * 1000 / elapsed) / (1024 * 1024));
+}
+
+static void membench_print(uint32_t mbps) {
+    printf("  %3u.%02u", mbps / 1024, (mbps % 1024) * 100 / 1024);
+}
+
+static void handle_membench() {
+    uint8_t* src = (uint8_t*)malloc(MEMBENCH_LARGE);
+    uint8_t* dst = (uint8_t*)malloc(MEMBENCH_LARGE);
+    if (!src || !dst) {
+        printf("membench: Out of memory\n");
+        free(src);
+        free(dst);
+        return;
+    }
+    memset(src, 0xA5, MEMBENCH_LARGE);
+    memset(dst, 0, MEMBENCH_LARGE);
+
+    const memory_impl_t* impls;
+    int count = memory_get_impls(&impls);
+
+    printf("Memory bandwidth in GB/s (active: %s)\n", memory_active_impl());
+    printf("  variant  copy 8M  copy 4K   set 8M   set 4K\n");
+    for (int i = 0; i < count; i++) {
+        printf("  %s", impls[i].name);
+        for (int pad = strlen(impls[i].name); pad < 7; pad++) putc(' ');
+        membench_print(membench_run(&impls[i], true, dst, src, MEMBENCH_LARGE));
+        membench_print(membench_run(&impls[i], true, dst, src, MEMBENCH_SMALL));
+        membench_print(membench_run(&impls[i], false, dst, src, MEMBENCH_LARGE));
+        membench_print(membench_run(&impls[i], false, dst, src, MEMBENCH_SMALL));
+        printf("\n");
+    }
+
+    free(src);
+    free(dst);
+}
+
+static void handle_fbbench() {
+    if (!g_vbe_screen || !g_vbe_screen->physical_buffer) {
+        printf("fbbench: No framebuffer.\n");
+        return;
+    }
+
+    uint32_t size = g_vbe_screen->height * g_vbe_screen->pitch;
+    uint8_t* src = (uint8_t*)malloc(size);
+    if (!src) {
+        printf("fbbench: Out of memory\n");
+        return;
+    }
+    memset(src, 0x40, size);
+
+    // Benchmark with whichever memcpy/memset variant is active
+    const memory_impl_t* impls;
+    const memory_impl_t* impl = NULL;
+    int count = memory_get_impls(&impls);
+    for (int i = 0; i < count; i++) {
+        if (strcmp(impls[i].name, memory_active_impl()) == 0) impl = &impls[i];
+    }
+
+    uint32_t results_fill[2], results_copy[2];
+    paging_cache_t modes[2] = { PAGING_CACHE_UNCACHED, PAGING_CACHE_WRITE_COMBINING };
+    uint8_t* vram = (uint8_t*)g_vbe_screen->physical_buffer;
+    for (int m = 0; m < 2; m++) {
+        i686_Paging_Set_Cache((uint32_t)vram, size, modes[m]);
+        results_fill[m] = membench_run(impl, false, vram, src, size);
+        results_copy[m] = membench_run(impl, true, vram, src, size);
+    }
+    i686_Paging_Set_Cache((uint32_t)vram, size, PAGING_CACHE_WRITE_COMBINING);
+    free(src);
+
+    // The benchmark scribbled over the screen, put the console back
+    console_refresh();
+
+    // Lower depths move fewer bytes per frame; swap converts to them
+    printf("Mode: %ux%u, %u bpp (%s), %u KB per frame\n",
+           (unsigned int)g_vbe_screen->width, (unsigned int)g_vbe_screen->height,
+           (unsigned int)g_vbe_screen->bpp, graphics_get_format_name(), size / 1024);
+    printf("Framebuffer bandwidth in GB/s (%s, write-combining via %s)\n",
+           impl->name, i686_Paging_WC_Method());
+    printf("  mapping     fill    copy\n");
+    printf("  uncached");
+    membench_print(results_fill[0]);
+    membench_print(results_copy[0]);
+    printf("\n  wc      ");
+    membench_print(results_fill[1]);
+    membench_print(results_copy[1]);
+    printf("\n");
+}
+
+static void handle_fps() {
+    bool enable = !graphics_is_fps_overlay();
+    graphics_set_fps_overlay(enable);
+    if (enable && !graphics_is_fps_overlay()) {
+        printf("fps: Overlay not available.\n");
+        return;
+    }
+    printf("FPS overlay %s\n", enable ? "on" : "off");
+}
+
+static void handle_threads() {
+    // printf has no left-justified %s, so the columns are padded here
+    static const char* const states[] = { "ready  ", "running", "blocked", "dead   " };
+    static const char* const priorities[] = { "idle  ", "low   ", "normal", "high  " };
+
+    thread_info_t* threads = (thread_info_t*)command_scratch_alloc(THREAD_MAX_INFO * sizeof(thread_info_t));
+    if (!threads) return;
+    int count = thread_get_info(threads, THREAD_MAX_INFO);
+    if (count == 0) {
+        printf("threads: Scheduler not running.\n");
+        return;
+    }
+
+    printf("   ID  PRIORITY  STATE    CPU  SWITCHES    CPU ms  NAME\n");
+    for (int i = count - 1; i >= 0; i--) {
+        thread_info_t* t = &threads[i];
+        printf("  %3u  %s    %s  %3u  %8u  %8llu  %s\n", t->id, priorities[t->priority], states[t->state],
+               t->cpu, t->switches, t->runtime_ns / 1000000, t->name);
+    }
+}
+
+#define CPUS_SAMPLE_MS 250
+
+static void handle_cpus() {
+    thread_cpu_info_t before[SMP_MAX_CPUS];
+    thread_cpu_info_t after[SMP_MAX_CPUS];
+
+    // Load is measured over a short window rather than since boot
+    uint64_t start = time_now_ns();
+    int count = thread_get_cpu_info(before, SMP_MAX_CPUS);
+    if (count == 0) {
+        printf("cpus: Scheduler not running.\n");
+        return;
+    }
+    sleep_ms(CPUS_SAMPLE_MS);
+    uint64_t window = time_now_ns() - start;
+    count = thread_get_cpu_info(after, count);
+
+    printf("  CPU  APIC  LOAD  SWITCHES  STEALS  QUEUED  RUNNING\n");
+    for (int i = 0; i < count; i++) {
+        thread_cpu_info_t* c = &after[i];
+        uint64_t idle = c->idle_ns - before[i].idle_ns;
+        uint32_t load = idle >= window ? 0 : (uint32_t)((window - idle) * 100 / window);
+        printf("  %3u  %4u  %3u%%  %8u  %6u  %6u  %s\n", c->index, c->apic_id, load,
+               c->switches, c->steals, c->queued, c->current);
+    }
+}
+
+static void handle_locks(const char* input) {
+    if (strcmp(input, "locks reset") == 0) {
+        lock_stats_reset();
+        printf("Lock statistics reset.\n");
+        return;
+    }
+
+    lock_stats_info_t* locks = (lock_stats_info_t*)command_scratch_alloc(LOCK_STATS_MAX_INFO * sizeof(lock_stats_info_t));
+    if (!locks) return;
+    int count = lock_stats_snapshot(locks, LOCK_STATS_MAX_INFO);
+    if (count == 0) {
+        printf("locks: No statistics; the kernel was built without LOCK_STATS.\n");
+        return;
+    }
+
+    // printf has no left-justified %s, so the kind column is padded here
+    static const char* const kinds[] = { "spin  ", "ticket", "rw    ", "mutex " };
+    printf("  KIND       ACQUIRED   CONTENDED       WAITS  MAX HOLD (cycles)  NAME\n");
+    for (int i = 0; i < count; i++) {
+        lock_stats_info_t* l = &locks[i];
+        printf("  %s  %10llu  %10llu  %10llu  %17llu  %s\n", kinds[l->kind], l->acquisitions,
+               l->contended, l->waits, l->max_hold_cycles, l->name);
+    }
+}
+
 void handleUptime() {
     uint32_t ms = get_uptime_ms();
     uint32_t seconds = ms / 1000;
@@ -286,10 +571,49 @@ extern void user_mode_test_program();
 }
 */
 
+void* command_scratch_alloc(size_t size) {
+    return arena_alloc(g_CommandArena, size);
+}
+
+static void command_execute(const char* input);
+
+static void handle_time(const char* input) {
+    const char* cmd = input + 4;
+    while (*cmd == ' ') cmd++;
+    if (*cmd == '\0') {
+        printf("Usage: time [command]\n");
+        return;
+    }
+
+    uint64_t start_ns = time_now_ns();
+    uint64_t start_cycles = time_now_cycles();
+    command_execute(cmd);
+    uint64_t cycles = time_now_cycles() - start_cycles;
+    uint64_t us = (time_now_ns() - start_ns) / 1000;
+
+    printf("\nreal %llu.%03u ms", us / 1000, (unsigned int)(us % 1000));
+    if (time_tsc_khz()) printf(" (%llu cycles)", cycles);
+    printf("\n");
+}
+
 void command_dispatch(const char* input) {
     if (input[0] == '\0')
         return;
 
+    if (!g_CommandArena) {
+        g_CommandArena = arena_create(COMMAND_SCRATCH_SIZE);
+    }
+
+    command_execute(input);
+    // Output printed within a frame of the last present is still pending
+    console_flush();
+
+    // Everything the command took from the scratch arena goes away in one step
+    arena_reset(g_CommandArena);
+}
+
+static void command_execute(const char* input) {
+
     if (strcmp(input, "help") == 0) {
         handle_help();
     } else if (strcmp(input, "ls") == 0) {
@@ -359,6 +683,22 @@ void command_dispatch(const char* input) {
         }
     } else if (strcmp(input, "memory") == 0) {
         handle_memory();
+    } else if (memcmp(input, "heapstat", 8) == 0 && (input[8] == ' ' || input[8] == '\0')) {
+        handle_heapstat(input);
+    } else if (strcmp(input, "membench") == 0) {
+        handle_membench();
+    } else if (strcmp(input, "fbbench") == 0) {
+        handle_fbbench();
+    } else if (memcmp(input, "time", 4) == 0 && (input[4] == ' ' || input[4] == '\0')) {
+        handle_time(input);
+    } else if (strcmp(input, "fps") == 0) {
+        handle_fps();
+    } else if (strcmp(input, "threads") == 0) {
+        handle_threads();
+    } else if (strcmp(input, "cpus") == 0) {
+        handle_cpus();
+    } else if (memcmp(input, "locks", 5) == 0 && (input[5] == ' ' || input[5] == '\0')) {
+        handle_locks(input);
     } else {
         // Fallback: Try to execute as an ELF file from disk
         char path[256];
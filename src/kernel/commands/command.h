@@ -1,3 +1,8 @@
 #pragma once
 
-void command_dispatch(const char* input);
\ No newline at end of file
+#include <stddef.h>
+
+void command_dispatch(const char* input);
+
+// Short-lived allocation that lives until the current command returns.
+void* command_scratch_alloc(size_t size);
\ No newline at end of file
@@ -6,8 +6,10 @@
 #include <arch/i686/io.h>
 #include <arch/i686/keyboard.h>
 #include "../heap.h"
-#include "../font.h"
+#include "../glyph.h"
 #include "../string.h"
+#include "../arena.h"
+#include "../time.h"
 
 // --- 3D Math Helpers ---
 
@@ -101,6 +103,9 @@ static void draw_triangle(int x0, int y0, int z0, int x1, int y1, int z1, int x2
     int total_height = y2 - y0;
     if (total_height == 0) return;
 
+    if (!graphics_get_draw_buffer()) return;
+    int min_x = screen_w, max_x = -1;
+
     for (int i = 0; i < total_height; i++) {
         int y = y0 + i;
         if (y < 0 || y >= screen_h) continue;
@@ -123,19 +128,32 @@ static void draw_triangle(int x0, int y0, int z0, int x1, int y1, int z1, int x2
         int z_step = (B_x - A_x) > 0 ? (B_z - A_z) * 1024 / (B_x - A_x) : 0;
         int current_z_scaled = A_z * 1024;
 
-        int row_offset = y * screen_w;
-        for (int j = A_x; j <= B_x; j++) {
-            if (j >= 0 && j < screen_w) {
-                int current_z = current_z_scaled / 1024;
-                int idx = row_offset + j;
-                if ((uint32_t)current_z < z_buffer[idx]) {
-                    z_buffer[idx] = (uint32_t)current_z;
-                    draw_pixel(j, y, color);
-                }
+        // Clip the span once instead of testing every pixel
+        int left = A_x, right = B_x;
+        if (left < 0) {
+            current_z_scaled += -left * z_step;
+            left = 0;
+        }
+        if (right >= screen_w) right = screen_w - 1;
+        if (left > right) continue;
+        if (left < min_x) min_x = left;
+        if (right > max_x) max_x = right;
+
+        uint32_t* z_row = &z_buffer[y * screen_w];
+        uint32_t* pixel_row = graphics_get_row(y);
+        for (int j = left; j <= right; j++) {
+            int current_z = current_z_scaled / 1024;
+            if ((uint32_t)current_z < z_row[j]) {
+                z_row[j] = (uint32_t)current_z;
+                pixel_row[j] = color;
             }
             current_z_scaled += z_step;
         }
     }
+
+    if (max_x >= min_x) {
+        graphics_mark_dirty(min_x, y0, max_x - min_x + 1, total_height);
+    }
 }
 
 static void wait_for_vsync() {
@@ -148,39 +166,6 @@ static void wait_for_vsync() {
     while (!(i686_inb(0x3DA) & 8) && --timeout);
 }
 
-// --- Text Drawing Helpers ---
-
-// Make g_ticks from main.c available
-extern volatile uint32_t g_ticks;
-
-// Helper to draw a character with a transparent background
-static void draw_char_transparent(int x, int y, char c, uint32_t color) {
-    if (!g_vbe_screen) return;
-
-    // Get font data (offset by 32 because our font starts at space)
-    if (c < 32 || c > 127) c = '?'; // Use a placeholder for non-printable chars
-    const uint8_t* glyph = font8x8_basic[c - 32];
-
-    // Draw 8x8 pixels
-    for (int row = 0; row < 8; row++) {
-        for (int col = 0; col < 8; col++) {
-            // Check if the bit is set in the font bitmap
-            if ((glyph[row] >> (7 - col)) & 1) {
-                draw_pixel(x + col, y + row, color);
-            }
-        }
-    }
-}
-
-// Helper to draw a string
-static void draw_string(int x, int y, const char* str, uint32_t color) {
-    while (*str) {
-        draw_char_transparent(x, y, *str, color);
-        x += 8; // Move to next character position
-        str++;
-    }
-}
-
 // --- Integer to String Conversion ---
 
 static void reverse(char s[]) {
@@ -302,17 +287,8 @@ void cube_test() {
         return;
     }
 
-    printf("Starting Cube Test... Press any key to exit.\n");
+    printf("Starting Cube Test... Press ESC to exit.\n");
 
-    // Enable double buffering
-    graphics_set_double_buffering(true);
-
-    if (!g_DoubleBufferEnabled) {
-        printf("Error: Double buffering not available.\n");
-        getch();
-        return;
-    }
-    
     int screen_w = g_vbe_screen->width;
     int screen_h = g_vbe_screen->height;
 
@@ -320,11 +296,10 @@ void cube_test() {
     int angleX = 0, angleY = 0, angleZ = 0;
     int camX = 0, camY = 0, camZ = -300;
 
-    // Dynamic Buffer: Allocate memory for projected points
-    Point2D* projected = (Point2D*)malloc(8 * sizeof(Point2D));
-    if (!projected) {
-        printf("Error: Failed to allocate memory for projection.\n");
-        graphics_set_double_buffering(false);
+    // Per-frame scratch memory, reset at the top of every frame
+    arena_t* frame_arena = arena_create(4096);
+    if (!frame_arena) {
+        printf("Error: Failed to allocate frame arena.\n");
         getch();
         return;
     }
@@ -333,24 +308,39 @@ void cube_test() {
     uint32_t* z_buffer = (uint32_t*)malloc(screen_w * screen_h * sizeof(uint32_t));
     if (!z_buffer) {
         printf("Error: Failed to allocate Z-buffer.\n");
-        free(projected);
-        graphics_set_double_buffering(false);
+        arena_destroy(frame_arena);
         getch();
         return;
     }
 
-    // Mask IRQ 1 (Keyboard) to prevent the OS ISR from stealing the keypress
-    i686_outb(0x21, i686_inb(0x21) | 0x02);
+    // Draw on a surface of our own; the console stays parked behind it
+    if (!graphics_app_begin()) {
+        printf("Error: Not enough memory for the app surface.\n");
+        arena_destroy(frame_arena);
+        free(z_buffer);
+        getch();
+        return;
+    }
+
+    // Present by flipping VRAM pages when the adapter supports it
+    graphics_set_page_flipping(true);
+
+    keyboard_flush_events(); // The Enter that started the demo
 
     // FPS counter variables
     int frame_count = 0;
-    uint32_t start_ticks = g_ticks;
+    uint64_t start_ns = time_now_ns();
     int fps = 0;
     char fps_str[16];
 
-    // Loop until key press
+    // Loop until ESC
     while (1) { // Main loop
-        
+        arena_reset(frame_arena);
+
+        // Dynamic Buffer: projected points only live for this frame
+        Point2D* projected = (Point2D*)arena_alloc(frame_arena, 8 * sizeof(Point2D));
+        if (!projected) break;
+
         // 1. Clear Buffer (Black)
         graphics_clear_buffer(0x00000000);
         memset(z_buffer, 0xFF, screen_w * screen_h * sizeof(uint32_t)); // Clear Z-buffer to max depth
@@ -383,18 +373,17 @@ void cube_test() {
 
         // --- FPS Calculation & Display ---
         frame_count++;
-        uint32_t current_ticks = g_ticks;
-        // Assuming 100Hz timer, 100 ticks = 1 second
-        if (current_ticks - start_ticks >= 100) {
-            fps = frame_count;
+        uint64_t current_ns = time_now_ns();
+        if (current_ns - start_ns >= 1000000000) {
+            fps = (int)((uint64_t)frame_count * 1000000000 / (current_ns - start_ns));
             frame_count = 0;
-            start_ticks = current_ticks;
+            start_ns = current_ns;
         }
         strcpy(fps_str, "FPS: ");
         itoa(fps, fps_str + 5);
-        draw_string(10, 10, fps_str, 0x00FFFFFF); // White text
+        glyph_draw_string(10, 10, fps_str, 0x00FFFFFF, 8, 8); // White text
 
-        draw_string(10, screen_h - 20, "Move: WASD, Space, L-Ctrl | Exit: ESC", 0x00CCCCCC);
+        glyph_draw_string(10, screen_h - 20, "Move: WASD, Space, L-Ctrl | Exit: ESC", 0x00CCCCCC, 8, 8);
 
         // Wait for Vertical Sync to prevent tearing ("scanning" effect)
         wait_for_vsync();
@@ -407,45 +396,27 @@ void cube_test() {
         angleY = (angleY + 2) % 64;
         angleZ = (angleZ + 1) % 64;
 
-        // Handle keyboard input for camera movement
-        if (i686_inb(0x64) & 0x01) {
-            uint8_t scancode = i686_inb(0x60);
-            if ((scancode & 0x80) == 0) { // Key Press (Make code)
-                int move_speed = 10;
-                switch (scancode) {
-                    case 0x01: // ESC
-                        goto end_loop;
-                    case 0x11: // W (forward)
-                        camZ += move_speed;
-                        break;
-                    case 0x1F: // S (backward)
-                        camZ -= move_speed;
-                        break;
-                    case 0x1E: // A (left)
-                        camX -= move_speed;
-                        break;
-                    case 0x20: // D (right)
-                        camX += move_speed;
-                        break;
-                    case 0x39: // Space (up)
-                        camY += move_speed;
-                        break;
-                    case 0x1D: // Left Ctrl (down)
-                        camY -= move_speed;
-                        break;
-                }
-            }
+        key_event_t event;
+        while (keyboard_read_event(&event)) {
+            if (event.pressed && event.key == KEYCODE_ESCAPE) goto end_loop;
         }
+
+        // Camera movement follows the held keys
+        int move_speed = 10;
+        if (keyboard_key_down(KEYCODE_W)) camZ += move_speed;     // forward
+        if (keyboard_key_down(KEYCODE_S)) camZ -= move_speed;     // backward
+        if (keyboard_key_down(KEYCODE_A)) camX -= move_speed;     // left
+        if (keyboard_key_down(KEYCODE_D)) camX += move_speed;     // right
+        if (keyboard_key_down(KEYCODE_SPACE)) camY += move_speed; // up
+        if (keyboard_key_down(KEYCODE_LCTRL)) camY -= move_speed; // down
     }
 end_loop:;
-    // Restore IRQ 1 (Unmask Keyboard)
-    i686_outb(0x21, i686_inb(0x21) & ~0x02);
+    keyboard_flush_events(); // Keys meant for the demo don't reach the shell
 
     // Free dynamic memory
-    free(projected);
+    arena_destroy(frame_arena);
     free(z_buffer);
 
-    // Cleanup: Disable double buffering (returns to direct drawing)
-    graphics_set_double_buffering(false);
-    clrscr(); // Clear screen back to text mode look
+    // Cleanup: Bring the console back as it was
+    graphics_app_end();
 }
\ No newline at end of file
@@ -3,28 +3,45 @@
 #include "mm8Splash.h"
 #include <apps/imageview/bmp.h>
 #include "time.h"
+#include "glyph.h"
 
 
+static const char* const g_SplashBanner[] = {
+    "    '##::::'##:'##::::'##::'#######::::::::::::'#######:::'######::",
+    "    ###::'###: ###::'###:'##.... ##::::::::::'##.... ##:'##... ##:",
+    "    ####'####: ####'####: ##:::: ##:::::::::: ##:::: ##: ##:::..::",
+    "    ## ### ##: ## ### ##:: #######::'#######: ##:::: ##:. ######::",
+    "    ##. #: ##: ##. #: ##:'##.... ##:........: ##:::: ##::..... ##:",
+    "    ##:.:: ##: ##:.:: ##: ##:::: ##:::::::::: ##:::: ##:'##::: ##:",
+    "    ##:::: ##: ##:::: ##:. #######:::::::::::. #######::. ######::",
+    "    ..:::::..::..:::::..:::.......:::::::::::::.......::::......:::",
+};
+
+#define SPLASH_BANNER_LINES (sizeof(g_SplashBanner) / sizeof(g_SplashBanner[0]))
+
 void mm8Splash() {
 
     clrscr();
 
     printf("===============================================\n");
-    printf("\n"
-           "    '##::::'##:'##::::'##::'#######::::::::::::'#######:::'######::\n"
-           "    ###::'###: ###::'###:'##.... ##::::::::::'##.... ##:'##... ##:\n"
-           "    ####'####: ####'####: ##:::: ##:::::::::: ##:::: ##: ##:::..::\n"
-           "    ## ### ##: ## ### ##:: #######::'#######: ##:::: ##:. ######::\n"
-           "    ##. #: ##: ##. #: ##:'##.... ##:........: ##:::: ##::..... ##:\n"
-           "    ##:.:: ##: ##:.:: ##: ##:::: ##:::::::::: ##:::: ##:'##::: ##:\n"
-           "    ##:::: ##: ##:::: ##:. #######:::::::::::. #######::. ######::\n"
-           "    ..:::::..::..:::::..:::.......:::::::::::::.......::::......:::\n");
+    printf("\n");
+    for (unsigned i = 0; i < SPLASH_BANNER_LINES; i++) {
+        printf("%s\n", g_SplashBanner[i]);
+    }
     printf("\n");
     printf("===============================================\n");
 
            return;
 }
 
+int mm8Splash_draw(int x, int y, uint32_t color) {
+    for (unsigned i = 0; i < SPLASH_BANNER_LINES; i++) {
+        glyph_draw_string(x, y, g_SplashBanner[i], color, 8, 8);
+        y += 10;
+    }
+    return y;
+}
+
 void loadingScreen() {
     clrscr();
 
@@ -1,4 +1,8 @@
 #pragma once 
+#include <stdint.h>
 
 void mm8Splash();
+// Draws the banner at (x, y) on the current surface, e.g. an app's, without
+// touching the console. Returns the y just below it.
+int mm8Splash_draw(int x, int y, uint32_t color);
 void loadingScreen();
\ No newline at end of file
@@ -0,0 +1,72 @@
+#include "deferred.h"
+#include <arch/i686/irq.h>
+#include <arch/i686/smp.h>
+#include <sync/spinlock.h>
+
+#define DEFERRED_MASK (DEFERRED_QUEUE_SIZE - 1)
+
+typedef struct {
+    deferred_fn_t fn;
+    void* arg;
+} deferred_item_t;
+
+typedef struct {
+    deferred_item_t items[DEFERRED_QUEUE_SIZE];
+    volatile uint32_t head;     // only the producer writes this
+    volatile uint32_t tail;     // only the consumer writes this
+    uint32_t dropped;
+} deferred_ring_t;
+
+static deferred_ring_t g_DeferredRings[SMP_MAX_CPUS];
+
+static inline uint32_t deferred_cpu_id() {
+    return i686_SMP_CpuIndex();
+}
+
+void deferred_initialize() {
+    i686_IRQ_SetTailHandler(deferred_run);
+}
+
+bool deferred_queue(deferred_fn_t fn, void* arg) {
+    // Only matters when called from normal code: an IRQ queueing on this CPU
+    // in the middle would be a second producer
+    uint32_t flags = irq_save();
+    deferred_ring_t* ring = &g_DeferredRings[deferred_cpu_id()];
+
+    uint32_t head = ring->head;
+    if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == DEFERRED_QUEUE_SIZE) {
+        ring->dropped++;
+        irq_restore(flags);
+        return false;
+    }
+
+    ring->items[head & DEFERRED_MASK].fn = fn;
+    ring->items[head & DEFERRED_MASK].arg = arg;
+    // Publish the item before the consumer can see the new head
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+
+    irq_restore(flags);
+    return true;
+}
+
+void deferred_run() {
+    deferred_ring_t* ring = &g_DeferredRings[deferred_cpu_id()];
+
+    for (;;) {
+        uint32_t tail = ring->tail;
+        if (tail == __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)) break;
+
+        deferred_item_t item = ring->items[tail & DEFERRED_MASK];
+        // Free the slot before running, the item may well queue another
+        __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+        item.fn(item.arg);
+    }
+}
+
+uint32_t deferred_dropped() {
+    uint32_t dropped = 0;
+    for (int cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        dropped += g_DeferredRings[cpu].dropped;
+    }
+    return dropped;
+}
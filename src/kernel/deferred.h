@@ -0,0 +1,35 @@
+#ifndef DEFERRED_H
+#define DEFERRED_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Deferred interrupt work ("bottom halves").
+//
+// An IRQ handler should only acknowledge its device and queue whatever else
+// needs doing. Queued items run after the EOI with interrupts enabled, so a
+// slow console redraw no longer holds up the timer or the disk.
+//
+// Each CPU has its own ring. Handlers don't nest (they run with interrupts
+// off), so a ring has one producer and one consumer, the drain on the same
+// CPU, and needs no lock.
+
+#define DEFERRED_QUEUE_SIZE     256     // power of two
+
+typedef void (*deferred_fn_t)(void* arg);
+
+// Installs the drain as the IRQ tail. Call once interrupts are set up.
+void deferred_initialize();
+
+// Queues fn(arg) on this CPU. Safe from IRQ handlers and, since it briefly
+// masks interrupts, from normal code. Returns false if the ring is full.
+bool deferred_queue(deferred_fn_t fn, void* arg);
+
+// The IRQ tail: runs everything queued on this CPU, including items queued
+// meanwhile. Not for calling directly, it must stay the ring's only consumer.
+void deferred_run();
+
+// Items dropped because a ring was full, summed over CPUs
+uint32_t deferred_dropped();
+
+#endif // DEFERRED_H
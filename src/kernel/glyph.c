@@ -0,0 +1,235 @@
+#include "glyph.h"
+#include "graphics.h"
+#include "vbe.h"
+#include "memory.h"
+#include "font.h"
+#include "stdbool.h"
+
+typedef struct {
+    uint32_t fg;
+    uint32_t bg;
+    uint32_t last_used;
+    char ch;
+    bool valid;
+} glyph_slot_t;
+
+static glyph_slot_t g_GlyphSlots[GLYPH_CACHE_SETS][GLYPH_CACHE_WAYS];
+static uint32_t* g_GlyphPixels = NULL;  // one cell per slot, rasterized at g_GlyphScale
+static int g_GlyphScale = 0;
+static uint32_t g_GlyphClock = 0;
+
+// Runs of lit pixels for every possible font row byte: (start column, length)
+static uint8_t g_SpanCount[256];
+static uint8_t g_Spans[256][4][2];
+static bool g_SpansReady = false;
+
+// Largest cell glyph_draw_run batches (scale 8)
+#define GLYPH_RUN_MAX_CELL 64
+
+static const uint8_t* glyph_bitmap(char c) {
+    unsigned char uc = (unsigned char)c;
+    return (uc >= 32 && uc <= 127) ? font8x8_basic[uc - 32] : font8x8_basic[0];
+}
+
+void glyph_cache_flush() {
+    memset(g_GlyphSlots, 0, sizeof(g_GlyphSlots));
+    g_GlyphClock = 0;
+}
+
+static bool glyph_cache_set_scale(int scale) {
+    if (scale == g_GlyphScale && g_GlyphPixels) return true;
+
+    // Every slot holds a cell of the current scale, so a new scale starts over
+    if (g_GlyphPixels) free(g_GlyphPixels);
+    int cell = 8 * scale;
+    g_GlyphPixels = (uint32_t*)malloc(GLYPH_CACHE_SETS * GLYPH_CACHE_WAYS * cell * cell * sizeof(uint32_t));
+    g_GlyphScale = g_GlyphPixels ? scale : 0;
+    glyph_cache_flush();
+    return g_GlyphPixels != NULL;
+}
+
+static void glyph_rasterize(uint32_t* out, char c, uint32_t fg, uint32_t bg) {
+    const uint8_t* bitmap = glyph_bitmap(c);
+    int scale = g_GlyphScale;
+    int cell = 8 * scale;
+
+    for (int row = 0; row < 8; row++) {
+        // Build the first scaled scanline of this font row, then duplicate it
+        uint32_t* line = out + row * scale * cell;
+        for (int col = 0; col < 8; col++) {
+            uint32_t color = ((bitmap[row] >> (7 - col)) & 1) ? fg : bg;
+            for (int sx = 0; sx < scale; sx++) {
+                line[col * scale + sx] = color;
+            }
+        }
+        for (int sy = 1; sy < scale; sy++) {
+            memcpy(line + sy * cell, line, cell * sizeof(uint32_t));
+        }
+    }
+}
+
+static uint32_t* glyph_lookup(char c, uint32_t fg, uint32_t bg) {
+    uint32_t hash = (uint8_t)c * 2654435761u ^ fg * 40503u ^ bg * 9176u;
+    uint32_t set = (hash >> 8) & (GLYPH_CACHE_SETS - 1);
+    glyph_slot_t* slots = g_GlyphSlots[set];
+    int cell_pixels = 64 * g_GlyphScale * g_GlyphScale;
+
+    g_GlyphClock++;
+
+    int victim = 0;
+    for (int way = 0; way < GLYPH_CACHE_WAYS; way++) {
+        glyph_slot_t* slot = &slots[way];
+        if (slot->valid && slot->ch == c && slot->fg == fg && slot->bg == bg) {
+            slot->last_used = g_GlyphClock;
+            return g_GlyphPixels + (set * GLYPH_CACHE_WAYS + way) * cell_pixels;
+        }
+        // Prefer an empty way, otherwise evict the least recently used one
+        if (!slot->valid) {
+            if (slots[victim].valid) victim = way;
+        } else if (slots[victim].valid && slot->last_used < slots[victim].last_used) {
+            victim = way;
+        }
+    }
+
+    glyph_slot_t* slot = &slots[victim];
+    slot->ch = c;
+    slot->fg = fg;
+    slot->bg = bg;
+    slot->valid = true;
+    slot->last_used = g_GlyphClock;
+
+    uint32_t* pixels = g_GlyphPixels + (set * GLYPH_CACHE_WAYS + victim) * cell_pixels;
+    glyph_rasterize(pixels, c, fg, bg);
+    return pixels;
+}
+
+void glyph_draw(int x, int y, char c, uint32_t fg, uint32_t bg, int scale) {
+    uint32_t* target = graphics_get_draw_buffer();
+    if (!target || scale < 1) return;
+    if (!glyph_cache_set_scale(scale)) return;
+
+    uint32_t* pixels = glyph_lookup(c, fg, bg);
+    int cell = 8 * scale;
+
+    // Clip the cell against the screen
+    int x0 = x < 0 ? 0 : x;
+    int y0 = y < 0 ? 0 : y;
+    int x1 = x + cell > g_vbe_screen->width ? g_vbe_screen->width : x + cell;
+    int y1 = y + cell > g_vbe_screen->height ? g_vbe_screen->height : y + cell;
+    if (x0 >= x1 || y0 >= y1) return;
+
+    size_t row_bytes = (x1 - x0) * sizeof(uint32_t);
+    uint32_t* src = pixels + (y0 - y) * cell + (x0 - x);
+    for (int row = y0; row < y1; row++) {
+        memcpy(graphics_get_row(row) + x0, src, row_bytes);
+        src += cell;
+    }
+
+    graphics_mark_dirty(x0, y0, x1 - x0, y1 - y0);
+}
+
+void glyph_draw_run(int x, int y, const char* str, int count, uint32_t fg, uint32_t bg, int scale) {
+    if (!graphics_get_draw_buffer() || scale < 1 || count <= 0) return;
+    if (!glyph_cache_set_scale(scale)) return;
+
+    int cell = 8 * scale;
+    // Runs hanging off the screen (or huge scales) are rare, let glyph_draw handle those
+    if (cell > GLYPH_RUN_MAX_CELL || x < 0 || y < 0 || x + count * cell > g_vbe_screen->width || y + cell > g_vbe_screen->height) {
+        for (int i = 0; i < count; i++) glyph_draw(x + i * cell, y, str[i], fg, bg, scale);
+        return;
+    }
+
+    // Resolve the rows once; they're shared by every cell of the run.
+    // Each cell is copied right after its lookup, since a later lookup may
+    // evict it from the cache.
+    uint32_t* rows[GLYPH_RUN_MAX_CELL];
+    for (int row = 0; row < cell; row++) rows[row] = graphics_get_row(y + row) + x;
+
+    size_t row_bytes = cell * sizeof(uint32_t);
+    for (int i = 0; i < count; i++) {
+        const uint32_t* pixels = glyph_lookup(str[i], fg, bg);
+        for (int row = 0; row < cell; row++) {
+            memcpy(rows[row] + i * cell, pixels + row * cell, row_bytes);
+        }
+    }
+
+    graphics_mark_dirty(x, y, count * cell, cell);
+}
+
+void glyph_draw_text_to(uint32_t* surface, int w, int h, int x, int y, const char* str, uint32_t fg, uint32_t bg) {
+    for (; *str; str++, x += 8) {
+        const uint8_t* bitmap = glyph_bitmap(*str);
+        for (int row = 0; row < 8; row++) {
+            if (y + row < 0 || y + row >= h) continue;
+            uint32_t* line = surface + (y + row) * w;
+            for (int col = 0; col < 8; col++) {
+                if (x + col < 0 || x + col >= w) continue;
+                line[x + col] = ((bitmap[row] >> (7 - col)) & 1) ? fg : bg;
+            }
+        }
+    }
+}
+
+static void glyph_build_spans() {
+    for (int bits = 0; bits < 256; bits++) {
+        int count = 0;
+        int col = 0;
+        while (col < 8) {
+            if (!((bits >> (7 - col)) & 1)) { col++; continue; }
+            int start = col;
+            while (col < 8 && ((bits >> (7 - col)) & 1)) col++;
+            g_Spans[bits][count][0] = start;
+            g_Spans[bits][count][1] = col - start;
+            count++;
+        }
+        g_SpanCount[bits] = count;
+    }
+    g_SpansReady = true;
+}
+
+void glyph_draw_transparent(int x, int y, char c, uint32_t color, int size) {
+    uint32_t* target = graphics_get_draw_buffer();
+    if (!target || size < 1) return;
+    if (!g_SpansReady) glyph_build_spans();
+
+    const uint8_t* bitmap = glyph_bitmap(c);
+    int width = g_vbe_screen->width;
+    int height = g_vbe_screen->height;
+
+    // Font row/column n covers destination pixels [ceil(n*size/8), ceil((n+1)*size/8))
+    for (int row = 0; row < 8; row++) {
+        uint8_t bits = bitmap[row];
+        if (!bits) continue;
+
+        int dy0 = y + (row * size + 7) / 8;
+        int dy1 = y + ((row + 1) * size + 7) / 8;
+        if (dy0 < 0) dy0 = 0;
+        if (dy1 > height) dy1 = height;
+
+        for (int s = 0; s < g_SpanCount[bits]; s++) {
+            int start = g_Spans[bits][s][0];
+            int end = start + g_Spans[bits][s][1];
+            int dx0 = x + (start * size + 7) / 8;
+            int dx1 = x + (end * size + 7) / 8;
+            if (dx0 < 0) dx0 = 0;
+            if (dx1 > width) dx1 = width;
+
+            for (int dy = dy0; dy < dy1; dy++) {
+                uint32_t* line = graphics_get_row(dy);
+                for (int dx = dx0; dx < dx1; dx++) {
+                    line[dx] = color;
+                }
+            }
+        }
+    }
+
+    graphics_mark_dirty(x, y, size, size);
+}
+
+void glyph_draw_string(int x, int y, const char* str, uint32_t color, int size, int advance) {
+    while (*str) {
+        glyph_draw_transparent(x, y, *str, color, size);
+        x += advance;
+        str++;
+    }
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdint.h>
+
+// Text rendering for the 8x8 font.
+//
+// Opaque glyphs (the console) are rasterized once per (char, fg, bg, scale)
+// into a small set-associative LRU cache and drawn with one memcpy per row.
+// Transparent glyphs (HUDs, logos) are drawn from per-row span tables, so
+// only the lit runs are filled.
+
+#define GLYPH_CACHE_SETS    64
+#define GLYPH_CACHE_WAYS    4
+
+// Draws `c` as an (8*scale)x(8*scale) cell with background
+void glyph_draw(int x, int y, char c, uint32_t fg, uint32_t bg, int scale);
+// Draws `count` opaque cells side by side with a single dirty mark for the run
+void glyph_draw_run(int x, int y, const char* str, int count, uint32_t fg, uint32_t bg, int scale);
+
+// Draws only the lit pixels of `c`, stretched to a size x size cell (nearest neighbour)
+void glyph_draw_transparent(int x, int y, char c, uint32_t color, int size);
+// Draws a string of transparent glyphs, moving `advance` pixels per character
+void glyph_draw_string(int x, int y, const char* str, uint32_t color, int size, int advance);
+
+// Draws `str` at scale 1 into a w x h surface other than the screen (e.g. the
+// overlay). Colours are stored as given, alpha included; nothing is marked dirty.
+void glyph_draw_text_to(uint32_t* surface, int w, int h, int x, int y, const char* str, uint32_t fg, uint32_t bg);
+
+// Drops every cached glyph (e.g. when the palette or font changes)
+void glyph_cache_flush();
@@ -4,20 +4,179 @@
 #include "memory.h"
 #include "stdio.h"
 #include "arch/i686/keyboard.h"
+#include <arch/i686/bga.h>
+#include <arch/i686/paging.h>
+#include "pixel_format.h"
+#include "glyph.h"
+#include "time.h"
 
 uint32_t* g_BackBuffer = NULL;
 bool g_DoubleBufferEnabled = false;
 
+// Drawing always happens in 32-bit 0x00RRGGBB. In other modes the back
+// buffer is mandatory and swap converts it to the VRAM format.
+static const pixel_format_t* g_PixelFormat = NULL;
+static uint32_t g_DrawPitch = 0;            // bytes per row of 32-bit draw buffers
+
+// --- Dirty tracking ---
+// The back buffer is split into tiles with one byte per tile. Drawing marks
+// the tiles it touches and swap copies only runs of dirty tiles to VRAM.
+static uint8_t* g_DirtyTiles = NULL;
+static int g_TilesX = 0;
+static int g_TilesY = 0;
+static int g_DirtyCount = 0;
+static bool g_DirtyAll = false;
+
+// --- Page flipping ---
+// With the Bochs/QEMU dispi interface the visible screen is a window into a
+// taller virtual framebuffer. We render straight into the hidden page and
+// present by moving the window, so no copy is needed at all.
+static bool g_PageFlipping = false;
+static uint32_t* g_RamBackBuffer = NULL;    // copy-path back buffer, parked while flipping
+static int g_FrontPage = 0;
+
+// --- Ring scrolling ---
+// Scrolling rotates the RAM back buffer instead of moving pixels: logical row
+// 0 lives at physical row g_RingOffset and rows wrap at the bottom. Swap puts
+// the rows back in screen order while copying. With the dispi interface we
+// skip even that: VRAM holds the rows in the same rotated order (rows before
+// the offset go into the second page) and the Y offset register points the
+// display at row g_RingOffset.
+static int g_RingOffset = 0;
+static int g_SavedRingOffset = 0;           // RAM buffer's offset, parked while flipping
+static bool g_HwScroll = false;
+
+// --- Layers ---
+// Console and app layers each own a full-screen back buffer with its own
+// dirty tiles and ring offset. The globals above always describe the layer
+// being shown; the console is parked here while an app runs.
+typedef struct {
+    uint32_t* pixels;
+    uint8_t* dirty_tiles;
+    int dirty_count;
+    bool dirty_all;
+    int ring_offset;
+} graphics_layer_t;
+
+static graphics_layer_t g_ConsoleLayer;
+static bool g_AppActive = false;
+
+// The overlay is blended in while spans are presented, so it never touches
+// the layers' pixels. Its damage is forwarded to the shown layer's tiles.
+static uint32_t* g_Overlay = NULL;          // 0xAARRGGBB
+static int g_OverlayX = 0;
+static int g_OverlayY = 0;
+static int g_OverlayW = 0;
+static int g_OverlayH = 0;
+static uint32_t* g_OverlayRow = NULL;       // one composed screen row
+
+static bool g_FpsOverlay = false;
+static uint32_t g_FpsFrames = 0;
+static uint32_t g_FpsLastMs = 0;
+
 static int abs(int n) {
     return (n < 0) ? -n : n;
 }
 
+// Physical back buffer row holding screen row `y`
+static inline int graphics_ring_row(int y) {
+    int row = y + g_RingOffset;
+    return row >= g_vbe_screen->height ? row - g_vbe_screen->height : row;
+}
+
+static inline uint32_t* graphics_row(uint32_t* target, int y) {
+    if (target == g_BackBuffer) y = graphics_ring_row(y);
+    return target + y * (g_DrawPitch / 4);
+}
+
+uint32_t* graphics_get_row(int y) {
+    uint32_t* target = graphics_get_draw_buffer();
+    if (!target || y < 0 || y >= g_vbe_screen->height) return NULL;
+    return graphics_row(target, y);
+}
+
+static inline void graphics_mark_tile(int tx, int ty) {
+    uint8_t* tile = &g_DirtyTiles[ty * g_TilesX + tx];
+    if (!*tile) {
+        *tile = 1;
+        g_DirtyCount++;
+    }
+}
+
+static void graphics_mark_tiles(int x, int y, int w, int h) {
+    int tx0 = x >> GRAPHICS_TILE_SHIFT_X, tx1 = (x + w - 1) >> GRAPHICS_TILE_SHIFT_X;
+    int ty0 = y >> GRAPHICS_TILE_SHIFT_Y, ty1 = (y + h - 1) >> GRAPHICS_TILE_SHIFT_Y;
+    for (int ty = ty0; ty <= ty1; ty++) {
+        for (int tx = tx0; tx <= tx1; tx++) {
+            graphics_mark_tile(tx, ty);
+        }
+    }
+}
+
+void graphics_mark_dirty(int x, int y, int w, int h) {
+    if (!g_DirtyTiles || g_DirtyAll) return;
+
+    // Clip to the screen
+    if (x < 0) { w += x; x = 0; }
+    if (y < 0) { h += y; y = 0; }
+    if (x + w > g_vbe_screen->width) w = g_vbe_screen->width - x;
+    if (y + h > g_vbe_screen->height) h = g_vbe_screen->height - y;
+    if (w <= 0 || h <= 0) return;
+
+    // Tiles are tracked in physical rows, which may wrap past the bottom
+    int py = graphics_ring_row(y);
+    if (py + h > g_vbe_screen->height) {
+        int first = g_vbe_screen->height - py;
+        graphics_mark_tiles(x, py, w, first);
+        graphics_mark_tiles(x, 0, w, h - first);
+    } else {
+        graphics_mark_tiles(x, py, w, h);
+    }
+}
+
+void graphics_mark_all_dirty() {
+    g_DirtyAll = true;
+}
+
+static void graphics_clear_dirty() {
+    if (g_DirtyTiles) memset(g_DirtyTiles, 0, g_TilesX * g_TilesY);
+    g_DirtyCount = 0;
+    g_DirtyAll = false;
+}
+
+static uint32_t* graphics_vram_page(int page) {
+    return (uint32_t*)(g_vbe_screen->physical_buffer + page * g_vbe_screen->height * g_vbe_screen->pitch);
+}
+
+// Makes the dispi virtual screen two pages tall and maps the second page.
+// Both page flipping and ring scrolling need it.
+static bool graphics_reserve_second_page() {
+    if (!i686_BGA_IsAvailable()) return false;
+
+    uint32_t page_size = g_vbe_screen->height * g_vbe_screen->pitch;
+    uint32_t vram = i686_BGA_GetVideoMemory();
+    if (vram && vram < 2 * page_size) return false;
+
+    // Ask for a virtual screen two pages tall and check the adapter agreed
+    i686_BGA_Write(BGA_INDEX_VIRT_HEIGHT, g_vbe_screen->height * 2);
+    if (i686_BGA_Read(BGA_INDEX_VIRT_HEIGHT) < g_vbe_screen->height * 2) {
+        i686_BGA_Write(BGA_INDEX_VIRT_HEIGHT, g_vbe_screen->height);
+        return false;
+    }
+
+    // Paging only covers the first page of the framebuffer
+    i686_Paging_Map_Range_Cached(g_vbe_screen->physical_buffer + page_size,
+                                 g_vbe_screen->physical_buffer + page_size, page_size,
+                                 PAGING_CACHE_WRITE_COMBINING);
+    return true;
+}
+
 void graphics_init_double_buffer() {
-    if (!g_vbe_screen) return;
+    if (!g_vbe_screen || !g_PixelFormat) return;
     
     // Allocate memory for the back buffer
     // Size = Height * Pitch (Pitch is bytes per line)
-    size_t buffer_size = g_vbe_screen->height * g_vbe_screen->pitch;
+    size_t buffer_size = g_vbe_screen->height * g_DrawPitch;
     
     if (!g_BackBuffer) {
         g_BackBuffer = (uint32_t*)malloc(buffer_size);
@@ -30,9 +189,76 @@ void graphics_init_double_buffer() {
             getch(); // Wait so user sees the error
         }
     }
+
+    if (!g_DirtyTiles) {
+        g_TilesX = (g_vbe_screen->width + GRAPHICS_TILE_WIDTH - 1) >> GRAPHICS_TILE_SHIFT_X;
+        g_TilesY = (g_vbe_screen->height + GRAPHICS_TILE_HEIGHT - 1) >> GRAPHICS_TILE_SHIFT_Y;
+        g_DirtyTiles = (uint8_t*)malloc(g_TilesX * g_TilesY);
+    }
+    // The new back buffer doesn't match what's on screen yet
+    graphics_clear_dirty();
+    g_DirtyAll = true;
+
+    g_RingOffset = 0;
+    if (g_BackBuffer && !g_HwScroll) g_HwScroll = graphics_reserve_second_page();
+}
+
+bool graphics_set_page_flipping(bool enabled) {
+    if (enabled == g_PageFlipping) return true;
+
+    if (!enabled) {
+        // Show page 0 again and hand drawing back to the RAM buffer.
+        // The next swap rewrites VRAM and the Y offset for ring scrolling.
+        i686_BGA_Write(BGA_INDEX_Y_OFFSET, 0);
+        if (!g_HwScroll) i686_BGA_Write(BGA_INDEX_VIRT_HEIGHT, g_vbe_screen->height);
+        g_BackBuffer = g_RamBackBuffer;
+        g_RamBackBuffer = NULL;
+        g_RingOffset = g_SavedRingOffset;
+        g_PageFlipping = false;
+        graphics_mark_all_dirty();
+        return true;
+    }
+
+    if (!g_vbe_screen || !g_DoubleBufferEnabled || !g_BackBuffer) return false;
+    // The overlay is only blended in on the copy path
+    if (g_Overlay) return false;
+    // Apps draw 32-bit pixels straight into the pages
+    if (!g_PixelFormat->native) return false;
+    if (!g_HwScroll && !graphics_reserve_second_page()) return false;
+
+    // VRAM pages are always drawn in screen order
+    g_SavedRingOffset = g_RingOffset;
+    g_RingOffset = 0;
+
+    i686_BGA_Write(BGA_INDEX_Y_OFFSET, 0);
+    g_FrontPage = 0;
+    g_RamBackBuffer = g_BackBuffer;
+    g_BackBuffer = graphics_vram_page(1);
+    g_PageFlipping = true;
+    return true;
+}
+
+bool graphics_is_page_flipping() {
+    return g_PageFlipping;
 }
 
 void graphics_set_double_buffering(bool enabled) {
+    // Without a 32-bit mode there's nothing to draw into except the back buffer
+    if (!enabled && g_PixelFormat && !g_PixelFormat->native) {
+        graphics_set_page_flipping(false);
+        return;
+    }
+    if (!enabled) {
+        // g_BackBuffer may point into VRAM, put the RAM buffer back first
+        graphics_set_page_flipping(false);
+        // Drawing goes straight to page 0 from now on
+        if (g_HwScroll) {
+            i686_BGA_Write(BGA_INDEX_Y_OFFSET, 0);
+            i686_BGA_Write(BGA_INDEX_VIRT_HEIGHT, g_vbe_screen->height);
+            g_HwScroll = false;
+        }
+        g_RingOffset = 0;
+    }
     if (enabled) {
         if (!g_BackBuffer) {
             graphics_init_double_buffer();
@@ -44,37 +270,171 @@ void graphics_set_double_buffering(bool enabled) {
             free(g_BackBuffer);
             g_BackBuffer = NULL;
         }
+        if (g_DirtyTiles) {
+            free(g_DirtyTiles);
+            g_DirtyTiles = NULL;
+        }
     }
 }
 
+// VRAM row that physical back buffer row `row` is copied to
+static inline int graphics_vram_row(int row) {
+    if (row < g_RingOffset) row += g_vbe_screen->height;
+    return g_HwScroll ? row : row - g_RingOffset;
+}
+
+// Screen row that physical back buffer row `row` holds
+static inline int graphics_screen_row(int row) {
+    row -= g_RingOffset;
+    return row < 0 ? row + g_vbe_screen->height : row;
+}
+
+// `src` over `dst`; src alpha 0 leaves dst alone, 255 replaces it
+static inline uint32_t graphics_blend(uint32_t dst, uint32_t src) {
+    uint32_t a = src >> 24;
+    if (a == 0) return dst;
+    if (a == 255) return src & 0x00FFFFFF;
+
+    // Red and blue share a multiply; neither can carry into the other
+    uint32_t rb = ((src & 0x00FF00FF) * a + (dst & 0x00FF00FF) * (255 - a)) >> 8;
+    uint32_t g = ((src & 0x0000FF00) * a + (dst & 0x0000FF00) * (255 - a)) >> 8;
+    return (rb & 0x00FF00FF) | (g & 0x0000FF00);
+}
+
+// Returns the span [x, x + count) of screen row `y` with the overlay blended
+// over it. Spans the overlay doesn't cover come back untouched.
+static const uint32_t* graphics_overlay_compose(const uint32_t* row, int y, int x, int count) {
+    int oy = y - g_OverlayY;
+    if (oy < 0 || oy >= g_OverlayH) return row;
+
+    int x0 = x > g_OverlayX ? x : g_OverlayX;
+    int x1 = x + count < g_OverlayX + g_OverlayW ? x + count : g_OverlayX + g_OverlayW;
+    if (x0 >= x1) return row;
+
+    memcpy(g_OverlayRow + x, row + x, count * sizeof(uint32_t));
+    const uint32_t* src = g_Overlay + oy * g_OverlayW + (x0 - g_OverlayX);
+    uint32_t* dst = g_OverlayRow + x0;
+    for (int i = 0; i < x1 - x0; i++) dst[i] = graphics_blend(dst[i], src[i]);
+    return g_OverlayRow;
+}
+
+// Copies `count` pixels of physical back buffer row `y` to a VRAM row,
+// blending the overlay and converting if needed
+static inline void graphics_present_span(uint8_t* vram_row, const uint32_t* row, int y, int x, int count) {
+    if (g_Overlay) row = graphics_overlay_compose(row, graphics_screen_row(y), x, count);
+    if (g_PixelFormat->native) {
+        memcpy(vram_row + x * 4, row + x, count * 4);
+    } else {
+        g_PixelFormat->convert(g_PixelFormat, vram_row + x * g_PixelFormat->bytes, row + x, count);
+    }
+}
+
+static void graphics_fps_update();
+
 void graphics_swap_buffer() {
     if (!g_BackBuffer || !g_vbe_screen) return;
-    memcpy((void*)g_vbe_screen->physical_buffer, g_BackBuffer, g_vbe_screen->height * g_vbe_screen->pitch);
+    if (g_FpsOverlay) graphics_fps_update();
+
+    if (g_PageFlipping) {
+        // Show the page we just drew and start drawing into the other one
+        int back = 1 - g_FrontPage;
+        i686_BGA_Write(BGA_INDEX_Y_OFFSET, back * g_vbe_screen->height);
+        g_FrontPage = back;
+        g_BackBuffer = graphics_vram_page(1 - back);
+        graphics_clear_dirty();
+        return;
+    }
+
+    uint8_t* dst = (uint8_t*)g_vbe_screen->physical_buffer;
+    uint8_t* src = (uint8_t*)g_BackBuffer;
+    uint32_t pitch = g_vbe_screen->pitch;
+    int offset_rows = g_RingOffset;
+
+    // Past a certain point one big streaming copy beats many small ones.
+    // Rows from the offset down and rows above it are each contiguous.
+    if (!g_DirtyTiles || g_DirtyAll ||
+        g_DirtyCount * 100 >= g_TilesX * g_TilesY * GRAPHICS_FULL_SWAP_PERCENT) {
+        int height = g_vbe_screen->height;
+        if (g_PixelFormat->native && !g_Overlay) {
+            memcpy(dst + graphics_vram_row(offset_rows) * pitch, src + offset_rows * pitch,
+                   (height - offset_rows) * pitch);
+            if (offset_rows) memcpy(dst + graphics_vram_row(0) * pitch, src, offset_rows * pitch);
+        } else {
+            for (int y = 0; y < height; y++) {
+                graphics_present_span(dst + graphics_vram_row(y) * pitch,
+                                      (uint32_t*)(src + y * g_DrawPitch), y, 0, g_vbe_screen->width);
+            }
+        }
+        graphics_clear_dirty();
+        if (g_HwScroll) i686_BGA_Write(BGA_INDEX_Y_OFFSET, offset_rows);
+        return;
+    }
+    if (g_DirtyCount == 0) {
+        if (g_HwScroll) i686_BGA_Write(BGA_INDEX_Y_OFFSET, offset_rows);
+        return;
+    }
+
+    for (int ty = 0; ty < g_TilesY; ty++) {
+        uint8_t* row = &g_DirtyTiles[ty * g_TilesX];
+        int y0 = ty << GRAPHICS_TILE_SHIFT_Y;
+        int y1 = y0 + GRAPHICS_TILE_HEIGHT;
+        if (y1 > g_vbe_screen->height) y1 = g_vbe_screen->height;
+
+        int tx = 0;
+        while (tx < g_TilesX) {
+            if (!row[tx]) { tx++; continue; }
+
+            // Copy each horizontal run of dirty tiles as one span per scanline
+            int run_start = tx;
+            while (tx < g_TilesX && row[tx]) row[tx++] = 0;
+
+            int x0 = run_start << GRAPHICS_TILE_SHIFT_X;
+            int x1 = tx << GRAPHICS_TILE_SHIFT_X;
+            if (x1 > g_vbe_screen->width) x1 = g_vbe_screen->width;
+            for (int y = y0; y < y1; y++) {
+                graphics_present_span(dst + graphics_vram_row(y) * pitch,
+                                      (uint32_t*)(src + y * g_DrawPitch), y, x0, x1 - x0);
+            }
+        }
+    }
+    g_DirtyCount = 0;
+    if (g_HwScroll) i686_BGA_Write(BGA_INDEX_Y_OFFSET, offset_rows);
 }
 
 void graphics_clear_buffer(uint32_t color) {
-    if (!g_vbe_screen) return;
+    if (!g_vbe_screen || !g_PixelFormat) return;
     
     uint32_t* target;
     if (g_DoubleBufferEnabled && g_BackBuffer) {
         target = g_BackBuffer;
-    } else {
+        graphics_mark_all_dirty();
+        // Every row gets the same value, so the buffer may as well be in order again
+        g_RingOffset = 0;
+    } else if (g_PixelFormat->native) {
         target = (uint32_t*)g_vbe_screen->physical_buffer;
+    } else {
+        // Straight into VRAM in its own format
+        uint8_t* row = (uint8_t*)g_vbe_screen->physical_buffer;
+        for (int y = 0; y < g_vbe_screen->height; y++) {
+            g_PixelFormat->fill(g_PixelFormat, row, color, g_vbe_screen->width);
+            row += g_vbe_screen->pitch;
+        }
+        return;
     }
     
     // Optimization for black
     if (color == 0) {
-        memset(target, 0, g_vbe_screen->height * g_vbe_screen->pitch);
+        memset(target, 0, g_vbe_screen->height * g_DrawPitch);
         return;
     }
 
-    // Fill manually (assuming 32bpp)
-    size_t pixels = (g_vbe_screen->height * g_vbe_screen->pitch) / 4;
-    // Use a faster fill if possible, but at least minimize calculations
-    uint32_t *ptr = target;
-    while(pixels--) {
-        *ptr++ = color;
-    }
+    memset32(target, color, (g_vbe_screen->height * g_DrawPitch) / 4);
+}
+
+uint32_t* graphics_get_draw_buffer() {
+    if (!g_vbe_screen || !g_PixelFormat) return NULL;
+    if (g_DoubleBufferEnabled && g_BackBuffer) return g_BackBuffer;
+    return g_PixelFormat->native ? (uint32_t*)g_vbe_screen->physical_buffer : NULL;
 }
 
 void draw_pixel(int x, int y, uint32_t color)
@@ -85,8 +445,8 @@ void draw_pixel(int x, int y, uint32_t color)
         return;
     }
 
-    // We only support 32 bpp for simplicity
-    if (g_vbe_screen->bpp != 32)
+    // Other depths are only drawn through the back buffer
+    if (!g_PixelFormat || (!g_PixelFormat->native && !(g_DoubleBufferEnabled && g_BackBuffer)))
     {
         return;
     }
@@ -95,11 +455,13 @@ void draw_pixel(int x, int y, uint32_t color)
     
     if (g_DoubleBufferEnabled && g_BackBuffer) {
         framebuffer = g_BackBuffer;
+        y = graphics_ring_row(y);
+        if (g_DirtyTiles) graphics_mark_tile(x >> GRAPHICS_TILE_SHIFT_X, y >> GRAPHICS_TILE_SHIFT_Y);
     } else {
         framebuffer = (uint32_t*)g_vbe_screen->physical_buffer;
     }
 
-    uint32_t pitch_in_dwords = g_vbe_screen->pitch / 4;
+    uint32_t pitch_in_dwords = g_DrawPitch / 4;
 
     framebuffer[y * pitch_in_dwords + x] = color;
 }
@@ -107,6 +469,17 @@ void draw_pixel(int x, int y, uint32_t color)
 void draw_line(int x0, int y0, int x1, int y1, uint32_t color) {
     int dx = abs(x1 - x0);
     int dy = abs(y1 - y0);
+
+    // Axis-aligned lines are a single clipped span
+    if (dy == 0) {
+        graphics_hline(x0 < x1 ? x0 : x1, y0, dx + 1, color);
+        return;
+    }
+    if (dx == 0) {
+        graphics_vline(x0, y0 < y1 ? y0 : y1, dy + 1, color);
+        return;
+    }
+
     int sx = (x0 < x1) ? 1 : -1;
     int sy = (y0 < y1) ? 1 : -1;
     int err = (dx > dy ? dx : -dy) / 2;
@@ -125,4 +498,319 @@ void draw_line(int x0, int y0, int x1, int y1, uint32_t color) {
             err += dx; y0 += sy; 
         }
     }
-}
\ No newline at end of file
+}
+
+// --- 2D primitives ---
+// Each primitive clips once, then works on whole rows of the draw buffer.
+
+// Clips a w x h rectangle at (*x, *y) against the screen. `skip_x`/`skip_y`
+// receive how many columns/rows were cut off at the left/top.
+static bool graphics_clip(int* x, int* y, int* w, int* h, int* skip_x, int* skip_y) {
+    *skip_x = 0;
+    *skip_y = 0;
+    if (*x < 0) { *skip_x = -*x; *w += *x; *x = 0; }
+    if (*y < 0) { *skip_y = -*y; *h += *y; *y = 0; }
+    if (*x + *w > g_vbe_screen->width) *w = g_vbe_screen->width - *x;
+    if (*y + *h > g_vbe_screen->height) *h = g_vbe_screen->height - *y;
+    return *w > 0 && *h > 0;
+}
+
+void graphics_fill_rect(int x, int y, int w, int h, uint32_t color) {
+    uint32_t* target = graphics_get_draw_buffer();
+    int skip_x, skip_y;
+    if (!target || !graphics_clip(&x, &y, &w, &h, &skip_x, &skip_y)) return;
+
+    for (int i = 0; i < h; i++) {
+        memset32(graphics_row(target, y + i) + x, color, w);
+    }
+    graphics_mark_dirty(x, y, w, h);
+}
+
+void graphics_hline(int x, int y, int w, uint32_t color) {
+    graphics_fill_rect(x, y, w, 1, color);
+}
+
+void graphics_vline(int x, int y, int h, uint32_t color) {
+    uint32_t* target = graphics_get_draw_buffer();
+    int w = 1, skip_x, skip_y;
+    if (!target || !graphics_clip(&x, &y, &w, &h, &skip_x, &skip_y)) return;
+
+    for (int i = 0; i < h; i++) {
+        graphics_row(target, y + i)[x] = color;
+    }
+    graphics_mark_dirty(x, y, 1, h);
+}
+
+void graphics_blit(int x, int y, const uint32_t* src, int w, int h, int stride) {
+    uint32_t* target = graphics_get_draw_buffer();
+    int skip_x, skip_y;
+    if (!target || !src || !graphics_clip(&x, &y, &w, &h, &skip_x, &skip_y)) return;
+
+    const uint32_t* s = src + skip_y * stride + skip_x;
+    for (int i = 0; i < h; i++) {
+        memcpy(graphics_row(target, y + i) + x, s, w * sizeof(uint32_t));
+        s += stride;
+    }
+    graphics_mark_dirty(x, y, w, h);
+}
+
+void graphics_blit_keyed(int x, int y, const uint32_t* src, int w, int h, int stride, uint32_t key) {
+    uint32_t* target = graphics_get_draw_buffer();
+    int skip_x, skip_y;
+    if (!target || !src || !graphics_clip(&x, &y, &w, &h, &skip_x, &skip_y)) return;
+
+    const uint32_t* s = src + skip_y * stride + skip_x;
+    for (int i = 0; i < h; i++) {
+        uint32_t* d = graphics_row(target, y + i) + x;
+        for (int j = 0; j < w; j++) {
+            if (s[j] != key) d[j] = s[j];
+        }
+        s += stride;
+    }
+    graphics_mark_dirty(x, y, w, h);
+}
+
+void graphics_blit_scaled(int x, int y, int dw, int dh, const uint32_t* src, int sw, int sh, int stride) {
+    uint32_t* target = graphics_get_draw_buffer();
+    if (!target || !src || dw <= 0 || dh <= 0 || sw <= 0 || sh <= 0) return;
+
+    // 16.16 fixed-point source steps, nearest neighbour
+    uint32_t step_x = ((uint32_t)sw << 16) / dw;
+    uint32_t step_y = ((uint32_t)sh << 16) / dh;
+
+    int skip_x, skip_y;
+    if (!graphics_clip(&x, &y, &dw, &dh, &skip_x, &skip_y)) return;
+
+    uint32_t fy = skip_y * step_y;
+    for (int i = 0; i < dh; i++) {
+        uint32_t* d = graphics_row(target, y + i) + x;
+        const uint32_t* s = src + (fy >> 16) * stride;
+        uint32_t fx = skip_x * step_x;
+        for (int j = 0; j < dw; j++) {
+            d[j] = s[fx >> 16];
+            fx += step_x;
+        }
+        fy += step_y;
+    }
+    graphics_mark_dirty(x, y, dw, dh);
+}
+
+void graphics_copy_rect(int src_x, int src_y, int w, int h, int dst_x, int dst_y) {
+    uint32_t* target = graphics_get_draw_buffer();
+    if (!target) return;
+
+    // Clip the source, then the destination, shifting the other side along
+    if (src_x < 0) { w += src_x; dst_x -= src_x; src_x = 0; }
+    if (src_y < 0) { h += src_y; dst_y -= src_y; src_y = 0; }
+    if (src_x + w > g_vbe_screen->width) w = g_vbe_screen->width - src_x;
+    if (src_y + h > g_vbe_screen->height) h = g_vbe_screen->height - src_y;
+    if (dst_x < 0) { w += dst_x; src_x -= dst_x; dst_x = 0; }
+    if (dst_y < 0) { h += dst_y; src_y -= dst_y; dst_y = 0; }
+    if (dst_x + w > g_vbe_screen->width) w = g_vbe_screen->width - dst_x;
+    if (dst_y + h > g_vbe_screen->height) h = g_vbe_screen->height - dst_y;
+    if (w <= 0 || h <= 0) return;
+
+    size_t row_bytes = w * sizeof(uint32_t);
+
+    // Walk rows bottom-up when moving down so overlapping rows aren't clobbered
+    if (dst_y > src_y) {
+        for (int i = h - 1; i >= 0; i--) {
+            memmove(graphics_row(target, dst_y + i) + dst_x, graphics_row(target, src_y + i) + src_x, row_bytes);
+        }
+    } else {
+        for (int i = 0; i < h; i++) {
+            memmove(graphics_row(target, dst_y + i) + dst_x, graphics_row(target, src_y + i) + src_x, row_bytes);
+        }
+    }
+    graphics_mark_dirty(dst_x, dst_y, w, h);
+}
+
+void graphics_scroll_up(int rows, uint32_t fill) {
+    uint32_t* target = graphics_get_draw_buffer();
+    if (!target || rows <= 0) return;
+
+    int height = g_vbe_screen->height;
+    if (rows > height) rows = height;
+
+    if (target == g_BackBuffer && !g_PageFlipping) {
+        // Just move the start row. Without the Y offset register every row
+        // now shows up somewhere else; with it only wrapping back to the top
+        // leaves VRAM rows in the wrong page.
+        int old_offset = g_RingOffset;
+        g_RingOffset = (g_RingOffset + rows) % height;
+        if (!g_HwScroll || g_RingOffset < old_offset) graphics_mark_all_dirty();
+        // VRAM still has the overlay blended into rows that just moved up
+        if (g_Overlay) graphics_mark_dirty(g_OverlayX, g_OverlayY - rows, g_OverlayW, g_OverlayH + rows);
+    } else {
+        // Drawing straight to VRAM, the pixels have to move
+        size_t pitch = g_vbe_screen->pitch;
+        memmove(target, (uint8_t*)target + rows * pitch, (height - rows) * pitch);
+        graphics_mark_all_dirty();
+    }
+
+    graphics_fill_rect(0, height - rows, g_vbe_screen->width, rows, fill);
+}
+
+void graphics_initialize() {
+    if (!g_vbe_screen) return;
+
+    g_PixelFormat = pixel_format_detect(g_vbe_screen);
+    if (!g_PixelFormat) return;
+    g_DrawPitch = g_PixelFormat->native ? g_vbe_screen->pitch : g_vbe_screen->width * 4;
+}
+
+const char* graphics_get_format_name() {
+    return g_PixelFormat ? g_PixelFormat->name : "unsupported";
+}
+
+// --- Layers ---
+
+static void graphics_park_layer(graphics_layer_t* layer) {
+    layer->pixels = g_BackBuffer;
+    layer->dirty_tiles = g_DirtyTiles;
+    layer->dirty_count = g_DirtyCount;
+    layer->dirty_all = g_DirtyAll;
+    layer->ring_offset = g_RingOffset;
+}
+
+static void graphics_show_layer(const graphics_layer_t* layer) {
+    g_BackBuffer = layer->pixels;
+    g_DirtyTiles = layer->dirty_tiles;
+    g_DirtyCount = layer->dirty_count;
+    g_DirtyAll = layer->dirty_all;
+    g_RingOffset = layer->ring_offset;
+}
+
+bool graphics_app_begin() {
+    if (g_AppActive) return true;
+    graphics_set_double_buffering(true);
+    if (!g_DoubleBufferEnabled) return false;
+
+    size_t buffer_size = g_vbe_screen->height * g_DrawPitch;
+    graphics_layer_t app = { 0 };
+    app.pixels = (uint32_t*)malloc(buffer_size);
+    app.dirty_tiles = (uint8_t*)malloc(g_TilesX * g_TilesY);
+    if (!app.pixels || !app.dirty_tiles) {
+        free(app.pixels);
+        free(app.dirty_tiles);
+        return false;
+    }
+    memset(app.pixels, 0, buffer_size);
+    memset(app.dirty_tiles, 0, g_TilesX * g_TilesY);
+    // Nothing of the app is on screen yet
+    app.dirty_all = true;
+
+    graphics_park_layer(&g_ConsoleLayer);
+    graphics_show_layer(&app);
+    g_AppActive = true;
+    return true;
+}
+
+void graphics_app_end() {
+    if (!g_AppActive) return;
+
+    // Brings the app's RAM buffer back if it was flipping pages
+    graphics_set_page_flipping(false);
+    free(g_BackBuffer);
+    free(g_DirtyTiles);
+
+    graphics_show_layer(&g_ConsoleLayer);
+    g_AppActive = false;
+
+    // The console's pixels are as it left them; VRAM just needs them back
+    graphics_mark_all_dirty();
+    graphics_swap_buffer();
+}
+
+bool graphics_app_active() {
+    return g_AppActive;
+}
+
+// --- Overlay ---
+
+uint32_t* graphics_overlay_create(int x, int y, int w, int h) {
+    graphics_overlay_destroy();
+    if (!g_vbe_screen || !g_DoubleBufferEnabled || !g_BackBuffer) return NULL;
+
+    int skip_x, skip_y;
+    if (!graphics_clip(&x, &y, &w, &h, &skip_x, &skip_y)) return NULL;
+
+    uint32_t* pixels = (uint32_t*)malloc(w * h * sizeof(uint32_t));
+    uint32_t* row = (uint32_t*)malloc(g_vbe_screen->width * sizeof(uint32_t));
+    if (!pixels || !row) {
+        free(pixels);
+        free(row);
+        return NULL;
+    }
+    memset(pixels, 0, w * h * sizeof(uint32_t));
+
+    graphics_set_page_flipping(false);
+    g_Overlay = pixels;
+    g_OverlayRow = row;
+    g_OverlayX = x;
+    g_OverlayY = y;
+    g_OverlayW = w;
+    g_OverlayH = h;
+    return pixels;
+}
+
+void graphics_overlay_destroy() {
+    if (!g_Overlay) return;
+
+    // Let the layer underneath show through again
+    graphics_mark_dirty(g_OverlayX, g_OverlayY, g_OverlayW, g_OverlayH);
+    free(g_Overlay);
+    free(g_OverlayRow);
+    g_Overlay = NULL;
+    g_OverlayRow = NULL;
+    g_FpsOverlay = false;
+}
+
+void graphics_overlay_damage(int x, int y, int w, int h) {
+    if (!g_Overlay) return;
+    graphics_mark_dirty(g_OverlayX + x, g_OverlayY + y, w, h);
+}
+
+// --- FPS overlay ---
+
+#define FPS_OVERLAY_WIDTH   (8 * 8 + 8)
+#define FPS_OVERLAY_HEIGHT  (8 + 8)
+
+static void graphics_fps_draw(const char* text) {
+    // Translucent backing so the digits read over anything
+    memset32(g_Overlay, 0xA0000000, FPS_OVERLAY_WIDTH * FPS_OVERLAY_HEIGHT);
+    glyph_draw_text_to(g_Overlay, FPS_OVERLAY_WIDTH, FPS_OVERLAY_HEIGHT, 4, 4, text, 0xFF55FF55, 0);
+    graphics_overlay_damage(0, 0, FPS_OVERLAY_WIDTH, FPS_OVERLAY_HEIGHT);
+}
+
+static void graphics_fps_update() {
+    g_FpsFrames++;
+    uint32_t now = get_uptime_ms();
+    uint32_t elapsed = now - g_FpsLastMs;
+    if (elapsed < 1000) return;
+
+    char text[16];
+    sprintf(text, "%u fps", (unsigned int)(g_FpsFrames * 1000 / elapsed));
+    graphics_fps_draw(text);
+    g_FpsFrames = 0;
+    g_FpsLastMs = now;
+}
+
+void graphics_set_fps_overlay(bool enabled) {
+    if (enabled == g_FpsOverlay) return;
+    if (!enabled) {
+        graphics_overlay_destroy();
+        return;
+    }
+
+    int x = g_vbe_screen ? g_vbe_screen->width - FPS_OVERLAY_WIDTH - 8 : 0;
+    if (!graphics_overlay_create(x, 8, FPS_OVERLAY_WIDTH, FPS_OVERLAY_HEIGHT)) return;
+    g_FpsOverlay = true;
+    g_FpsFrames = 0;
+    g_FpsLastMs = get_uptime_ms();
+    graphics_fps_draw("-- fps");
+}
+
+bool graphics_is_fps_overlay() {
+    return g_FpsOverlay;
+}
@@ -5,13 +5,79 @@
 
 #define COLOR_RED   0x00FF0000
 
+// Dirty tracking granularity for graphics_swap_buffer (powers of two)
+#define GRAPHICS_TILE_SHIFT_X       5
+#define GRAPHICS_TILE_SHIFT_Y       4
+#define GRAPHICS_TILE_WIDTH         (1 << GRAPHICS_TILE_SHIFT_X)
+#define GRAPHICS_TILE_HEIGHT        (1 << GRAPHICS_TILE_SHIFT_Y)
+// Swap copies the whole frame once this share of tiles is dirty
+#define GRAPHICS_FULL_SWAP_PERCENT  60
+
 extern bool g_DoubleBufferEnabled;
 extern uint32_t* g_BackBuffer;
 
 void draw_pixel(int x, int y, uint32_t color);
+// Buffer that draw_pixel would write to. Always 32-bit 0x00RRGGBB; NULL if
+// there is nothing to draw into (unsupported mode, or not 32bpp without a back buffer)
+uint32_t* graphics_get_draw_buffer();
+// Row `y` of the draw buffer. Scrolling rotates the back buffer rather than
+// moving pixels, so rows aren't always `pitch` apart; go through this.
+uint32_t* graphics_get_row(int y);
 void draw_line(int x0, int y0, int x1, int y1, uint32_t color);
 
+// 2D primitives, clipped to the screen and drawn into the current draw buffer
+void graphics_fill_rect(int x, int y, int w, int h, uint32_t color);
+void graphics_hline(int x, int y, int w, uint32_t color);
+void graphics_vline(int x, int y, int h, uint32_t color);
+// `stride` is the source width in pixels
+void graphics_blit(int x, int y, const uint32_t* src, int w, int h, int stride);
+// Like graphics_blit, but source pixels equal to `key` are left out
+void graphics_blit_keyed(int x, int y, const uint32_t* src, int w, int h, int stride, uint32_t key);
+// Stretches an sw x sh image to dw x dh (nearest neighbour)
+void graphics_blit_scaled(int x, int y, int dw, int dh, const uint32_t* src, int sw, int sh, int stride);
+// Moves a rectangle within the draw buffer; overlapping source and destination are fine
+void graphics_copy_rect(int src_x, int src_y, int w, int h, int dst_x, int dst_y);
+
+// Picks the pixel format for the VBE mode; call after i686_CPU_Initialize()
+void graphics_initialize();
+const char* graphics_get_format_name();
+
 void graphics_init_double_buffer();
 void graphics_swap_buffer();
 void graphics_clear_buffer(uint32_t color);
-void graphics_set_double_buffering(bool enabled);
\ No newline at end of file
+void graphics_set_double_buffering(bool enabled);
+// Scrolls the screen up by `rows` pixel rows and fills the rows exposed at the bottom
+void graphics_scroll_up(int rows, uint32_t fill);
+
+// Hardware page flipping (Bochs/QEMU dispi). While enabled, g_BackBuffer points
+// at the hidden VRAM page and changes on every swap, so re-read it each frame.
+// Returns false if the adapter can't do it; the copy path stays in use then.
+bool graphics_set_page_flipping(bool enabled);
+bool graphics_is_page_flipping();
+
+// Code that writes g_BackBuffer directly must report what it touched
+void graphics_mark_dirty(int x, int y, int w, int h);
+void graphics_mark_all_dirty();
+
+// --- Layers ---
+// The console and app layers are full-screen; only one of them is shown.
+// graphics_app_begin gives the caller a fresh surface to draw into (the
+// usual draw functions and g_BackBuffer target it) and parks the console
+// with its pixels and damage intact, so graphics_app_end shows the shell
+// again without redrawing any text. Returns false if there's no memory.
+bool graphics_app_begin();
+void graphics_app_end();
+bool graphics_app_active();
+
+// The overlay is a small 0xAARRGGBB surface blended over whichever layer is
+// shown as it's presented. Only one exists at a time; creating it turns page
+// flipping off, since flipped pages never pass through the compositor.
+// Returns the overlay's pixels, cleared to transparent, or NULL.
+uint32_t* graphics_overlay_create(int x, int y, int w, int h);
+void graphics_overlay_destroy();
+// Report what was drawn into the overlay, in overlay coordinates
+void graphics_overlay_damage(int x, int y, int w, int h);
+
+// Frames-per-second counter in the top right corner, drawn on the overlay
+void graphics_set_fps_overlay(bool enabled);
+bool graphics_is_fps_overlay();
@@ -0,0 +1,141 @@
+#include "acpi.h"
+#include <arch/i686/paging.h>
+#include "memory.h"
+#include "string.h"
+#include "stdio.h"
+
+// MADT entry types
+#define MADT_LOCAL_APIC         0
+#define MADT_IOAPIC             1
+#define MADT_SOURCE_OVERRIDE    2
+#define MADT_LAPIC_ENABLED      0x01
+#define MADT_PCAT_COMPAT        0x01
+
+typedef struct {
+    char signature[8];
+    uint8_t checksum;
+    char oem_id[6];
+    uint8_t revision;
+    uint32_t rsdt_address;
+} __attribute__((packed)) acpi_rsdp_t;
+
+typedef struct {
+    acpi_header_t header;
+    uint32_t lapic_address;
+    uint32_t flags;
+} __attribute__((packed)) acpi_madt_t;
+
+acpi_madt_info_t g_AcpiMadt;
+
+static const acpi_header_t* g_Rsdt = NULL;
+
+static bool acpi_checksum(const void* data, uint32_t length) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    uint8_t sum = 0;
+    for (uint32_t i = 0; i < length; i++) sum += bytes[i];
+    return sum == 0;
+}
+
+// Tables usually sit in RAM below the identity map, but firmware may put
+// them anywhere; map whatever isn't reachable yet
+static void acpi_map(uint32_t phys, uint32_t length) {
+    uint32_t first = phys & 0xFFFFF000;
+    uint32_t last = (phys + length - 1) & 0xFFFFF000;
+    for (uint32_t page = first; page <= last; page += 4096) {
+        if (i686_Paging_Get_Physical(page) != page) i686_Paging_Map_Range(page, page, 4096);
+        if (page == 0xFFFFF000) break;
+    }
+}
+
+static const acpi_header_t* acpi_map_table(uint32_t phys) {
+    acpi_map(phys, sizeof(acpi_header_t));
+    const acpi_header_t* header = (const acpi_header_t*)phys;
+    acpi_map(phys, header->length);
+    return acpi_checksum(header, header->length) ? header : NULL;
+}
+
+static const acpi_rsdp_t* acpi_scan_rsdp(uint32_t start, uint32_t length) {
+    for (uint32_t addr = start; addr < start + length; addr += 16) {
+        const acpi_rsdp_t* rsdp = (const acpi_rsdp_t*)addr;
+        if (memcmp(rsdp->signature, "RSD PTR ", 8) == 0 && acpi_checksum(rsdp, sizeof(acpi_rsdp_t))) {
+            return rsdp;
+        }
+    }
+    return NULL;
+}
+
+const acpi_header_t* acpi_find_table(const char* signature) {
+    if (!g_Rsdt) return NULL;
+
+    const uint32_t* entries = (const uint32_t*)(g_Rsdt + 1);
+    int count = (g_Rsdt->length - sizeof(acpi_header_t)) / 4;
+    for (int i = 0; i < count; i++) {
+        const acpi_header_t* table = acpi_map_table(entries[i]);
+        if (table && memcmp(table->signature, signature, 4) == 0) return table;
+    }
+    return NULL;
+}
+
+static void acpi_parse_madt(const acpi_madt_t* madt) {
+    g_AcpiMadt.lapic_address = madt->lapic_address;
+    g_AcpiMadt.has_8259 = (madt->flags & MADT_PCAT_COMPAT) != 0;
+    g_AcpiMadt.cpu_count = 0;
+
+    const uint8_t* entry = (const uint8_t*)(madt + 1);
+    const uint8_t* end = (const uint8_t*)madt + madt->header.length;
+    while (entry + 2 <= end && entry[1] >= 2) {
+        switch (entry[0]) {
+            case MADT_LOCAL_APIC: {
+                // processor id, apic id, flags
+                uint32_t flags = *(const uint32_t*)(entry + 4);
+                if ((flags & MADT_LAPIC_ENABLED) && g_AcpiMadt.cpu_count < ACPI_MAX_CPUS) {
+                    g_AcpiMadt.cpu_apic_ids[g_AcpiMadt.cpu_count++] = entry[3];
+                }
+                break;
+            }
+            case MADT_IOAPIC:
+                if (g_AcpiMadt.ioapic_count < ACPI_MAX_IOAPICS) {
+                    acpi_ioapic_t* ioapic = &g_AcpiMadt.ioapics[g_AcpiMadt.ioapic_count++];
+                    ioapic->id = entry[2];
+                    ioapic->address = *(const uint32_t*)(entry + 4);
+                    ioapic->gsi_base = *(const uint32_t*)(entry + 8);
+                }
+                break;
+            case MADT_SOURCE_OVERRIDE: {
+                // bus (always ISA), source IRQ, GSI, flags
+                uint8_t irq = entry[3];
+                if (irq < 16) {
+                    g_AcpiMadt.isa_irqs[irq].gsi = *(const uint32_t*)(entry + 4);
+                    g_AcpiMadt.isa_irqs[irq].flags = *(const uint16_t*)(entry + 8);
+                }
+                break;
+            }
+        }
+        entry += entry[1];
+    }
+
+    if (g_AcpiMadt.cpu_count == 0) g_AcpiMadt.cpu_count = 1;
+}
+
+bool acpi_initialize() {
+    memset(&g_AcpiMadt, 0, sizeof(g_AcpiMadt));
+    g_AcpiMadt.cpu_count = 1;
+    g_AcpiMadt.has_8259 = true;
+    for (int irq = 0; irq < 16; irq++) g_AcpiMadt.isa_irqs[irq].gsi = irq;
+
+    // The RSDP is in the first KB of the EBDA or in the BIOS area
+    uint32_t ebda = (uint32_t)(*(volatile const uint16_t*)0x40E) << 4;
+    const acpi_rsdp_t* rsdp = ebda ? acpi_scan_rsdp(ebda, 1024) : NULL;
+    if (!rsdp) rsdp = acpi_scan_rsdp(0xE0000, 0x20000);
+    if (!rsdp) return false;
+
+    g_Rsdt = acpi_map_table(rsdp->rsdt_address);
+    if (!g_Rsdt) return false;
+
+    const acpi_madt_t* madt = (const acpi_madt_t*)acpi_find_table("APIC");
+    if (!madt) return false;
+    acpi_parse_madt(madt);
+
+    printf("ACPI: %d CPU(s), %d IOAPIC(s)\n", g_AcpiMadt.cpu_count, g_AcpiMadt.ioapic_count);
+    return true;
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include "stdint.h"
+#include "stdbool.h"
+
+#define ACPI_MAX_CPUS       16
+#define ACPI_MAX_IOAPICS    4
+
+// MPS INTI flags from interrupt source overrides
+#define ACPI_INTI_POLARITY_MASK     0x03
+#define ACPI_INTI_ACTIVE_LOW        0x03
+#define ACPI_INTI_TRIGGER_MASK      0x0C
+#define ACPI_INTI_LEVEL             0x0C
+
+typedef struct {
+    char signature[4];
+    uint32_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed)) acpi_header_t;
+
+typedef struct {
+    uint8_t id;
+    uint32_t address;
+    uint32_t gsi_base;
+} acpi_ioapic_t;
+
+// Where an ISA IRQ ends up on the IOAPICs. Identity unless the MADT overrides it.
+typedef struct {
+    uint32_t gsi;
+    uint16_t flags;
+} acpi_isa_irq_t;
+
+// What the MADT says about interrupt hardware
+typedef struct {
+    uint32_t lapic_address;
+    bool has_8259;
+    int cpu_count;
+    uint8_t cpu_apic_ids[ACPI_MAX_CPUS];    // enabled processors, boot CPU first
+    int ioapic_count;
+    acpi_ioapic_t ioapics[ACPI_MAX_IOAPICS];
+    acpi_isa_irq_t isa_irqs[16];
+} acpi_madt_info_t;
+
+extern acpi_madt_info_t g_AcpiMadt;
+
+// Finds the RSDP and parses the MADT. Returns false without ACPI or a MADT;
+// g_AcpiMadt then describes a single CPU with identity ISA routing.
+bool acpi_initialize();
+// Returns the table with this 4-character signature, or NULL
+const acpi_header_t* acpi_find_table(const char* signature);
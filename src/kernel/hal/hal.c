@@ -5,6 +5,11 @@
 #include <arch/i686/irq.h>
 #include <arch/i686/io.h>
 #include <arch/i686/paging.h>
+#include <arch/i686/cpu.h>
+#include <arch/i686/apic.h>
+#include <arch/i686/ioapic.h>
+#include <arch/i686/smp.h>
+#include "acpi.h"
 
 void i686_PIT_Initialize(uint32_t frequency) {
     uint32_t divisor = 1193182 / frequency;
@@ -32,19 +37,50 @@ void HAL_Speaker_Stop() {
     i686_outb(0x61, status);
 }
 
+// Hands the ISA IRQs to the I/O APICs the MADT lists. Without ACPI, an
+// APIC or an I/O APIC, everything stays on the 8259.
+static void HAL_InitializeInterruptRouting()
+{
+    if (!acpi_initialize() || !i686_APIC_IsEnabled()) return;
+
+    for (int i = 0; i < g_AcpiMadt.ioapic_count; i++) {
+        acpi_ioapic_t* ioapic = &g_AcpiMadt.ioapics[i];
+        i686_IOAPIC_Add(ioapic->id, ioapic->address, ioapic->gsi_base);
+    }
+
+    for (int irq = 0; irq < 16; irq++) {
+        acpi_isa_irq_t* route = &g_AcpiMadt.isa_irqs[irq];
+        i686_IRQ_SetIsaRoute(irq, route->gsi,
+                             (route->flags & ACPI_INTI_POLARITY_MASK) == ACPI_INTI_ACTIVE_LOW,
+                             (route->flags & ACPI_INTI_TRIGGER_MASK) == ACPI_INTI_LEVEL);
+    }
+
+    i686_IRQ_SwitchToIOAPIC();
+}
+
 void HAL_Initialize()
 {
+    i686_CPU_Initialize();
     i686_GDT_Initialize();
     i686_IDT_Initialize();
     i686_ISR_Initialize();
     i686_IRQ_Initialize();
 
     i686_Paging_Initialize();
+    i686_APIC_Initialize();
+    HAL_InitializeInterruptRouting();
 
-    // Set PIT to 100Hz to match TIMER_FREQUENCY_HZ in time.c
+    // Set PIT to 100Hz to match TIMER_FREQUENCY_HZ in time.c. Once time.c has
+    // calibrated the local APIC timer against it, the PIT's IRQ is masked.
     i686_PIT_Initialize(100);
 
     __asm__ volatile("sti"); // Enable interrupts only after all hardware tables are ready
 }
 
+uint32_t HAL_StartSecondaryCpus(void (*entry)())
+{
+    if (!g_AcpiMadt.cpu_count) return i686_SMP_CpuCount();
+    return i686_SMP_StartCpus(g_AcpiMadt.cpu_apic_ids, g_AcpiMadt.cpu_count, entry);
+}
+
 // Hardware Abstraction Layer
\ No newline at end of file
@@ -1,3 +1,9 @@
 #pragma once
+#include <stdint.h>
 
-void HAL_Initialize();
\ No newline at end of file
+void HAL_Initialize();
+
+// Starts the other processors the ACPI MADT lists. Each calls entry() with
+// interrupts off once its own CPU state is set up. Returns the number of
+// CPUs online; 1 without ACPI or a local APIC.
+uint32_t HAL_StartSecondaryCpus(void (*entry)());
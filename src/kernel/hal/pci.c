@@ -1,5 +1,7 @@
 #include "pci.h"
 #include <arch/i686/io.h>
+#include <arch/i686/apic.h>
+#include <arch/i686/paging.h>
 #include "stdio.h"
 
 extern void hda_init(pci_device_t* dev);
@@ -17,6 +19,103 @@ void pci_write_config(uint32_t bus, uint32_t slot, uint32_t func, uint32_t offse
     i686_outl(0xCFC, value);
 }
 
+// Messages to 0xFEExxxxx land in the local APIC named in bits 12-19
+#define PCI_MSI_ADDRESS         0xFEE00000
+#define PCI_MSI_64BIT           (1 << 7)
+#define PCI_MSI_MULTIPLE        (7 << 4)
+#define PCI_MSI_ENABLE          (1 << 0)
+#define PCI_MSIX_ENABLE         (1 << 15)
+#define PCI_MSIX_FUNCTION_MASK  (1 << 14)
+
+static uint32_t pci_dev_read(pci_device_t* dev, uint32_t offset) {
+    return pci_read_config(dev->bus, dev->device, dev->function, offset);
+}
+
+static void pci_dev_write(pci_device_t* dev, uint32_t offset, uint32_t value) {
+    pci_write_config(dev->bus, dev->device, dev->function, offset, value);
+}
+
+uint8_t pci_find_capability(pci_device_t* dev, uint8_t id) {
+    if (!(pci_dev_read(dev, PCI_COMMAND) & PCI_STATUS_CAP_LIST)) return 0;
+
+    uint8_t ptr = pci_dev_read(dev, PCI_CAP_POINTER) & 0xFC;
+    // A broken list could loop; there's only room for 48 entries anyway
+    for (int i = 0; ptr && i < 48; i++) {
+        uint32_t cap = pci_dev_read(dev, ptr);
+        if ((cap & 0xFF) == id) return ptr;
+        ptr = (cap >> 8) & 0xFC;
+    }
+    return 0;
+}
+
+bool pci_enable_msi(pci_device_t* dev, uint8_t vector, uint8_t apic_id) {
+    uint8_t cap = pci_find_capability(dev, PCI_CAP_MSI);
+    if (!cap) return false;
+
+    uint32_t header = pci_dev_read(dev, cap);
+    uint16_t control = header >> 16;
+
+    pci_dev_write(dev, cap + 4, PCI_MSI_ADDRESS | ((uint32_t)apic_id << 12));
+    uint8_t data = cap + 8;
+    if (control & PCI_MSI_64BIT) {
+        pci_dev_write(dev, cap + 8, 0);
+        data = cap + 12;
+    }
+    // Edge triggered, fixed delivery; the upper half may be extended data
+    pci_dev_write(dev, data, (pci_dev_read(dev, data) & 0xFFFF0000) | vector);
+
+    // One message only
+    control = (control & ~PCI_MSI_MULTIPLE) | PCI_MSI_ENABLE;
+    pci_dev_write(dev, cap, (header & 0xFFFF) | ((uint32_t)control << 16));
+    return true;
+}
+
+bool pci_enable_msix(pci_device_t* dev, uint8_t vector, uint8_t apic_id) {
+    uint8_t cap = pci_find_capability(dev, PCI_CAP_MSIX);
+    if (!cap) return false;
+
+    uint32_t header = pci_dev_read(dev, cap);
+    uint16_t control = header >> 16;
+
+    // The vector table lives in one of the memory BARs
+    uint32_t table = pci_dev_read(dev, cap + 4);
+    uint32_t bar = pci_dev_read(dev, 0x10 + (table & 0x7) * 4);
+    if (bar & 0x1) return false;
+    uint32_t phys = (bar & 0xFFFFFFF0) + (table & ~0x7);
+    if (phys < 0x1000) return false;
+
+    i686_Paging_Map_Range_Cached(phys & 0xFFFFF000, phys & 0xFFFFF000, 0x1000, PAGING_CACHE_UNCACHED);
+    volatile uint32_t* entry = (volatile uint32_t*)phys;
+
+    // Enable with the whole function masked, fill in entry 0, then unmask.
+    // The other entries stay masked as they come out of reset.
+    pci_dev_write(dev, cap, (header & 0xFFFF) | ((uint32_t)(control | PCI_MSIX_ENABLE | PCI_MSIX_FUNCTION_MASK) << 16));
+    entry[0] = PCI_MSI_ADDRESS | ((uint32_t)apic_id << 12);
+    entry[1] = 0;
+    entry[2] = vector;
+    entry[3] = 0;
+    control = (control | PCI_MSIX_ENABLE) & ~PCI_MSIX_FUNCTION_MASK;
+    pci_dev_write(dev, cap, (header & 0xFFFF) | ((uint32_t)control << 16));
+    return true;
+}
+
+int pci_setup_interrupt(pci_device_t* dev, IRQHandler handler) {
+    int vector = i686_IRQ_AllocateVector(handler);
+    if (vector < 0) return -1;
+
+    uint8_t apic_id = (uint8_t)i686_APIC_GetId();
+    if (!pci_enable_msix(dev, vector, apic_id) && !pci_enable_msi(dev, vector, apic_id)) {
+        i686_IRQ_FreeVector(vector);
+        return -1;
+    }
+
+    // Messages are memory writes, so the device must be a bus master.
+    // The status half of the dword is write-1-to-clear; don't touch it.
+    uint32_t command = pci_dev_read(dev, PCI_COMMAND) & 0xFFFF;
+    pci_dev_write(dev, PCI_COMMAND, command | PCI_COMMAND_BUS_MASTER | PCI_COMMAND_INTX_OFF);
+    return vector;
+}
+
 extern void ohci_init(pci_device_t* dev);
 extern void ehci_init(pci_device_t* dev);
 
@@ -1,5 +1,7 @@
 #pragma once
 #include "stdint.h"
+#include "stdbool.h"
+#include <arch/i686/irq.h>
 
 typedef struct {
     uint8_t bus;
@@ -15,4 +17,24 @@ typedef struct {
 uint32_t pci_read_config(uint32_t bus, uint32_t slot, uint32_t func, uint32_t offset);
 void pci_write_config(uint32_t bus, uint32_t slot, uint32_t func, uint32_t offset, uint32_t value);
 void pci_enumerate();
-void pci_init_device(pci_device_t* dev);
\ No newline at end of file
+void pci_init_device(pci_device_t* dev);
+
+#define PCI_COMMAND             0x04
+#define PCI_COMMAND_BUS_MASTER  (1 << 2)
+#define PCI_COMMAND_INTX_OFF    (1 << 10)
+#define PCI_STATUS_CAP_LIST     (1 << 20)   // in the dword at PCI_COMMAND
+#define PCI_CAP_POINTER         0x34
+
+#define PCI_CAP_MSI             0x05
+#define PCI_CAP_MSIX            0x11
+
+// Returns the config space offset of capability `id`, or 0 if the device lacks it
+uint8_t pci_find_capability(pci_device_t* dev, uint8_t id);
+// Points the device's MSI/MSI-X at `vector` on the local APIC `apic_id`
+bool pci_enable_msi(pci_device_t* dev, uint8_t vector, uint8_t apic_id);
+bool pci_enable_msix(pci_device_t* dev, uint8_t vector, uint8_t apic_id);
+
+// Gives the device its own vector, preferring MSI-X, and runs `handler` on it.
+// Legacy INTx lines are turned off. Returns the vector, or -1 if the device
+// can't signal messages (or the CPU can't receive them).
+int pci_setup_interrupt(pci_device_t* dev, IRQHandler handler);
\ No newline at end of file
@@ -1,7 +1,11 @@
 #include "heap.h"
 #include "memory.h"
+#include "vmm.h"
 #include "stdbool.h"
 #include "stdint.h"
+#include <sync/spinlock.h>
+#include <sync/ticketlock.h>
+#include <arch/i686/smp.h>
 
 // A simple linked-list based memory allocator
 
@@ -9,6 +13,7 @@ typedef struct block_header {
     size_t size;
     bool is_free;
     struct block_header* next;
+    void* caller;                   // Return address of whoever allocated the block
 } block_header_t;
 
 // The linker provides this symbol, which marks the end of the kernel's code/data.
@@ -20,6 +25,139 @@ static block_header_t* heap_start = NULL;
 // Define a fixed size for the heap (e.g., 256MB)
 #define HEAP_SIZE (1024 * 1024 * 128) // 12 MB - Keep below app load address (16MB) // Made bigger for WAV
 
+// --- Locking ---
+// g_HeapLock protects the block list. IRQ handlers may allocate, so it is
+// always taken with interrupts disabled, and it's a ticket lock so CPUs
+// refilling their magazines get it in arrival order. g_HeapStatsLock
+// protects the instrumentation below and is only ever held for a handful
+// of adds.
+static ticketlock_t g_HeapLock = TICKETLOCK_INIT_NAMED("heap");
+static spinlock_t g_HeapStatsLock = SPINLOCK_INIT_NAMED("heap-stats");
+
+// --- Magazines ---
+// Small allocations are rounded up to a size class and served from a
+// per-CPU stack of recently freed blocks. The fast path only disables
+// interrupts on the local CPU; the global lock is taken once per batch
+// when a magazine has to be refilled from, or flushed back to, the list.
+static const size_t g_MagazineClassSize[HEAP_MAGAZINE_CLASSES] = { 16, 32, 64, 128, 256 };
+
+typedef struct {
+    uint32_t count;
+    block_header_t* rounds[HEAP_MAGAZINE_ROUNDS];
+} heap_magazine_t;
+
+static heap_magazine_t g_Magazines[SMP_MAX_CPUS][HEAP_MAGAZINE_CLASSES];
+
+static inline uint32_t heap_cpu_id() {
+    return i686_SMP_CpuIndex();
+}
+
+static int heap_size_class(size_t size) {
+    for (int i = 0; i < HEAP_MAGAZINE_CLASSES; i++) {
+        if (size <= g_MagazineClassSize[i]) return i;
+    }
+    return -1;
+}
+
+// --- Instrumentation ---
+// Running counters are updated on every malloc/free so statistics are O(1).
+// The largest free block is refreshed by the coalescing walk and only
+// recomputed on demand after an allocation carves it up.
+static size_t g_HeapUsed = 0;           // payload bytes handed out to callers
+static size_t g_HeapPeakUsed = 0;
+static size_t g_HeapCached = 0;         // payload bytes parked in magazines
+static uint32_t g_HeapCachedBlocks = 0;
+static uint32_t g_HeapBlocks = 0;       // headers in the list (protected by g_HeapLock)
+static uint32_t g_HeapUsedBlocks = 0;
+static size_t g_HeapLargeUsed = 0;
+static uint32_t g_HeapLargeBlocks = 0;
+static uint32_t g_HeapAllocCount = 0;
+static uint32_t g_HeapFreeCount = 0;
+static uint32_t g_HeapFailCount = 0;
+static size_t g_HeapLargestFree = 0;
+static bool g_HeapLargestStale = false;
+static uint32_t g_HeapHistogram[HEAP_HISTOGRAM_BUCKETS];
+
+#if HEAP_TRACK_CALLERS
+static heap_callsite_t g_HeapCallsites[HEAP_CALLSITE_SLOTS];
+
+static heap_callsite_t* heap_callsite_lookup(void* caller, bool create) {
+    uint32_t idx = ((uintptr_t)caller >> 2) % HEAP_CALLSITE_SLOTS;
+    for (int probe = 0; probe < HEAP_CALLSITE_SLOTS; probe++) {
+        heap_callsite_t* site = &g_HeapCallsites[(idx + probe) % HEAP_CALLSITE_SLOTS];
+        if (site->caller == caller) return site;
+        if (site->caller == NULL) {
+            if (!create) return NULL;
+            site->caller = caller;
+            return site;
+        }
+    }
+    return NULL; // Table full, this call site goes untracked
+}
+#endif
+
+static int heap_histogram_bucket(size_t size) {
+    // Bucket 0 holds sizes <= 16, each following bucket doubles, the last is open-ended
+    int bucket = 0;
+    size_t limit = 16;
+    while (size > limit && bucket < HEAP_HISTOGRAM_BUCKETS - 1) {
+        limit <<= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+static void heap_account_alloc(block_header_t* block, void* caller, bool large) {
+    uint32_t flags = spin_lock_irqsave(&g_HeapStatsLock);
+
+    if (large) {
+        g_HeapLargeUsed += block->size;
+        g_HeapLargeBlocks++;
+    } else {
+        g_HeapUsed += block->size;
+        g_HeapUsedBlocks++;
+        if (g_HeapUsed > g_HeapPeakUsed) g_HeapPeakUsed = g_HeapUsed;
+    }
+    g_HeapAllocCount++;
+    g_HeapHistogram[heap_histogram_bucket(block->size)]++;
+
+    block->caller = caller;
+#if HEAP_TRACK_CALLERS
+    heap_callsite_t* site = heap_callsite_lookup(caller, true);
+    if (site) {
+        site->live_bytes += block->size;
+        site->live_blocks++;
+        site->total_allocs++;
+        site->total_bytes += block->size;
+    }
+#endif
+
+    spin_unlock_irqrestore(&g_HeapStatsLock, flags);
+}
+
+static void heap_account_free(block_header_t* block, bool large) {
+    uint32_t flags = spin_lock_irqsave(&g_HeapStatsLock);
+
+    if (large) {
+        g_HeapLargeUsed -= block->size;
+        g_HeapLargeBlocks--;
+    } else {
+        g_HeapUsed -= block->size;
+        g_HeapUsedBlocks--;
+    }
+    g_HeapFreeCount++;
+
+#if HEAP_TRACK_CALLERS
+    heap_callsite_t* site = heap_callsite_lookup(block->caller, false);
+    if (site) {
+        site->live_bytes -= block->size;
+        site->live_blocks--;
+    }
+#endif
+
+    spin_unlock_irqrestore(&g_HeapStatsLock, flags);
+}
+
 void heap_initialize() {
     // The heap starts right after the kernel's end address.
     // Align to 16 bytes to ensure proper alignment for larger types
@@ -33,17 +171,24 @@ void heap_initialize() {
     heap_start->size = HEAP_SIZE - sizeof(block_header_t);
     heap_start->is_free = true;
     heap_start->next = NULL;
-}
+    heap_start->caller = NULL;
 
-void* malloc(size_t size) {
-    if (size == 0) {
-        return NULL;
-    }
+    g_HeapBlocks = 1;
+    g_HeapLargestFree = heap_start->size;
 
+    vmm_initialize();
+}
+
+// First-fit search of the block list. Caller must hold g_HeapLock.
+static block_header_t* heap_carve_locked(size_t size) {
     block_header_t* current = heap_start;
     while (current) {
         // Find the first block that is free and large enough
         if (current->is_free && current->size >= size) {
+            if (current->size == g_HeapLargestFree) {
+                g_HeapLargestStale = true;
+            }
+
             // Is the block large enough to be split?
             if (current->size > size + sizeof(block_header_t)) {
                 // Create a new header for the remaining part of the block
@@ -51,15 +196,16 @@ void* malloc(size_t size) {
                 new_block->size = current->size - size - sizeof(block_header_t);
                 new_block->is_free = true;
                 new_block->next = current->next;
+                new_block->caller = NULL;
 
                 // Update the current block
                 current->size = size;
                 current->next = new_block;
+                g_HeapBlocks++;
             }
 
             current->is_free = false;
-            // Return a pointer to the memory region *after* the header
-            return (void*)((uint8_t*)current + sizeof(block_header_t));
+            return current;
         }
         current = current->next;
     }
@@ -68,6 +214,132 @@ void* malloc(size_t size) {
     return NULL;
 }
 
+// Merges neighbouring free blocks. Caller must hold g_HeapLock.
+// We walk the whole list anyway, so refresh the largest free block too.
+static void heap_coalesce_locked() {
+    size_t largest = 0;
+    block_header_t* current = heap_start;
+    while (current) {
+        if (current->next && current->is_free && current->next->is_free) {
+            // Merge current block with the next one
+            current->size += sizeof(block_header_t) + current->next->size;
+            current->next = current->next->next;
+            g_HeapBlocks--;
+            // After merging, we stay at `current` to check if the new `current->next` can also be merged
+        } else {
+            // Otherwise, move to the next block
+            if (current->is_free && current->size > largest) largest = current->size;
+            current = current->next;
+        }
+    }
+    g_HeapLargestFree = largest;
+    g_HeapLargestStale = false;
+}
+
+// Takes blocks from the global list to fill the local magazine halfway.
+// Runs with interrupts already disabled by the caller.
+static void heap_magazine_refill(heap_magazine_t* mag, size_t class_size) {
+    uint32_t added = 0;
+
+    ticket_lock(&g_HeapLock);
+    while (mag->count < HEAP_MAGAZINE_ROUNDS / 2) {
+        block_header_t* block = heap_carve_locked(class_size);
+        if (!block) break;
+        if (block->size != class_size) {
+            // Too small to split, and free() would never take it back into
+            // a magazine. Leave it for heap_alloc's direct carve.
+            block->is_free = true;
+            break;
+        }
+        mag->rounds[mag->count++] = block;
+        added++;
+    }
+    ticket_unlock(&g_HeapLock);
+
+    uint32_t flags = spin_lock_irqsave(&g_HeapStatsLock);
+    g_HeapCached += added * class_size;
+    g_HeapCachedBlocks += added;
+    spin_unlock_irqrestore(&g_HeapStatsLock, flags);
+}
+
+// Returns half of a full magazine to the global list with a single coalescing pass.
+static void heap_magazine_flush(heap_magazine_t* mag, size_t class_size) {
+    uint32_t released = 0;
+
+    ticket_lock(&g_HeapLock);
+    while (mag->count > HEAP_MAGAZINE_ROUNDS / 2) {
+        mag->rounds[--mag->count]->is_free = true;
+        released++;
+    }
+    heap_coalesce_locked();
+    ticket_unlock(&g_HeapLock);
+
+    uint32_t flags = spin_lock_irqsave(&g_HeapStatsLock);
+    g_HeapCached -= released * class_size;
+    g_HeapCachedBlocks -= released;
+    spin_unlock_irqrestore(&g_HeapStatsLock, flags);
+}
+
+static void* heap_alloc(size_t size, void* caller) {
+    if (size == 0) {
+        return NULL;
+    }
+
+    block_header_t* block = NULL;
+    int cls = heap_size_class(size);
+
+    if (size > HEAP_LARGE_THRESHOLD) {
+        // Large buffers get their own pages so they never fragment the list.
+        // The header stays in front of the payload so free/realloc work unchanged.
+        block = (block_header_t*)vmm_alloc(sizeof(block_header_t) + size);
+        if (block) {
+            block->size = size;
+            block->is_free = false;
+            block->next = NULL;
+            heap_account_alloc(block, caller, true);
+            return (void*)((uint8_t*)block + sizeof(block_header_t));
+        }
+        // Page pool exhausted, fall back to the list
+    }
+
+    if (cls >= 0) {
+        size_t class_size = g_MagazineClassSize[cls];
+        uint32_t flags = irq_save();
+        heap_magazine_t* mag = &g_Magazines[heap_cpu_id()][cls];
+        if (mag->count == 0) {
+            heap_magazine_refill(mag, class_size);
+        }
+        if (mag->count > 0) {
+            block = mag->rounds[--mag->count];
+            spin_lock(&g_HeapStatsLock);
+            g_HeapCached -= class_size;
+            g_HeapCachedBlocks--;
+            spin_unlock(&g_HeapStatsLock);
+        }
+        irq_restore(flags);
+    }
+
+    if (!block) {
+        // Not a size class, or the magazine couldn't be refilled
+        uint32_t flags = ticket_lock_irqsave(&g_HeapLock);
+        block = heap_carve_locked(size);
+        ticket_unlock_irqrestore(&g_HeapLock, flags);
+    }
+
+    if (!block) {
+        __sync_fetch_and_add(&g_HeapFailCount, 1);
+        return NULL;
+    }
+
+    heap_account_alloc(block, caller, false);
+    // Return a pointer to the memory region *after* the header
+    return (void*)((uint8_t*)block + sizeof(block_header_t));
+}
+
+void* malloc(size_t size) {
+    return heap_alloc(size, __builtin_return_address(0));
+}
+
 void* malloc_aligned(size_t size, size_t alignment) {
     if (size == 0) return NULL;
     if (alignment == 0) return malloc(size);
@@ -77,10 +349,10 @@ void* malloc_aligned(size_t size, size_t alignment) {
 
     // Total size: requested + alignment padding + space for pointer storage
     size_t total_size = size + alignment + sizeof(void*);
-    void* raw_ptr = malloc(total_size);
+    void* raw_ptr = heap_alloc(total_size, __builtin_return_address(0));
     if (!raw_ptr) return NULL;
 
-    // Calculate the aligned address. 
+    // Calculate the aligned address.
     // We leave space for the pointer by adding sizeof(void*)
     uintptr_t raw_addr = (uintptr_t)raw_ptr;
     uintptr_t aligned_addr = (raw_addr + sizeof(void*) + (alignment - 1)) & ~(alignment - 1);
@@ -106,27 +378,42 @@ void free(void* ptr) {
 
     // Get the block header from the pointer
     block_header_t* header = (block_header_t*)((uint8_t*)ptr - sizeof(block_header_t));
-    header->is_free = true;
 
-    // Coalesce adjacent free blocks to prevent fragmentation
-    block_header_t* current = heap_start;
-    while (current && current->next) {
-        if (current->is_free && current->next->is_free) {
-            // Merge current block with the next one
-            current->size += sizeof(block_header_t) + current->next->size;
-            current->next = current->next->next;
-            // After merging, we stay at `current` to check if the new `current->next` can also be merged
-        } else {
-            // Otherwise, move to the next block
-            current = current->next;
+    if (vmm_owns(header)) {
+        heap_account_free(header, true);
+        vmm_free(header, sizeof(block_header_t) + header->size);
+        return;
+    }
+
+    heap_account_free(header, false);
+
+    // Blocks that exactly match a size class go back to the local magazine
+    int cls = heap_size_class(header->size);
+    if (cls >= 0 && g_MagazineClassSize[cls] == header->size) {
+        uint32_t flags = irq_save();
+        heap_magazine_t* mag = &g_Magazines[heap_cpu_id()][cls];
+        if (mag->count == HEAP_MAGAZINE_ROUNDS) {
+            heap_magazine_flush(mag, header->size);
         }
+        mag->rounds[mag->count++] = header;
+        spin_lock(&g_HeapStatsLock);
+        g_HeapCached += header->size;
+        g_HeapCachedBlocks++;
+        spin_unlock(&g_HeapStatsLock);
+        irq_restore(flags);
+        return;
     }
+
+    uint32_t flags = ticket_lock_irqsave(&g_HeapLock);
+    header->is_free = true;
+    heap_coalesce_locked();
+    ticket_unlock_irqrestore(&g_HeapLock, flags);
 }
 
 void* realloc(void* ptr, size_t new_size) {
     if (!ptr) {
         // If ptr is NULL, realloc is equivalent to malloc
-        return malloc(new_size);
+        return heap_alloc(new_size, __builtin_return_address(0));
     }
 
     if (new_size == 0) {
@@ -137,7 +424,7 @@ void* realloc(void* ptr, size_t new_size) {
 
     // Get the header of the old block
     block_header_t* header = (block_header_t*)((uint8_t*)ptr - sizeof(block_header_t));
-    
+
     // If the new size is smaller or equal, we can just return the same pointer for now.
     // A more advanced implementation would shrink the block.
     if (new_size <= header->size) {
@@ -145,7 +432,7 @@ void* realloc(void* ptr, size_t new_size) {
     }
 
     // Allocate a new, larger block
-    void* new_ptr = malloc(new_size);
+    void* new_ptr = heap_alloc(new_size, __builtin_return_address(0));
     if (!new_ptr) {
         // Allocation failed, original block is untouched as per realloc spec
         return NULL;
@@ -155,18 +442,70 @@ void* realloc(void* ptr, size_t new_size) {
     return new_ptr;
 }
 
+// Bytes available to callers: list free space plus blocks parked in magazines
+static size_t heap_free_bytes() {
+    return HEAP_SIZE - g_HeapUsed - g_HeapBlocks * sizeof(block_header_t);
+}
+
 void heap_get_stats(size_t* total, size_t* used, size_t* free_mem) {
     *total = HEAP_SIZE;
-    *used = 0;
-    *free_mem = 0;
+    *used = g_HeapUsed;
+    *free_mem = heap_free_bytes();
+}
 
-    block_header_t* current = heap_start;
-    while (current) {
-        if (current->is_free) {
-            *free_mem += current->size;
-        } else {
-            *used += current->size;
+void heap_get_detailed_stats(heap_stats_t* stats) {
+    uint32_t flags = ticket_lock_irqsave(&g_HeapLock);
+    if (g_HeapLargestStale) {
+        size_t largest = 0;
+        for (block_header_t* current = heap_start; current; current = current->next) {
+            if (current->is_free && current->size > largest) largest = current->size;
         }
-        current = current->next;
+        g_HeapLargestFree = largest;
+        g_HeapLargestStale = false;
+    }
+    stats->largest_free = g_HeapLargestFree;
+    stats->free_blocks = g_HeapBlocks;
+    ticket_unlock_irqrestore(&g_HeapLock, flags);
+
+    flags = spin_lock_irqsave(&g_HeapStatsLock);
+    stats->total = HEAP_SIZE;
+    stats->used = g_HeapUsed;
+    stats->free = heap_free_bytes();
+    stats->cached = g_HeapCached;
+    stats->large_used = g_HeapLargeUsed;
+    stats->large_blocks = g_HeapLargeBlocks;
+    stats->peak_used = g_HeapPeakUsed;
+    stats->used_blocks = g_HeapUsedBlocks;
+    // Blocks parked in magazines are neither handed out nor free in the list
+    stats->free_blocks -= g_HeapUsedBlocks + g_HeapCachedBlocks;
+    stats->alloc_count = g_HeapAllocCount;
+    stats->free_count = g_HeapFreeCount;
+    stats->fail_count = g_HeapFailCount;
+    for (int i = 0; i < HEAP_HISTOGRAM_BUCKETS; i++) {
+        stats->histogram[i] = g_HeapHistogram[i];
     }
-}
\ No newline at end of file
+    spin_unlock_irqrestore(&g_HeapStatsLock, flags);
+
+    vmm_get_stats(&stats->frames_used, &stats->frames_total);
+
+    // 0 = all free memory is one block, 1000 = free memory is scattered in tiny pieces
+    stats->fragmentation_permille = stats->free
+        ? (uint32_t)(1000 - ((uint64_t)stats->largest_free * 1000) / stats->free)
+        : 0;
+}
+
+int heap_get_callsites(heap_callsite_t* out, int max) {
+#if HEAP_TRACK_CALLERS
+    int count = 0;
+    uint32_t flags = spin_lock_irqsave(&g_HeapStatsLock);
+    for (int i = 0; i < HEAP_CALLSITE_SLOTS && count < max; i++) {
+        if (g_HeapCallsites[i].caller) {
+            out[count++] = g_HeapCallsites[i];
+        }
+    }
+    spin_unlock_irqrestore(&g_HeapStatsLock, flags);
+    return count;
+#else
+    return 0;
+#endif
+}
@@ -3,5 +3,52 @@
 #include <stdint.h>
 #include <stddef.h>
 
+// Tag every allocation with the caller's return address for `heapstat`
+#ifndef HEAP_TRACK_CALLERS
+#define HEAP_TRACK_CALLERS 1
+#endif
+
+#define HEAP_CALLSITE_SLOTS     128
+#define HEAP_HISTOGRAM_BUCKETS  14  // <=16, <=32, ... <=64K, larger
+
+// Allocations above this size get their own freshly mapped pages (see vmm.h)
+#define HEAP_LARGE_THRESHOLD    (64 * 1024)
+
+// Per-CPU caches of recently freed small blocks (16..256 bytes)
+#define HEAP_MAGAZINE_CLASSES   5
+#define HEAP_MAGAZINE_ROUNDS    32
+
+typedef struct {
+    size_t total;
+    size_t used;
+    size_t free;
+    size_t cached;              // part of `free` parked in per-CPU magazines
+    size_t large_used;          // bytes in page-mapped large allocations
+    uint32_t large_blocks;
+    uint32_t frames_used;       // frames taken from the large-allocation pool
+    uint32_t frames_total;
+    size_t peak_used;
+    size_t largest_free;
+    uint32_t used_blocks;
+    uint32_t free_blocks;
+    uint32_t alloc_count;
+    uint32_t free_count;
+    uint32_t fail_count;
+    uint32_t fragmentation_permille;
+    uint32_t histogram[HEAP_HISTOGRAM_BUCKETS];
+} heap_stats_t;
+
+typedef struct {
+    void* caller;
+    size_t live_bytes;
+    uint32_t live_blocks;
+    uint32_t total_allocs;
+    uint64_t total_bytes;
+} heap_callsite_t;
+
 void heap_initialize();
-void heap_get_stats(size_t* total, size_t* used, size_t* free);
\ No newline at end of file
+void heap_get_stats(size_t* total, size_t* used, size_t* free);
+void heap_get_detailed_stats(heap_stats_t* stats);
+
+// Copies up to `max` tracked call sites into `out`, returns how many were copied.
+int heap_get_callsites(heap_callsite_t* out, int max);
\ No newline at end of file
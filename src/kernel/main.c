@@ -19,6 +19,9 @@
 #include "graphics.h"
 #include <apps/imageview/bmp.h>
 #include "time.h" // Include the new time.h header
+#include "timer.h"
+#include "deferred.h"
+#include <sched/thread.h>
 #include <misc/noCrash.h>
 
 
@@ -44,6 +47,7 @@ extern uint8_t __end;
 void timer(Registers* regs)
 {
     g_ticks++;
+    timer_interrupt();
 }
 
 #define HISTORY_SIZE 10 // Define the size of the command history
@@ -134,15 +138,24 @@ void __attribute__((section(".entry"))) start(VbeScreenInfo* vbe_info, uint16_t
     g_vbe_screen = &s_vbe_screen;
 
     HAL_Initialize();
+    memory_initialize();
+    graphics_initialize();
     heap_initialize();
     //init_tests(); 
     console_initialize();
     syscall_initialize();
+    deferred_initialize();
+    // The PIT tick is registered first; time_initialize masks it again
+    // once the local APIC timer takes over
+    i686_IRQ_RegisterHandler(0, timer);
     time_initialize();
+    timer_initialize();
+    thread_initialize();
+    // The other CPUs join the scheduler as soon as they're up
+    HAL_StartSecondaryCpus(thread_ap_main);
     pci_enumerate();
     
     // Init some shit
-    i686_IRQ_RegisterHandler(0, timer);
     i686_Keyboard_Initialize(g_CommandHistory, &g_HistoryCount, &g_HistoryIndex, HISTORY_SIZE);
     i686_EnableInterrupts();
 
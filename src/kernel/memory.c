@@ -1,12 +1,24 @@
 #include "memory.h"
 #include <stdint.h>
+#include <arch/i686/cpu.h>
 
-void* memcpy(void* dst, const void* src, size_t num)
+// Copies and fills at least this big bypass the cache with non-temporal
+// stores, so pushing a whole frame to VRAM doesn't evict everything else.
+#define MEMORY_NT_THRESHOLD (256 * 1024)
+
+// Below this the SSE setup (saving xmm registers, aligning) costs more than it saves
+#define MEMORY_SSE_MIN 128
+
+typedef uint32_t __attribute__((may_alias)) u32_alias_t;
+
+// --- Portable C versions (used as the benchmark baseline) ---
+
+static void* memcpy_c(void* dst, const void* src, size_t num)
 {
     // Optimization: Copy 4 bytes at a time if aligned
     if (((uint32_t)dst % 4 == 0) && ((uint32_t)src % 4 == 0) && (num % 4 == 0)) {
-        uint32_t* u32Dst = (uint32_t *)dst;
-        const uint32_t* u32Src = (const uint32_t *)src;
+        u32_alias_t* u32Dst = (u32_alias_t *)dst;
+        const u32_alias_t* u32Src = (const u32_alias_t *)src;
         size_t n = num / 4;
         for (size_t i = 0; i < n; i++)
             u32Dst[i] = u32Src[i];
@@ -22,7 +34,7 @@ void* memcpy(void* dst, const void* src, size_t num)
     return dst;
 }
 
-void * memset(void * ptr, int value, size_t num)
+static void* memset_c(void* ptr, int value, size_t num)
 {
     uint8_t* u8Ptr = (uint8_t*)ptr;
 
@@ -32,7 +44,7 @@ void * memset(void * ptr, int value, size_t num)
         v32 |= (v32 << 8);
         v32 |= (v32 << 16);
 
-        uint32_t* u32Ptr = (uint32_t*)ptr;
+        u32_alias_t* u32Ptr = (u32_alias_t*)ptr;
         size_t n32 = num / 4;
         for (size_t i = 0; i < n32; i++) {
             u32Ptr[i] = v32;
@@ -49,35 +61,343 @@ void * memset(void * ptr, int value, size_t num)
     return ptr;
 }
 
-int memcmp(const void* ptr1, const void* ptr2, size_t num)
+// --- String instructions, available on every i686 ---
+
+static void* memcpy_rep(void* dst, const void* src, size_t num)
+{
+    void* ret = dst;
+
+    // Align the destination, move dwords, then finish the odd tail bytes
+    size_t head = (-(uintptr_t)dst) & 3;
+    if (head > num) head = num;
+    num -= head;
+    size_t dwords = num / 4;
+    size_t tail = num % 4;
+
+    __asm__ volatile("rep movsb" : "+D"(dst), "+S"(src), "+c"(head) : : "memory");
+    __asm__ volatile("rep movsl" : "+D"(dst), "+S"(src), "+c"(dwords) : : "memory");
+    __asm__ volatile("rep movsb" : "+D"(dst), "+S"(src), "+c"(tail) : : "memory");
+    return ret;
+}
+
+static void* memset_rep(void* ptr, int value, size_t num)
+{
+    void* dst = ptr;
+    uint32_t v32 = (uint8_t)value * 0x01010101u;
+
+    size_t head = (-(uintptr_t)ptr) & 3;
+    if (head > num) head = num;
+    num -= head;
+    size_t dwords = num / 4;
+    size_t tail = num % 4;
+
+    __asm__ volatile("rep stosb" : "+D"(dst), "+c"(head) : "a"(v32) : "memory");
+    __asm__ volatile("rep stosl" : "+D"(dst), "+c"(dwords) : "a"(v32) : "memory");
+    __asm__ volatile("rep stosb" : "+D"(dst), "+c"(tail) : "a"(v32) : "memory");
+    return ptr;
+}
+
+// --- SSE2 ---
+// The kernel doesn't save xmm state on interrupts, so every SSE path spills
+// the registers it touches and puts them back (i686_SSE_Save/Restore). That
+// keeps these functions safe to call from IRQ handlers that interrupt
+// another SSE copy.
+
+static void* memcpy_sse2_core(void* dst, const void* src, size_t num, bool nontemporal)
 {
-    const uint8_t* u8Ptr1 = (const uint8_t *)ptr1;
-    const uint8_t* u8Ptr2 = (const uint8_t *)ptr2;
+    if (num < MEMORY_SSE_MIN) {
+        return memcpy_rep(dst, src, num);
+    }
+
+    uint8_t* d = (uint8_t*)dst;
+    const uint8_t* s = (const uint8_t*)src;
+
+    // Align the destination to 16 bytes so stores can use movdqa/movntdq
+    size_t head = (-(uintptr_t)d) & 15;
+    memcpy_rep(d, s, head);
+    d += head;
+    s += head;
+    num -= head;
+
+    size_t blocks = num / 64;
+    size_t tail = num % 64;
+    uint8_t saved[64];
+
+    i686_SSE_Save(saved);
+    if (nontemporal) {
+        __asm__ volatile(
+            "1:\n\t"
+            "prefetchnta 256(%1)\n\t"
+            "movdqu 0(%1), %%xmm0\n\t"
+            "movdqu 16(%1), %%xmm1\n\t"
+            "movdqu 32(%1), %%xmm2\n\t"
+            "movdqu 48(%1), %%xmm3\n\t"
+            "movntdq %%xmm0, 0(%0)\n\t"
+            "movntdq %%xmm1, 16(%0)\n\t"
+            "movntdq %%xmm2, 32(%0)\n\t"
+            "movntdq %%xmm3, 48(%0)\n\t"
+            "add $64, %1\n\t"
+            "add $64, %0\n\t"
+            "dec %2\n\t"
+            "jnz 1b\n\t"
+            "sfence\n\t"
+            : "+r"(d), "+r"(s), "+r"(blocks) : : "memory");
+    } else {
+        __asm__ volatile(
+            "1:\n\t"
+            "movdqu 0(%1), %%xmm0\n\t"
+            "movdqu 16(%1), %%xmm1\n\t"
+            "movdqu 32(%1), %%xmm2\n\t"
+            "movdqu 48(%1), %%xmm3\n\t"
+            "movdqa %%xmm0, 0(%0)\n\t"
+            "movdqa %%xmm1, 16(%0)\n\t"
+            "movdqa %%xmm2, 32(%0)\n\t"
+            "movdqa %%xmm3, 48(%0)\n\t"
+            "add $64, %1\n\t"
+            "add $64, %0\n\t"
+            "dec %2\n\t"
+            "jnz 1b\n\t"
+            : "+r"(d), "+r"(s), "+r"(blocks) : : "memory");
+    }
+    i686_SSE_Restore(saved);
+
+    memcpy_rep(d, s, tail);
+    return dst;
+}
+
+static void* memcpy_sse2(void* dst, const void* src, size_t num)
+{
+    return memcpy_sse2_core(dst, src, num, num >= MEMORY_NT_THRESHOLD);
+}
+
+static void* memcpy_sse2_nt(void* dst, const void* src, size_t num)
+{
+    return memcpy_sse2_core(dst, src, num, true);
+}
+
+// Fills `blocks` 64-byte blocks at 16-aligned `d` with the 32-bit pattern, returns the end
+static uint8_t* sse2_fill_blocks_core(uint8_t* d, uint32_t v32, size_t blocks, bool nontemporal)
+{
+    if (blocks == 0) return d;
+
+    uint8_t saved[64];
+
+    i686_SSE_Save(saved);
+    if (nontemporal) {
+        __asm__ volatile(
+            "movd %2, %%xmm0\n\t"
+            "pshufd $0, %%xmm0, %%xmm0\n\t"
+            "1:\n\t"
+            "movntdq %%xmm0, 0(%0)\n\t"
+            "movntdq %%xmm0, 16(%0)\n\t"
+            "movntdq %%xmm0, 32(%0)\n\t"
+            "movntdq %%xmm0, 48(%0)\n\t"
+            "add $64, %0\n\t"
+            "dec %1\n\t"
+            "jnz 1b\n\t"
+            "sfence\n\t"
+            : "+r"(d), "+r"(blocks) : "r"(v32) : "memory");
+    } else {
+        __asm__ volatile(
+            "movd %2, %%xmm0\n\t"
+            "pshufd $0, %%xmm0, %%xmm0\n\t"
+            "1:\n\t"
+            "movdqa %%xmm0, 0(%0)\n\t"
+            "movdqa %%xmm0, 16(%0)\n\t"
+            "movdqa %%xmm0, 32(%0)\n\t"
+            "movdqa %%xmm0, 48(%0)\n\t"
+            "add $64, %0\n\t"
+            "dec %1\n\t"
+            "jnz 1b\n\t"
+            : "+r"(d), "+r"(blocks) : "r"(v32) : "memory");
+    }
+    i686_SSE_Restore(saved);
+
+    return d;
+}
+
+// Large fills bypass the cache so they don't evict everything else
+static uint8_t* sse2_fill_blocks(uint8_t* d, uint32_t v32, size_t blocks)
+{
+    return sse2_fill_blocks_core(d, v32, blocks, blocks >= MEMORY_NT_THRESHOLD / 64);
+}
+
+static void* memset_sse2_core(void* ptr, int value, size_t num, bool nontemporal)
+{
+    if (num < MEMORY_SSE_MIN) {
+        return memset_rep(ptr, value, num);
+    }
+
+    uint8_t* d = (uint8_t*)ptr;
+    size_t head = (-(uintptr_t)d) & 15;
+    memset_rep(d, value, head);
+    d += head;
+    num -= head;
+
+    size_t blocks = num / 64;
+    d = sse2_fill_blocks_core(d, (uint8_t)value * 0x01010101u, blocks,
+                              nontemporal || blocks >= MEMORY_NT_THRESHOLD / 64);
+    memset_rep(d, value, num % 64);
+    return ptr;
+}
+
+static void* memset_sse2(void* ptr, int value, size_t num)
+{
+    return memset_sse2_core(ptr, value, num, false);
+}
+
+static void* memset_sse2_nt(void* ptr, int value, size_t num)
+{
+    return memset_sse2_core(ptr, value, num, true);
+}
+
+static inline uint32_t* stosl(uint32_t* dst, uint32_t value, size_t count)
+{
+    __asm__ volatile("rep stosl" : "+D"(dst), "+c"(count) : "a"(value) : "memory");
+    return dst;
+}
+
+static int memcmp_tail(const uint8_t* a, const uint8_t* b, size_t num)
+{
+    // Skip equal dwords quickly, then find the differing byte
+    while (num >= 4 && *(const u32_alias_t*)a == *(const u32_alias_t*)b) {
+        a += 4;
+        b += 4;
+        num -= 4;
+    }
 
     for (size_t i = 0; i < num; i++)
     {
-        if (u8Ptr1[i] != u8Ptr2[i])
-            return u8Ptr1[i] - u8Ptr2[i];
+        if (a[i] != b[i])
+            return a[i] - b[i];
     }
 
     return 0;
 }
 
-void* memmove(void* dst, const void* src, size_t num)
+static int memcmp_sse2(const uint8_t* a, const uint8_t* b, size_t num)
 {
-    uint8_t* u8Dst = (uint8_t*)dst;
-    const uint8_t* u8Src = (const uint8_t*)src;
+    size_t blocks = num / 16;
+    uint32_t mask = 0xFFFF;
+    uint8_t saved[64];
 
-    // If destination is before source, we can copy forwards
-    if (u8Dst < u8Src) {
-        for (size_t i = 0; i < num; i++) {
-            u8Dst[i] = u8Src[i];
-        }
-    } else { // Otherwise, we must copy backwards to avoid overwriting data
-        for (size_t i = num; i > 0; i--) {
-            u8Dst[i-1] = u8Src[i-1];
-        }
+    // Compare 16 bytes per step until a block differs, then let the scalar
+    // code pinpoint the byte
+    i686_SSE_Save(saved);
+    while (blocks) {
+        __asm__ volatile(
+            "movdqu (%1), %%xmm0\n\t"
+            "movdqu (%2), %%xmm1\n\t"
+            "pcmpeqb %%xmm1, %%xmm0\n\t"
+            "pmovmskb %%xmm0, %0\n\t"
+            : "=r"(mask) : "r"(a), "r"(b) : "memory");
+        if (mask != 0xFFFF) break;
+        a += 16;
+        b += 16;
+        num -= 16;
+        blocks--;
+    }
+    i686_SSE_Restore(saved);
+
+    return memcmp_tail(a, b, num);
+}
+
+// --- Dispatch ---
+// The pointers start out on the rep variants (valid on every i686, and kept in
+// .data so clearing BSS with memset works before memory_initialize runs).
+
+static const memory_impl_t g_MemoryImpls[] = {
+    { "c",       memcpy_c,       memset_c    },
+    { "rep",     memcpy_rep,     memset_rep  },
+    { "sse2",    memcpy_sse2,    memset_sse2 },
+    { "sse2-nt", memcpy_sse2_nt, memset_sse2_nt },
+};
+
+#define MEMORY_IMPL_REP  1
+#define MEMORY_IMPL_SSE2 2
+
+static const memory_impl_t* g_MemoryImpl = &g_MemoryImpls[MEMORY_IMPL_REP];
+static bool g_MemorySSE2 = false;
+
+void memory_initialize()
+{
+    g_MemorySSE2 = g_CpuInfo.sse_enabled && i686_CPU_HasFeature(CPUID_EDX_SSE2);
+    g_MemoryImpl = &g_MemoryImpls[g_MemorySSE2 ? MEMORY_IMPL_SSE2 : MEMORY_IMPL_REP];
+}
+
+int memory_get_impls(const memory_impl_t** impls)
+{
+    *impls = g_MemoryImpls;
+    return g_MemorySSE2 ? 4 : 2;
+}
+
+const char* memory_active_impl()
+{
+    return g_MemoryImpl->name;
+}
+
+void* memcpy(void* dst, const void* src, size_t num)
+{
+    return g_MemoryImpl->copy(dst, src, num);
+}
+
+void* memset(void* ptr, int value, size_t num)
+{
+    return g_MemoryImpl->set(ptr, value, num);
+}
+
+int memcmp(const void* ptr1, const void* ptr2, size_t num)
+{
+    if (g_MemorySSE2 && num >= MEMORY_SSE_MIN) {
+        return memcmp_sse2((const uint8_t*)ptr1, (const uint8_t*)ptr2, num);
     }
+    return memcmp_tail((const uint8_t*)ptr1, (const uint8_t*)ptr2, num);
+}
+
+void* memset32(void* ptr, uint32_t value, size_t count)
+{
+    uint32_t* d = (uint32_t*)ptr;
+
+    // The SSE path needs whole pixels on the way to 16-byte alignment
+    if (!g_MemorySSE2 || count * 4 < MEMORY_SSE_MIN || ((uintptr_t)d & 3)) {
+        stosl(d, value, count);
+        return ptr;
+    }
+
+    size_t head = ((-(uintptr_t)d) & 15) / 4;
+    d = stosl(d, value, head);
+    count -= head;
+
+    d = (uint32_t*)sse2_fill_blocks((uint8_t*)d, value, count / 16);
+    stosl(d, value, count % 16);
+    return ptr;
+}
+
+void* memmove(void* dst, const void* src, size_t num)
+{
+    // Forward copies are safe when dst is below src or the ranges don't overlap.
+    // Every copy variant loads each chunk before storing it, front to back.
+    if ((uintptr_t)dst - (uintptr_t)src >= num) {
+        return memcpy(dst, src, num);
+    }
+
+    // Otherwise copy backwards: odd tail bytes first, then dwords, with DF set
+    uint8_t* d = (uint8_t*)dst + num - 1;
+    const uint8_t* s = (const uint8_t*)src + num - 1;
+    size_t tail = num % 4;
+    size_t dwords = num / 4;
+
+    __asm__ volatile(
+        "std\n\t"
+        "rep movsb\n\t"
+        "sub $3, %%esi\n\t"
+        "sub $3, %%edi\n\t"
+        "mov %3, %%ecx\n\t"
+        "rep movsl\n\t"
+        "cld\n\t"
+        : "+D"(d), "+S"(s), "+c"(tail)
+        : "r"(dwords)
+        : "memory");
 
     return dst;
-}
\ No newline at end of file
+}
@@ -1,11 +1,27 @@
 #pragma once
 #include <stdint.h>
 #include <stddef.h>
+#include "stdbool.h"
 
 void* memcpy(void* dst, const void* src, size_t num);
 void* memset(void* ptr, int value, size_t num);
 int memcmp(const void* ptr1, const void* ptr2, size_t num);
 void* memmove(void* dst, const void* src, size_t num);
+// Fills `count` 32-bit words (pixels) with `value`
+void* memset32(void* ptr, uint32_t value, size_t count);
+
+// memcpy/memset are dispatched to the fastest variant the CPU supports
+typedef struct {
+    const char* name;
+    void* (*copy)(void* dst, const void* src, size_t num);
+    void* (*set)(void* ptr, int value, size_t num);
+} memory_impl_t;
+
+// Picks the variants; call once after i686_CPU_Initialize()
+void memory_initialize();
+// Exposes every variant usable on this CPU (for membench), returns the count
+int memory_get_impls(const memory_impl_t** impls);
+const char* memory_active_impl();
 
 // Allocation functions (Defined in heap.c)
 void* malloc(size_t size);
@@ -2,7 +2,15 @@
 #include "stdio.h"
 #include "graphics.h"
 #include "time.h"
+#include "timer.h"
 #include "vbe.h"
+#include <arch/i686/keyboard.h>
+
+#define PIXEL_LOOP_PERIOD_NS 50000000
+
+// Bumped by every start and stop; a tick left over from an earlier run
+// sees a different number and doesn't re-arm
+static volatile uint32_t g_PixelLoopGeneration = 0;
 
 void init_tests() {
     // No longer blocks initialization
@@ -10,27 +18,40 @@ void init_tests() {
 }
 
 void pixelLoop() {
-    static uint32_t last_tick = 0;
     if (!g_vbe_screen) return;
 
-    // Check if 50ms has passed since the last successful run
-    if (time_is_periodic(&last_tick, 50))
-    {
-        // Use coordinates relative to the screen edge (bottom right)
-        int base_x = g_vbe_screen->width - 20;
-        int base_y = g_vbe_screen->height - 20;
-
-        // Simple toggle animation based on current uptime
-        uint32_t phase = (get_uptime_ms() / 100) % 4;
-
-        // Use RGB Hex literals instead of VGA indices
-        // 0xFFFFFF = White, 0x555555 = Dark Gray
-        uint32_t active_color = 0xFFFFFF;
-        uint32_t idle_color   = 0x555555;
-
-        draw_pixel(base_x,     base_y,     (phase == 0) ? active_color : idle_color);
-        draw_pixel(base_x + 5, base_y,     (phase == 1) ? active_color : idle_color);
-        draw_pixel(base_x + 5, base_y + 5, (phase == 2) ? active_color : idle_color);
-        draw_pixel(base_x,     base_y + 5, (phase == 3) ? active_color : idle_color);
-    }
-}
\ No newline at end of file
+    // Use coordinates relative to the screen edge (bottom right)
+    int base_x = g_vbe_screen->width - 20;
+    int base_y = g_vbe_screen->height - 20;
+
+    // Simple toggle animation based on current uptime
+    uint32_t phase = (get_uptime_ms() / 100) % 4;
+
+    // Use RGB Hex literals instead of VGA indices
+    // 0xFFFFFF = White, 0x555555 = Dark Gray
+    uint32_t active_color = 0xFFFFFF;
+    uint32_t idle_color   = 0x555555;
+
+    draw_pixel(base_x,     base_y,     (phase == 0) ? active_color : idle_color);
+    draw_pixel(base_x + 5, base_y,     (phase == 1) ? active_color : idle_color);
+    draw_pixel(base_x + 5, base_y + 5, (phase == 2) ? active_color : idle_color);
+    draw_pixel(base_x,     base_y + 5, (phase == 3) ? active_color : idle_color);
+}
+
+// Timer callback (deferred context). Drawing from here would race the
+// console, so it only wakes gets(), which draws the frame itself.
+static void pixelLoop_tick(void* arg) {
+    if ((uint32_t)(uintptr_t)arg != g_PixelLoopGeneration) return;
+
+    keyboard_poke();
+    timer_add(time_now_ns() + PIXEL_LOOP_PERIOD_NS, pixelLoop_tick, arg);
+}
+
+void pixelLoop_start() {
+    uint32_t generation = ++g_PixelLoopGeneration;
+    timer_add(time_now_ns(), pixelLoop_tick, (void*)(uintptr_t)generation);
+}
+
+void pixelLoop_stop() {
+    g_PixelLoopGeneration++;
+}
@@ -2,4 +2,9 @@
 #include "graphics.h"
 
 void init_tests();
-void pixelLoop();
\ No newline at end of file
+// Draws one frame of the corner activity indicator
+void pixelLoop();
+// Pokes gets() every 50 ms from a kernel timer until stopped, so it
+// redraws the indicator
+void pixelLoop_start();
+void pixelLoop_stop();
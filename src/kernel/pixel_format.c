@@ -0,0 +1,259 @@
+#include "pixel_format.h"
+#include "memory.h"
+#include <arch/i686/cpu.h>
+
+static pixel_format_t g_Format;
+
+// --- Packing ---
+
+static uint32_t pack_xrgb8888(const pixel_format_t* fmt, uint32_t rgb)
+{
+    return rgb & 0x00FFFFFF;
+}
+
+static uint32_t pack_rgb565(const pixel_format_t* fmt, uint32_t rgb)
+{
+    return ((rgb >> 8) & 0xF800) | ((rgb >> 5) & 0x07E0) | ((rgb >> 3) & 0x001F);
+}
+
+static uint32_t pack_xrgb1555(const pixel_format_t* fmt, uint32_t rgb)
+{
+    return ((rgb >> 9) & 0x7C00) | ((rgb >> 6) & 0x03E0) | ((rgb >> 3) & 0x001F);
+}
+
+// Any layout the mask sizes and positions describe
+static uint32_t pack_generic(const pixel_format_t* fmt, uint32_t rgb)
+{
+    uint32_t r = (rgb >> 16) & 0xFF;
+    uint32_t g = (rgb >> 8) & 0xFF;
+    uint32_t b = rgb & 0xFF;
+    return ((r >> (8 - fmt->red_size)) << fmt->red_shift) |
+           ((g >> (8 - fmt->green_size)) << fmt->green_shift) |
+           ((b >> (8 - fmt->blue_size)) << fmt->blue_shift);
+}
+
+// --- Fills ---
+// These only depend on the pixel size; the colour goes through fmt->pack.
+
+static void fill_32(const pixel_format_t* fmt, void* dst, uint32_t rgb, int count)
+{
+    memset32(dst, fmt->pack(fmt, rgb), count);
+}
+
+static void fill_24(const pixel_format_t* fmt, void* dst, uint32_t rgb, int count)
+{
+    uint32_t v = fmt->pack(fmt, rgb);
+    uint8_t* d = (uint8_t*)dst;
+
+    // Four pixels are exactly three dwords
+    uint32_t d0 = (v & 0xFFFFFF) | (v << 24);
+    uint32_t d1 = ((v >> 8) & 0xFFFF) | (v << 16);
+    uint32_t d2 = ((v >> 16) & 0xFF) | (v << 8);
+    for (; count >= 4; count -= 4) {
+        ((uint32_t*)d)[0] = d0;
+        ((uint32_t*)d)[1] = d1;
+        ((uint32_t*)d)[2] = d2;
+        d += 12;
+    }
+    while (count--) {
+        d[0] = v;
+        d[1] = v >> 8;
+        d[2] = v >> 16;
+        d += 3;
+    }
+}
+
+static void fill_16(const pixel_format_t* fmt, void* dst, uint32_t rgb, int count)
+{
+    uint16_t v = fmt->pack(fmt, rgb);
+    uint16_t* d = (uint16_t*)dst;
+
+    if (count > 0 && ((uintptr_t)d & 2)) {
+        *d++ = v;
+        count--;
+    }
+    memset32(d, v | ((uint32_t)v << 16), count / 2);
+    if (count & 1) d[count - 1] = v;
+}
+
+// --- Conversion ---
+
+static void convert_copy32(const pixel_format_t* fmt, void* dst, const uint32_t* src, int count)
+{
+    memcpy(dst, src, count * 4);
+}
+
+static void convert_rgb888(const pixel_format_t* fmt, void* dst, const uint32_t* src, int count)
+{
+    uint8_t* d = (uint8_t*)dst;
+
+    // Drop the top byte of four pixels and store them as three dwords
+    for (; count >= 4; count -= 4) {
+        uint32_t p0 = src[0], p1 = src[1], p2 = src[2], p3 = src[3];
+        ((uint32_t*)d)[0] = (p0 & 0xFFFFFF) | (p1 << 24);
+        ((uint32_t*)d)[1] = ((p1 >> 8) & 0xFFFF) | (p2 << 16);
+        ((uint32_t*)d)[2] = ((p2 >> 16) & 0xFF) | (p3 << 8);
+        src += 4;
+        d += 12;
+    }
+    while (count--) {
+        uint32_t p = *src++;
+        d[0] = p;
+        d[1] = p >> 8;
+        d[2] = p >> 16;
+        d += 3;
+    }
+}
+
+static void convert_rgb565(const pixel_format_t* fmt, void* dst, const uint32_t* src, int count)
+{
+    uint16_t* d = (uint16_t*)dst;
+    for (int i = 0; i < count; i++) d[i] = pack_rgb565(fmt, src[i]);
+}
+
+static void convert_xrgb1555(const pixel_format_t* fmt, void* dst, const uint32_t* src, int count)
+{
+    uint16_t* d = (uint16_t*)dst;
+    for (int i = 0; i < count; i++) d[i] = pack_xrgb1555(fmt, src[i]);
+}
+
+static void convert_generic(const pixel_format_t* fmt, void* dst, const uint32_t* src, int count)
+{
+    uint8_t* d = (uint8_t*)dst;
+    for (int i = 0; i < count; i++) {
+        uint32_t v = pack_generic(fmt, src[i]);
+        for (int b = 0; b < fmt->bytes; b++) *d++ = v >> (8 * b);
+    }
+}
+
+// 16-bit conversion, eight pixels per iteration. Each channel is shifted
+// into place and masked in 32-bit lanes; the lanes are then sign-extended
+// from 16 bits so packssdw narrows them without saturating.
+#define CONVERT16_SSE2_LANES(reg)                       \
+    "movdqa %%" reg ", %%xmm2\n\t"                      \
+    "psrld %[rs], %%xmm2\n\t"                           \
+    "pand 0(%[m]), %%xmm2\n\t"                          \
+    "movdqa %%" reg ", %%xmm3\n\t"                      \
+    "psrld %[gs], %%xmm3\n\t"                           \
+    "pand 16(%[m]), %%xmm3\n\t"                         \
+    "por %%xmm3, %%xmm2\n\t"                            \
+    "psrld $3, %%" reg "\n\t"                           \
+    "pand 32(%[m]), %%" reg "\n\t"                      \
+    "por %%xmm2, %%" reg "\n\t"                         \
+    "pslld $16, %%" reg "\n\t"                          \
+    "psrad $16, %%" reg "\n\t"
+
+#define DEFINE_CONVERT16_SSE2(name, scalar, red_shift, green_shift, red_mask, green_mask)      \
+    static const uint32_t name##_masks[12] __attribute__((aligned(16))) = {                     \
+        red_mask, red_mask, red_mask, red_mask,                                                  \
+        green_mask, green_mask, green_mask, green_mask,                                          \
+        0x1F, 0x1F, 0x1F, 0x1F,                                                                  \
+    };                                                                                           \
+    static void name(const pixel_format_t* fmt, void* dst, const uint32_t* src, int count)     \
+    {                                                                                            \
+        uint16_t* d = (uint16_t*)dst;                                                            \
+        int blocks = count / 8;                                                                  \
+        if (blocks) {                                                                            \
+            uint8_t saved[64];                                                                   \
+            i686_SSE_Save(saved);                                                                \
+            __asm__ volatile(                                                                    \
+                "1:\n\t"                                                                         \
+                "movdqu 0(%[s]), %%xmm0\n\t"                                                     \
+                "movdqu 16(%[s]), %%xmm1\n\t"                                                    \
+                CONVERT16_SSE2_LANES("xmm0")                                                     \
+                CONVERT16_SSE2_LANES("xmm1")                                                     \
+                "packssdw %%xmm1, %%xmm0\n\t"                                                    \
+                "movdqu %%xmm0, 0(%[d])\n\t"                                                     \
+                "add $32, %[s]\n\t"                                                              \
+                "add $16, %[d]\n\t"                                                              \
+                "dec %[n]\n\t"                                                                   \
+                "jnz 1b\n\t"                                                                     \
+                : [s]"+r"(src), [d]"+r"(d), [n]"+r"(blocks)                                      \
+                : [m]"r"(name##_masks), [rs]"i"(red_shift), [gs]"i"(green_shift)                 \
+                : "memory", "cc");                                                               \
+            i686_SSE_Restore(saved);                                                             \
+        }                                                                                        \
+        scalar(fmt, d, src, count & 7);                                                          \
+    }
+
+DEFINE_CONVERT16_SSE2(convert_rgb565_sse2, convert_rgb565, 8, 5, 0xF800, 0x07E0)
+DEFINE_CONVERT16_SSE2(convert_xrgb1555_sse2, convert_xrgb1555, 9, 6, 0x7C00, 0x03E0)
+
+// --- Detection ---
+
+static bool pixel_format_is(const pixel_format_t* fmt, int rs, int rp, int gs, int gp, int bs, int bp)
+{
+    return fmt->red_size == rs && fmt->red_shift == rp &&
+           fmt->green_size == gs && fmt->green_shift == gp &&
+           fmt->blue_size == bs && fmt->blue_shift == bp;
+}
+
+const pixel_format_t* pixel_format_detect(const VbeScreenInfo* screen)
+{
+    pixel_format_t* fmt = &g_Format;
+    memset(fmt, 0, sizeof(*fmt));
+
+    fmt->bpp = screen->bpp;
+    fmt->red_size = screen->red_mask;
+    fmt->red_shift = screen->red_position;
+    fmt->green_size = screen->green_mask;
+    fmt->green_shift = screen->green_position;
+    fmt->blue_size = screen->blue_mask;
+    fmt->blue_shift = screen->blue_position;
+
+    switch (screen->bpp) {
+        case 15:
+        case 16: fmt->bytes = 2; break;
+        case 24: fmt->bytes = 3; break;
+        case 32: fmt->bytes = 4; break;
+        default: return NULL;
+    }
+
+    // Some BIOSes leave the masks empty; assume the usual layout for the depth
+    if (!fmt->red_size || !fmt->green_size || !fmt->blue_size) {
+        if (screen->bpp == 15) {
+            fmt->red_size = 5; fmt->red_shift = 10;
+            fmt->green_size = 5; fmt->green_shift = 5;
+        } else if (screen->bpp == 16) {
+            fmt->red_size = 5; fmt->red_shift = 11;
+            fmt->green_size = 6; fmt->green_shift = 5;
+        } else {
+            fmt->red_size = 8; fmt->red_shift = 16;
+            fmt->green_size = 8; fmt->green_shift = 8;
+        }
+        fmt->blue_size = (screen->bpp <= 16) ? 5 : 8;
+        fmt->blue_shift = 0;
+    }
+    if (fmt->red_size > 8 || fmt->green_size > 8 || fmt->blue_size > 8) return NULL;
+
+    static void (*const fills[5])(const pixel_format_t*, void*, uint32_t, int) = {
+        NULL, NULL, fill_16, fill_24, fill_32
+    };
+    fmt->fill = fills[fmt->bytes];
+
+    bool sse2 = g_CpuInfo.sse_enabled && i686_CPU_HasFeature(CPUID_EDX_SSE2);
+
+    if (fmt->bytes == 4 && pixel_format_is(fmt, 8, 16, 8, 8, 8, 0)) {
+        fmt->name = "XRGB8888";
+        fmt->native = true;
+        fmt->pack = pack_xrgb8888;
+        fmt->convert = convert_copy32;
+    } else if (fmt->bytes == 3 && pixel_format_is(fmt, 8, 16, 8, 8, 8, 0)) {
+        fmt->name = "RGB888";
+        fmt->pack = pack_xrgb8888;
+        fmt->convert = convert_rgb888;
+    } else if (fmt->bytes == 2 && pixel_format_is(fmt, 5, 11, 6, 5, 5, 0)) {
+        fmt->name = "RGB565";
+        fmt->pack = pack_rgb565;
+        fmt->convert = sse2 ? convert_rgb565_sse2 : convert_rgb565;
+    } else if (fmt->bytes == 2 && pixel_format_is(fmt, 5, 10, 5, 5, 5, 0)) {
+        fmt->name = "XRGB1555";
+        fmt->pack = pack_xrgb1555;
+        fmt->convert = sse2 ? convert_xrgb1555_sse2 : convert_xrgb1555;
+    } else {
+        fmt->name = "generic";
+        fmt->pack = pack_generic;
+        fmt->convert = convert_generic;
+    }
+    return fmt;
+}
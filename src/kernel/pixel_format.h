@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdint.h>
+#include "stdbool.h"
+#include "vbe.h"
+
+// Framebuffer pixel layouts. Everything above the framebuffer draws in
+// 32-bit 0x00RRGGBB; these routines turn that into whatever the VBE mode
+// stores, once per pixel at present time.
+
+typedef struct pixel_format {
+    const char* name;
+    uint8_t bpp;                // Bits per pixel as reported by VBE
+    uint8_t bytes;              // Bytes per pixel in VRAM
+    uint8_t red_size, red_shift;
+    uint8_t green_size, green_shift;
+    uint8_t blue_size, blue_shift;
+    bool native;                // Same layout as the 32-bit draw buffers
+
+    // Packs one 0x00RRGGBB colour into the VRAM layout
+    uint32_t (*pack)(const struct pixel_format* fmt, uint32_t rgb);
+    // Writes `count` 0x00RRGGBB pixels to VRAM (also used for blits)
+    void (*convert)(const struct pixel_format* fmt, void* dst, const uint32_t* src, int count);
+    // Fills `count` VRAM pixels with one 0x00RRGGBB colour
+    void (*fill)(const struct pixel_format* fmt, void* dst, uint32_t rgb, int count);
+} pixel_format_t;
+
+// Picks the descriptor and routines for a mode, NULL if it can't be drawn to.
+// Call after i686_CPU_Initialize() so the SSE2 converters can be used.
+const pixel_format_t* pixel_format_detect(const VbeScreenInfo* screen);
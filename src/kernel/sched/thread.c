@@ -0,0 +1,551 @@
+#include "thread.h"
+#include "stddef.h"
+#include "string.h"
+#include "memory.h"
+#include "time.h"
+#include "timer.h"
+#include "deferred.h"
+#include <arch/i686/cpu.h>
+#include <arch/i686/gdt.h>
+#include <arch/i686/apic.h>
+#include <arch/i686/irq.h>
+#include <arch/i686/smp.h>
+#include <sync/spinlock.h>
+
+#define EFLAGS_RESERVED 0x2
+#define FPU_STATE_SIZE  512
+
+typedef struct {
+    spinlock_t lock;                        // everything below, but online
+    thread_t* queue[THREAD_PRIORITIES];
+    thread_t* queue_tail[THREAD_PRIORITIES];
+    uint32_t queue_mask;                    // bit per non-empty priority
+    uint32_t queued;
+    thread_t* current;
+    thread_t* idle;                         // never queued; runs when the queue is empty
+    thread_t* prev;                         // switched out, its stack still in use
+    timer_id_t slice_timer;
+    volatile bool need_resched;
+    volatile bool online;
+    uint32_t switches;
+    uint32_t steals;
+} sched_cpu_t;
+
+static sched_cpu_t g_Cpus[SMP_MAX_CPUS];
+
+// Run queue lock names for the `locks` command
+static const char* const g_RunQueueLockNames[SMP_MAX_CPUS] = {
+    "runqueue0", "runqueue1", "runqueue2", "runqueue3",
+    "runqueue4", "runqueue5", "runqueue6", "runqueue7",
+};
+
+static spinlock_t g_ThreadsLock = SPINLOCK_INIT_NAMED("threads");  // g_AllThreads, g_NextThreadId
+static thread_t* g_AllThreads = NULL;
+static uint32_t g_NextThreadId = 0;
+
+static bool g_Running = false;
+static bool g_HasFxsr = false;
+
+// The calling CPU's state. Interrupts must be off, or the thread could move
+// to another CPU while using it.
+static inline sched_cpu_t* thread_this_cpu() {
+    return &g_Cpus[i686_SMP_CpuIndex()];
+}
+
+// --- FPU/SSE state ---
+// Saved and restored on every switch; threads are few and switches rare
+// next to the cost of anyone finding their xmm registers swapped.
+
+static inline void thread_fpu_save(thread_t* thread) {
+    if (g_HasFxsr) {
+        __asm__ volatile("fxsave (%0)" : : "r"(thread->fpu_state) : "memory");
+    } else {
+        // fnsave reinitializes the FPU; the fnrstor that follows undoes it
+        __asm__ volatile("fnsave (%0)" : : "r"(thread->fpu_state) : "memory");
+    }
+}
+
+static inline void thread_fpu_restore(thread_t* thread) {
+    if (g_HasFxsr) {
+        __asm__ volatile("fxrstor (%0)" : : "r"(thread->fpu_state) : "memory");
+    } else {
+        __asm__ volatile("frstor (%0)" : : "r"(thread->fpu_state) : "memory");
+    }
+}
+
+// --- Run queues ---
+// A CPU's queue is only touched under its lock
+
+static void thread_enqueue(sched_cpu_t* cpu, thread_t* thread) {
+    int prio = thread->priority;
+    thread->next = NULL;
+    if (cpu->queue_tail[prio]) {
+        cpu->queue_tail[prio]->next = thread;
+    } else {
+        cpu->queue[prio] = thread;
+    }
+    cpu->queue_tail[prio] = thread;
+    cpu->queue_mask |= 1u << prio;
+    cpu->queued++;
+}
+
+static thread_t* thread_dequeue(sched_cpu_t* cpu) {
+    if (!cpu->queue_mask) return NULL;
+
+    int prio = 31 - __builtin_clz(cpu->queue_mask);
+    thread_t* thread = cpu->queue[prio];
+    cpu->queue[prio] = thread->next;
+    if (!cpu->queue[prio]) {
+        cpu->queue_tail[prio] = NULL;
+        cpu->queue_mask &= ~(1u << prio);
+    }
+    cpu->queued--;
+    thread->next = NULL;
+    return thread;
+}
+
+// Takes the next thread from the CPU with the most waiting. The caller holds
+// its own lock, so the victim's is only tried: two CPUs stealing from each
+// other would otherwise deadlock.
+static thread_t* thread_steal(sched_cpu_t* self) {
+    sched_cpu_t* victim = NULL;
+    uint32_t most = 0;
+    uint32_t count = i686_SMP_CpuCount();
+    for (uint32_t i = 0; i < count; i++) {
+        sched_cpu_t* cpu = &g_Cpus[i];
+        if (cpu == self || !cpu->online) continue;
+        if (cpu->queued > most) {
+            most = cpu->queued;
+            victim = cpu;
+        }
+    }
+    if (!victim || !spin_trylock(&victim->lock)) return NULL;
+
+    thread_t* thread = thread_dequeue(victim);
+    spin_unlock(&victim->lock);
+    if (thread) self->steals++;
+    return thread;
+}
+
+// Racy, but only used to pick a CPU; a wrong guess costs a steal later
+static bool thread_cpu_idle(uint32_t index) {
+    sched_cpu_t* cpu = &g_Cpus[index];
+    return cpu->online && cpu->current == cpu->idle && !cpu->queued;
+}
+
+// An idle CPU, preferably the one the thread last ran on, else that one
+static uint32_t thread_pick_cpu(thread_t* thread) {
+    if (thread_cpu_idle(thread->cpu)) return thread->cpu;
+
+    uint32_t count = i686_SMP_CpuCount();
+    for (uint32_t i = 0; i < count; i++) {
+        if (thread_cpu_idle(i)) return i;
+    }
+    return thread->cpu;
+}
+
+// --- Switching ---
+
+static void thread_slice_expired(void* arg) {
+    uint32_t index = (uint32_t)(uintptr_t)arg;
+    sched_cpu_t* cpu = &g_Cpus[index];
+
+    uint32_t flags = spin_lock_irqsave(&cpu->lock);
+    cpu->slice_timer = TIMER_INVALID;
+    cpu->need_resched = true;
+    spin_unlock_irqrestore(&cpu->lock, flags);
+
+    // Timers run on the boot CPU; any other has to be told
+    if (index != i686_SMP_CpuIndex()) i686_SMP_SendIPI(index, THREAD_IPI_VECTOR);
+}
+
+// Someone of the same or higher priority is waiting: give the running
+// thread a slice. Caller holds cpu->lock.
+static void thread_arm_slice(sched_cpu_t* cpu) {
+    if (cpu->slice_timer != TIMER_INVALID) return;
+    if (!cpu->queue_mask || (31 - __builtin_clz(cpu->queue_mask)) < (int)cpu->current->priority) return;
+    cpu->slice_timer = timer_add(time_now_ns() + THREAD_SLICE_NS, thread_slice_expired,
+                                 (void*)(uintptr_t)(cpu - g_Cpus));
+}
+
+// Queues a thread that just became ready where a CPU will get to it soon,
+// and preempts that CPU if the thread outranks what it runs. Interrupts
+// must be off. Returns true if this CPU is the one that should switch.
+static bool thread_make_ready(thread_t* thread) {
+    uint32_t here = i686_SMP_CpuIndex();
+    uint32_t target = thread_pick_cpu(thread);
+    sched_cpu_t* cpu = &g_Cpus[target];
+
+    spin_lock(&cpu->lock);
+    thread_enqueue(cpu, thread);
+    bool preempt = thread->priority > cpu->current->priority;
+    if (preempt) {
+        cpu->need_resched = true;
+    } else {
+        thread_arm_slice(cpu);
+    }
+    spin_unlock(&cpu->lock);
+
+    if (target == here) return preempt;
+    if (preempt) i686_SMP_SendIPI(target, THREAD_IPI_VECTOR);
+    return false;
+}
+
+static void thread_free(void* arg) {
+    thread_t* thread = (thread_t*)arg;
+
+    uint32_t flags = spin_lock_irqsave(&g_ThreadsLock);
+    thread_t** link = &g_AllThreads;
+    while (*link && *link != thread) link = &(*link)->all_next;
+    if (*link) *link = thread->all_next;
+    spin_unlock_irqrestore(&g_ThreadsLock, flags);
+
+    free(thread->stack);
+    free_aligned(thread->fpu_state);
+    free(thread);
+}
+
+// The ISR exit hook: runs with interrupts off once the outermost interrupt
+// is about to return, and picks whose frame it returns to
+static Registers* thread_switch(Registers* regs) {
+    sched_cpu_t* cpu = thread_this_cpu();
+    if (!cpu->need_resched) return regs;
+
+    spin_lock(&cpu->lock);
+    cpu->need_resched = false;
+
+    thread_t* prev = cpu->current;
+    prev->context = regs;
+    // Blocked or dead threads stay out. One woken before it got here is
+    // READY and already queued somewhere.
+    if (prev->state == THREAD_RUNNING) {
+        prev->state = THREAD_READY;
+        if (prev != cpu->idle) thread_enqueue(cpu, prev);
+    }
+
+    thread_t* next = thread_dequeue(cpu);
+    if (!next) next = thread_steal(cpu);
+    if (!next) next = cpu->idle;
+    if (next == prev) {
+        prev->state = THREAD_RUNNING;
+        spin_unlock(&cpu->lock);
+        return regs;
+    }
+
+    // Woken and picked up here while another CPU is still switching away
+    // from it: that only takes until its ISR stub is off the stack
+    while (__atomic_load_n(&next->on_cpu, __ATOMIC_ACQUIRE)) {
+        __asm__ volatile("pause");
+    }
+
+    uint64_t now = time_now_ns();
+    prev->runtime_ns += now - prev->switched_in_ns;
+    next->switched_in_ns = now;
+    next->switches++;
+    cpu->switches++;
+
+    thread_fpu_save(prev);
+    thread_fpu_restore(next);
+
+    next->state = THREAD_RUNNING;
+    next->cpu = cpu - g_Cpus;
+    next->on_cpu = true;
+    cpu->current = next;
+    i686_SMP_SetCurrentThread(next);
+
+    if (cpu->slice_timer != TIMER_INVALID) {
+        timer_cancel(cpu->slice_timer);
+        cpu->slice_timer = TIMER_INVALID;
+    }
+    thread_arm_slice(cpu);
+
+    // Its stack is the one we're still on; thread_switched() lets go of it
+    cpu->prev = prev;
+    spin_unlock(&cpu->lock);
+    return next->context;
+}
+
+// The ISR stub is on next's stack now, so prev may run elsewhere, or be freed
+static void thread_switched() {
+    sched_cpu_t* cpu = thread_this_cpu();
+    thread_t* prev = cpu->prev;
+    if (!prev) return;
+    cpu->prev = NULL;
+
+    bool dead = prev->state == THREAD_DEAD;
+    __atomic_store_n(&prev->on_cpu, false, __ATOMIC_RELEASE);
+    if (dead) deferred_queue(thread_free, prev);
+}
+
+static void thread_yield_interrupt(Registers* regs) {
+    // Nothing to do here; the switch happens on the way out
+}
+
+static void thread_ipi_interrupt(Registers* regs) {
+    // need_resched is set already. The tail runs whatever this CPU queued
+    // since its last interrupt, freeing threads that exited here included.
+    i686_APIC_SendEndOfInterrupt();
+    i686_IRQ_RunTail();
+}
+
+static void thread_reschedule() {
+    uint32_t flags = irq_save();
+    thread_this_cpu()->need_resched = true;
+    __asm__ volatile("int %0" : : "i"(THREAD_YIELD_VECTOR) : "memory");
+    irq_restore(flags);
+}
+
+// --- Creating threads ---
+
+static void thread_start() {
+    thread_t* self = thread_current();
+    self->entry(self->arg);
+    thread_exit();
+}
+
+static thread_t* thread_alloc(const char* name, thread_priority_t priority) {
+    thread_t* thread = (thread_t*)malloc(sizeof(thread_t));
+    if (!thread) return NULL;
+    memset(thread, 0, sizeof(thread_t));
+
+    thread->fpu_state = (uint8_t*)malloc_aligned(FPU_STATE_SIZE, 16);
+    if (!thread->fpu_state) {
+        free(thread);
+        return NULL;
+    }
+
+    strncpy(thread->name, name, THREAD_NAME_MAX - 1);
+    thread->priority = priority;
+
+    uint32_t flags = spin_lock_irqsave(&g_ThreadsLock);
+    thread->id = g_NextThreadId++;
+    thread->all_next = g_AllThreads;
+    g_AllThreads = thread;
+    spin_unlock_irqrestore(&g_ThreadsLock, flags);
+    return thread;
+}
+
+// A thread with a stack and a frame that starts it at entry(arg), not yet queued
+static thread_t* thread_new(const char* name, thread_entry_t entry, void* arg, thread_priority_t priority) {
+    uint8_t* stack = (uint8_t*)malloc(THREAD_STACK_SIZE);
+    if (!stack) return NULL;
+    thread_t* thread = thread_alloc(name, priority);
+    if (!thread) {
+        free(stack);
+        return NULL;
+    }
+
+    thread->stack = stack;
+    thread->entry = entry;
+    thread->arg = arg;
+
+    // Start from the creator's FPU state: sane control words, and nothing
+    // the new thread could depend on. fnsave clears the FPU, hence the reload.
+    uint32_t flags = irq_save();
+    thread_fpu_save(thread);
+    thread_fpu_restore(thread);
+    irq_restore(flags);
+
+    // A frame as if the thread had been interrupted at thread_start. A
+    // same-privilege iret doesn't pop esp/ss, so it starts with esp at
+    // &frame->esp, placed so thread_start sees the stack 16-byte aligned.
+    uintptr_t top = ((uintptr_t)stack + THREAD_STACK_SIZE) & ~15u;
+    Registers* frame = (Registers*)(top - 12 - sizeof(Registers));
+    memset(frame, 0, sizeof(Registers));
+    frame->ds = i686_GDT_DATA_SEGMENT;
+    frame->cs = i686_GDT_CODE_SEGMENT;
+    frame->eip = (uint32_t)thread_start;
+    frame->eflags = EFLAGS_IF | EFLAGS_RESERVED;
+    thread->context = frame;
+    thread->state = THREAD_READY;
+    return thread;
+}
+
+thread_t* thread_create(const char* name, thread_entry_t entry, void* arg, thread_priority_t priority) {
+    if (!thread_is_running()) return NULL;
+
+    thread_t* thread = thread_new(name, entry, arg, priority);
+    if (!thread) return NULL;
+
+    uint32_t flags = irq_save();
+    thread->cpu = i686_SMP_CpuIndex();
+    bool switch_now = thread_make_ready(thread) && !i686_ISR_InInterrupt();
+    irq_restore(flags);
+
+    if (switch_now) thread_reschedule();
+    return thread;
+}
+
+static void thread_idle(void* arg) {
+    for (;;) {
+        __asm__ volatile("sti\n\thlt");
+    }
+}
+
+void thread_initialize() {
+    g_HasFxsr = i686_CPU_HasFeature(CPUID_EDX_FXSR) && g_CpuInfo.sse_enabled;
+    for (int i = 0; i < SMP_MAX_CPUS; i++) {
+        spin_init_named(&g_Cpus[i].lock, g_RunQueueLockNames[i]);
+    }
+
+    // The boot context carries on as the shell thread; its frame is saved
+    // the first time it's switched out
+    thread_t* boot = thread_alloc("shell", THREAD_PRIORITY_NORMAL);
+    if (!boot) return;
+    boot->state = THREAD_RUNNING;
+    boot->on_cpu = true;
+    boot->switched_in_ns = time_now_ns();
+
+    thread_t* idle = thread_new("idle", thread_idle, NULL, THREAD_PRIORITY_IDLE);
+    if (!idle) return;
+
+    uint32_t flags = irq_save();
+    sched_cpu_t* cpu = &g_Cpus[0];
+    cpu->current = boot;
+    cpu->idle = idle;
+    cpu->online = true;
+    i686_SMP_SetCurrentThread(boot);
+
+    i686_ISR_RegisterHandler(THREAD_YIELD_VECTOR, thread_yield_interrupt);
+    i686_ISR_RegisterHandler(THREAD_IPI_VECTOR, thread_ipi_interrupt);
+    i686_ISR_SetExitHandler(thread_switch, thread_switched);
+    g_Running = true;
+    irq_restore(flags);
+}
+
+void thread_ap_main() {
+    uint32_t index = i686_SMP_CpuIndex();
+    sched_cpu_t* cpu = &g_Cpus[index];
+
+    // The stack we're on came from the SMP bring-up and stays ours for good
+    thread_t* idle = thread_alloc("idle", THREAD_PRIORITY_IDLE);
+    if (!idle) {
+        for (;;) __asm__ volatile("cli\n\thlt");
+    }
+    idle->state = THREAD_RUNNING;
+    idle->cpu = index;
+    idle->on_cpu = true;
+    idle->switched_in_ns = time_now_ns();
+
+    spin_lock(&cpu->lock);
+    cpu->current = idle;
+    cpu->idle = idle;
+    i686_SMP_SetCurrentThread(idle);
+    cpu->online = true;
+    spin_unlock(&cpu->lock);
+
+    thread_idle(NULL);
+}
+
+bool thread_is_running() {
+    return g_Running;
+}
+
+thread_t* thread_current() {
+    return (thread_t*)i686_SMP_CurrentThread();
+}
+
+void thread_exit() {
+    __asm__ volatile("cli");
+    thread_current()->state = THREAD_DEAD;
+    thread_reschedule();
+    // Never resumed
+    for (;;) __asm__ volatile("hlt");
+}
+
+void thread_yield() {
+    if (!thread_is_running() || i686_ISR_InInterrupt()) return;
+    thread_reschedule();
+}
+
+void thread_prepare_block() {
+    thread_current()->state = THREAD_BLOCKED;
+}
+
+void thread_block() {
+    thread_reschedule();
+}
+
+bool thread_wake(thread_t* thread) {
+    // Only one of several wakers gets past this
+    if (!__sync_bool_compare_and_swap(&thread->state, THREAD_BLOCKED, THREAD_READY)) return false;
+
+    uint32_t flags = irq_save();
+    bool switch_now = thread_make_ready(thread) && !i686_ISR_InInterrupt();
+    irq_restore(flags);
+
+    // From an IRQ the switch happens on the way out anyway
+    if (switch_now) thread_reschedule();
+    return true;
+}
+
+static void thread_sleep_expired(void* arg) {
+    thread_wake((thread_t*)arg);
+}
+
+bool thread_sleep_until(uint64_t deadline_ns) {
+    if (!thread_is_running() || i686_ISR_InInterrupt()) return false;
+
+    uint32_t flags = irq_save();
+    bool slept = false;
+    if (time_now_ns() < deadline_ns) {
+        // Blocked before the timer exists: it may fire on another CPU at once
+        thread_t* self = thread_current();
+        thread_prepare_block();
+        if (timer_add(deadline_ns, thread_sleep_expired, self) != TIMER_INVALID) {
+            thread_block();
+            slept = true;
+        } else {
+            self->state = THREAD_RUNNING;
+        }
+    }
+    irq_restore(flags);
+    return slept;
+}
+
+void thread_sleep(uint32_t ms) {
+    thread_sleep_until(time_now_ns() + (uint64_t)ms * 1000000);
+}
+
+int thread_get_info(thread_info_t* out, int max) {
+    uint32_t flags = spin_lock_irqsave(&g_ThreadsLock);
+    int count = 0;
+    uint64_t now = time_now_ns();
+    for (thread_t* thread = g_AllThreads; thread && count < max; thread = thread->all_next) {
+        thread_info_t* info = &out[count++];
+        info->id = thread->id;
+        memcpy(info->name, thread->name, THREAD_NAME_MAX);
+        info->state = thread->state;
+        info->priority = thread->priority;
+        info->switches = thread->switches;
+        info->cpu = thread->cpu;
+        info->runtime_ns = thread->runtime_ns;
+        if (thread->state == THREAD_RUNNING && now > thread->switched_in_ns) {
+            info->runtime_ns += now - thread->switched_in_ns;
+        }
+    }
+    spin_unlock_irqrestore(&g_ThreadsLock, flags);
+    return count;
+}
+
+int thread_get_cpu_info(thread_cpu_info_t* out, int max) {
+    uint32_t cpus = i686_SMP_CpuCount();
+    int count = 0;
+    for (uint32_t i = 0; i < cpus && count < max; i++) {
+        sched_cpu_t* cpu = &g_Cpus[i];
+        if (!cpu->online) continue;
+
+        uint32_t flags = spin_lock_irqsave(&cpu->lock);
+        thread_cpu_info_t* info = &out[count++];
+        info->index = i;
+        info->apic_id = g_PerCpu[i].apic_id;
+        info->switches = cpu->switches;
+        info->steals = cpu->steals;
+        info->queued = cpu->queued;
+        info->idle_ns = cpu->idle->runtime_ns;
+        if (cpu->current == cpu->idle) info->idle_ns += time_now_ns() - cpu->idle->switched_in_ns;
+        memcpy(info->current, cpu->current->name, THREAD_NAME_MAX);
+        spin_unlock_irqrestore(&cpu->lock, flags);
+    }
+    return count;
+}
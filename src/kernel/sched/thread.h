@@ -0,0 +1,121 @@
+#pragma once
+
+#include <stdint.h>
+#include "stdbool.h"
+#include <arch/i686/isr.h>
+
+// Preemptive kernel threads.
+//
+// Every switch happens on the way out of an interrupt: the outgoing thread's
+// Registers frame stays on its own stack and the ISR stub resumes the next
+// thread's frame instead. Voluntary switches (yield, block) raise
+// THREAD_YIELD_VECTOR to get there.
+//
+// Each CPU has its own run queue, a FIFO per priority; the highest
+// non-empty one runs, round-robin in THREAD_SLICE_NS slices. A thread that
+// becomes ready goes to an idle CPU if there is one, else back to the CPU
+// it last ran on. A CPU whose queue runs dry steals from the busiest other
+// one before it idles. Other CPUs are told to reschedule with
+// THREAD_IPI_VECTOR.
+
+#define THREAD_YIELD_VECTOR     0x81
+#define THREAD_IPI_VECTOR       0xF0
+#define THREAD_STACK_SIZE       (16 * 1024)
+#define THREAD_SLICE_NS         10000000
+#define THREAD_NAME_MAX         16
+#define THREAD_MAX_INFO         32
+
+typedef enum {
+    THREAD_PRIORITY_IDLE,       // only the idle thread
+    THREAD_PRIORITY_LOW,
+    THREAD_PRIORITY_NORMAL,     // the shell
+    THREAD_PRIORITY_HIGH,
+    THREAD_PRIORITIES
+} thread_priority_t;
+
+typedef enum {
+    THREAD_READY,
+    THREAD_RUNNING,
+    THREAD_BLOCKED,
+    THREAD_DEAD,
+} thread_state_t;
+
+typedef void (*thread_entry_t)(void* arg);
+
+typedef struct thread {
+    uint32_t id;
+    char name[THREAD_NAME_MAX];
+    thread_state_t state;
+    thread_priority_t priority;
+    Registers* context;         // saved frame while switched out
+    uint8_t* stack;             // NULL for the boot thread, which keeps its own
+    uint8_t* fpu_state;         // fxsave/fnsave area, 16-byte aligned
+    thread_entry_t entry;
+    void* arg;
+    uint32_t switches;          // times it was switched in
+    uint64_t runtime_ns;
+    uint64_t switched_in_ns;
+    uint32_t cpu;               // where it runs or last ran
+    volatile bool on_cpu;       // a CPU is still on its stack
+    struct thread* next;        // run queue or wait queue
+    struct thread* all_next;
+} thread_t;
+
+typedef struct {
+    uint32_t id;
+    char name[THREAD_NAME_MAX];
+    thread_state_t state;
+    thread_priority_t priority;
+    uint32_t switches;
+    uint64_t runtime_ns;
+    uint32_t cpu;
+} thread_info_t;
+
+typedef struct {
+    uint32_t index;
+    uint32_t apic_id;
+    uint32_t switches;          // threads switched in
+    uint32_t steals;            // of those, taken from another CPU's queue
+    uint32_t queued;            // ready threads waiting
+    uint64_t idle_ns;           // time spent in the idle thread
+    char current[THREAD_NAME_MAX];
+} thread_cpu_info_t;
+
+// Turns the boot context into the first thread and starts scheduling.
+// Call after timer_initialize() and deferred_initialize().
+void thread_initialize();
+// Entry point of the other CPUs (HAL_StartSecondaryCpus): their boot
+// context becomes their idle thread. Never returns.
+void thread_ap_main();
+bool thread_is_running();
+
+// Starts entry(arg) on a new thread. Returns NULL if out of memory.
+thread_t* thread_create(const char* name, thread_entry_t entry, void* arg, thread_priority_t priority);
+// Ends the calling thread; returning from its entry function does the same
+void thread_exit();
+thread_t* thread_current();
+
+// Lets another ready thread of the same or higher priority run
+void thread_yield();
+// Blocks the calling thread until time_now_ns() reaches deadline_ns.
+// Returns false (without waiting) before thread_initialize() or from an IRQ.
+bool thread_sleep_until(uint64_t deadline_ns);
+void thread_sleep(uint32_t ms);
+
+// For wait queues: blocks the current thread. Interrupts must be off; they
+// are off again when it returns.
+//
+// A waker on another CPU can run the moment the thread is visible to it,
+// so call thread_prepare_block() first, while still holding the lock the
+// waker takes, then drop the lock and call thread_block(). A wake in
+// between isn't lost; thread_block() then just gives up the CPU once.
+void thread_prepare_block();
+void thread_block();
+// Makes a blocked thread ready again, preempting the caller if it matters.
+// Returns false if the thread wasn't blocked.
+bool thread_wake(thread_t* thread);
+
+// Snapshot of up to max threads for the `threads` command
+int thread_get_info(thread_info_t* out, int max);
+// Snapshot of up to max online CPUs for the `cpus` command
+int thread_get_cpu_info(thread_cpu_info_t* out, int max);
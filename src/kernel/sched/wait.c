@@ -0,0 +1,75 @@
+#include "wait.h"
+#include "stddef.h"
+#include <sync/spinlock.h>
+
+void wait_queue_init(wait_queue_t* queue) {
+    spin_init(&queue->lock);
+    queue->head = NULL;
+    queue->tail = NULL;
+}
+
+void wait_queue_prepare(wait_queue_t* queue) {
+    thread_t* self = thread_current();
+
+    spin_lock(&queue->lock);
+    self->next = NULL;
+    if (queue->tail) {
+        queue->tail->next = self;
+    } else {
+        queue->head = self;
+    }
+    queue->tail = self;
+    thread_prepare_block();
+    spin_unlock(&queue->lock);
+}
+
+void wait_queue_wait(wait_queue_t* queue, spinlock_t* lock) {
+    wait_queue_prepare(queue);
+
+    if (lock) spin_unlock(lock);
+    thread_block();
+    if (lock) spin_lock(lock);
+}
+
+static thread_t* wait_queue_pop(wait_queue_t* queue) {
+    thread_t* thread = queue->head;
+    if (thread) {
+        queue->head = thread->next;
+        if (!queue->head) queue->tail = NULL;
+        thread->next = NULL;
+    }
+    return thread;
+}
+
+bool wait_queue_wake_one(wait_queue_t* queue) {
+    uint32_t flags = spin_lock_irqsave(&queue->lock);
+    thread_t* thread = wait_queue_pop(queue);
+    spin_unlock(&queue->lock);
+    if (thread) thread_wake(thread);
+    irq_restore(flags);
+    return thread != NULL;
+}
+
+int wait_queue_wake_all(wait_queue_t* queue) {
+    uint32_t flags = spin_lock_irqsave(&queue->lock);
+    // Detach the whole list first; the wakes take run queue locks
+    thread_t* thread = queue->head;
+    queue->head = NULL;
+    queue->tail = NULL;
+    spin_unlock(&queue->lock);
+
+    int woken = 0;
+    while (thread) {
+        thread_t* next = thread->next;
+        thread->next = NULL;
+        thread_wake(thread);
+        thread = next;
+        woken++;
+    }
+    irq_restore(flags);
+    return woken;
+}
+
+bool wait_queue_empty(wait_queue_t* queue) {
+    return queue->head == NULL;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "stdbool.h"
+#include "thread.h"
+#include <sync/spinlock.h>
+
+// FIFO of threads blocked on some condition. The condition is guarded by a
+// spinlock that the waker also holds while changing it, so a wake can't slip
+// in between the check and the block, even from another CPU:
+//
+//     uint32_t flags = spin_lock_irqsave(&lock);
+//     while (!condition) wait_queue_wait(&queue, &lock);
+//     spin_unlock_irqrestore(&lock, flags);
+
+typedef struct {
+    spinlock_t lock;
+    thread_t* head;
+    thread_t* tail;
+} wait_queue_t;
+
+#define WAIT_QUEUE_INIT { .lock = SPINLOCK_INIT, .head = NULL, .tail = NULL }
+
+void wait_queue_init(wait_queue_t* queue);
+// Blocks the current thread on the queue. Interrupts must be off. `lock`
+// (may be NULL) is held by the caller; it's dropped once the thread is on
+// the queue and taken again before returning.
+void wait_queue_wait(wait_queue_t* queue, spinlock_t* lock);
+// The first half of wait_queue_wait: queues the current thread and marks it
+// blocked without switching away. The caller drops its own locks and then
+// calls thread_block(); a wake that comes in between just turns that into
+// a yield. Interrupts must be off throughout.
+void wait_queue_prepare(wait_queue_t* queue);
+// Wake the longest waiter / everyone. Safe from IRQ handlers and deferred work.
+bool wait_queue_wake_one(wait_queue_t* queue);
+int wait_queue_wake_all(wait_queue_t* queue);
+bool wait_queue_empty(wait_queue_t* queue);
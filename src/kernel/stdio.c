@@ -7,9 +7,11 @@
 #include "memory.h"
 #include "vbe.h"
 #include "graphics.h"
-#include "font.h"
+#include "glyph.h"
 #include "heap.h"
 #include "time.h"
+#include "string.h"
+#include <sync/spinlock.h>
 
 static const char g_HexChars[] = "0123456789abcdef";
 
@@ -42,6 +44,11 @@ uint32_t g_ConsoleDelay = 0;
 static uint8_t* g_ShadowBuffer = NULL;
 uint8_t* g_ScreenBuffer = NULL;
 
+// What is actually drawn on screen, in the same (char, attr) layout. Cells
+// are only drawn when the shadow buffer differs from it.
+static uint8_t* g_FrontBuffer = NULL;
+static bool g_FrontValid = false;
+
 int g_ScreenX = 0, g_ScreenY = 0;
 int g_ConsoleWidth = 80;
 int g_ConsoleHeight = 25;
@@ -71,6 +78,13 @@ void console_initialize() {
         printf("CRITICAL: Failed to allocate console shadow buffer!\n");
     }
     g_ScreenBuffer = g_ShadowBuffer;
+
+    g_FrontBuffer = (uint8_t*)malloc(g_ConsoleWidth * g_ConsoleHeight * 2);
+    if (!g_FrontBuffer) {
+        // console_render falls back to redrawing every cell
+        printf("WARNING: Failed to allocate console front buffer.\n");
+    }
+    g_FrontValid = false;
     
     live_screen_backup = (uint8_t*)malloc(g_ConsoleWidth * g_ConsoleHeight * 2);
     if (!live_screen_backup) {
@@ -95,6 +109,7 @@ void console_set_font_scale(int scale) {
 
     // Free old buffers
     if (g_ShadowBuffer) free(g_ShadowBuffer);
+    if (g_FrontBuffer) free(g_FrontBuffer);
     if (live_screen_backup) free(live_screen_backup);
     if (scrollback_buffer) free(scrollback_buffer);
 
@@ -104,58 +119,100 @@ void console_set_font_scale(int scale) {
     clrscr();
 }
 
-// Helper to draw a character to the VBE screen
-static void draw_char_at(int x, int y, char c, uint8_t color) {
-    if (!g_vbe_screen) return;
-
-    uint32_t fg = vga_colors[color & 0x0F];
-    uint32_t bg = vga_colors[(color >> 4) & 0x0F];
-
-    // Get font data (offset by 32 because our font starts at space)
-    const uint8_t* glyph = (c >= 32 && c <= 127) ? font8x8_basic[c - 32] : font8x8_basic[0];
-
-    int screen_x = x * 8 * g_FontScale;
-    int screen_y = y * 8 * g_FontScale;
-
-    // Draw 8x8 pixels
-    for (int row = 0; row < 8; row++) {
-        for (int col = 0; col < 8; col++) {
-            // Check if the bit is set in the font bitmap
-            // Bit 0 is the rightmost pixel, Bit 7 is leftmost
-            bool pixel_on = (glyph[row] >> (7 - col)) & 1;
-            uint32_t draw_color = pixel_on ? fg : bg;
-            
-            // Draw scaled pixel
-            for (int sy = 0; sy < g_FontScale; sy++) {
-                for (int sx = 0; sx < g_FontScale; sx++) {
-                    draw_pixel(screen_x + col * g_FontScale + sx, 
-                               screen_y + row * g_FontScale + sy, 
-                               draw_color);
-                }
+// Draws every cell that differs from the front buffer. Changed cells next
+// to each other with the same colour go out as one glyph_draw_run. Without
+// a front buffer every cell is drawn each time.
+static void console_render()
+{
+    if (!g_vbe_screen || !g_ScreenBuffer) return;
+
+    int cell = 8 * g_FontScale;
+    size_t row_bytes = g_ConsoleWidth * 2;
+    char text[CONSOLE_RENDER_SPAN];
+    bool diff = g_FrontBuffer && g_FrontValid;
+
+    for (int y = 0; y < g_ConsoleHeight; y++) {
+        uint8_t* back = g_ScreenBuffer + y * row_bytes;
+        uint8_t* front = g_FrontBuffer ? g_FrontBuffer + y * row_bytes : NULL;
+        if (diff && memcmp(back, front, row_bytes) == 0) continue;
+
+        int x = 0;
+        while (x < g_ConsoleWidth) {
+            if (diff && back[2 * x] == front[2 * x] && back[2 * x + 1] == front[2 * x + 1]) {
+                x++;
+                continue;
             }
+
+            int start = x;
+            uint8_t color = back[2 * x + 1];
+            while (x < g_ConsoleWidth && x - start < CONSOLE_RENDER_SPAN && back[2 * x + 1] == color &&
+                   (!diff || back[2 * x] != front[2 * x] || color != front[2 * x + 1])) {
+                text[x - start] = (char)back[2 * x];
+                x++;
+            }
+
+            glyph_draw_run(start * cell, y * cell, text, x - start,
+                           vga_colors[color & 0x0F], vga_colors[(color >> 4) & 0x0F], g_FontScale);
         }
+        if (front) memcpy(front, back, row_bytes);
     }
+    g_FrontValid = g_FrontBuffer != NULL;
+}
+
+void console_invalidate()
+{
+    g_FrontValid = false;
+}
+
+// --- Presenting ---
+// Output is presented at most once per frame. Anything drawn in between is
+// left pending until the next present or console_flush().
+static uint32_t g_LastPresentMs = 0;
+static bool g_PresentPending = false;
+
+static void console_swap()
+{
+    // An app owns the screen; console output waits in the shadow buffer
+    if (graphics_app_active()) {
+        g_PresentPending = true;
+        return;
+    }
+    console_render();
+    if (g_DoubleBufferEnabled) graphics_swap_buffer();
+    g_LastPresentMs = get_uptime_ms();
+    g_PresentPending = false;
+}
+
+static void console_present()
+{
+    // With interrupts off the clock doesn't move, so never defer then
+    if (irq_enabled() && get_uptime_ms() - g_LastPresentMs < CONSOLE_FRAME_MS) {
+        g_PresentPending = true;
+        return;
+    }
+    console_swap();
+}
+
+void console_flush()
+{
+    // While an app is shown this stays pending until it ends
+    if (g_PresentPending && !graphics_app_active())
+        console_swap();
 }
 
 void putchr(int x, int y, char c)
 {
     if (g_ScreenBuffer) {
-        // Update shadow buffer
+        // Update shadow buffer, the next present draws it
         g_ScreenBuffer[2 * (y * g_ConsoleWidth + x)] = c;
     }
-    
-    // Draw to VBE
-    draw_char_at(x, y, c, getcolor(x, y));
 }
 
 void putcolor(int x, int y, uint8_t color)
 {
     if (!g_ScreenBuffer) return;
-    // Update shadow buffer
+    // Update shadow buffer, the next present draws it
     g_ScreenBuffer[2 * (y * g_ConsoleWidth + x) + 1] = color;
-    
-    // Draw to VBE
-    draw_char_at(x, y, getchr(x, y), color);
 }
 
 char getchr(int x, int y)
@@ -198,10 +255,18 @@ void clrscr()
     g_ScreenX = 0;
     g_ScreenY = 0;
     
-    // Clear the screen using the graphics abstraction (respects double buffering)
-    if (g_vbe_screen) {
+    // Clear the screen using the graphics abstraction (respects double buffering).
+    // Behind an app the console's pixels are left alone; the diff catches up later.
+    if (g_vbe_screen && !graphics_app_active()) {
         graphics_clear_buffer(0x00000000);
-        if (g_DoubleBufferEnabled) graphics_swap_buffer();
+        // Blank cells on a black background are exactly what's on screen now
+        if (g_FrontBuffer && g_ScreenBuffer && vga_colors[(DEFAULT_COLOR >> 4) & 0x0F] == 0) {
+            memcpy(g_FrontBuffer, g_ScreenBuffer, g_ConsoleWidth * g_ConsoleHeight * 2);
+            g_FrontValid = true;
+        } else {
+            g_FrontValid = false;
+        }
+        console_swap();
     }
 }
 
@@ -232,21 +297,21 @@ void scrollback(int lines)
         memmove(g_ScreenBuffer, g_ScreenBuffer + (lines * line_size), move_size);
     }
 
-    // 2. Move VBE Framebuffer (Pixels)
-    if (g_vbe_screen) {
-        int pixel_lines = lines * 8 * g_FontScale;
-        size_t pitch = g_vbe_screen->pitch;
-        size_t total_bytes = g_vbe_screen->height * pitch;
-        size_t bytes_to_scroll = pixel_lines * pitch;
-        
-        void* target_buffer = (g_DoubleBufferEnabled && g_BackBuffer) 
-            ? (void*)g_BackBuffer 
-            : (void*)g_vbe_screen->physical_buffer;
-
-        if (bytes_to_scroll < total_bytes) {
-            memmove(target_buffer, 
-                    (void*)((uintptr_t)target_buffer + bytes_to_scroll), 
-                    total_bytes - bytes_to_scroll);
+    // 2. Scroll the VBE Framebuffer (Pixels). With a back buffer this only
+    //    advances its start row, so clearing the new bottom rows is all the drawing.
+    //    The front buffer follows the pixels: the new rows are blank cells.
+    //    Behind an app neither moves and the next render redraws what changed.
+    if (g_vbe_screen && !graphics_app_active()) {
+        uint32_t bg_color = vga_colors[(DEFAULT_COLOR >> 4) & 0x0F];
+        graphics_scroll_up(lines * 8 * g_FontScale, bg_color);
+
+        if (g_FrontBuffer) {
+            size_t line_size = g_ConsoleWidth * 2;
+            memmove(g_FrontBuffer, g_FrontBuffer + (lines * line_size), (g_ConsoleHeight - lines) * line_size);
+            for (int i = (g_ConsoleHeight - lines) * g_ConsoleWidth; i < g_ConsoleHeight * g_ConsoleWidth; i++) {
+                g_FrontBuffer[2 * i] = '\0';
+                g_FrontBuffer[2 * i + 1] = DEFAULT_COLOR;
+            }
         }
     }
 
@@ -260,39 +325,16 @@ void scrollback(int lines)
             }
         }
     }
-
-    // 4. Fast Clear VBE Framebuffer bottom (Pixels)
-    if (g_vbe_screen) {
-        int pixel_lines = lines * 8 * g_FontScale;
-        uint32_t bg_color = vga_colors[(DEFAULT_COLOR >> 4) & 0x0F];
-        uint32_t pitch = g_vbe_screen->pitch;
-        
-        uint8_t* base_ptr = (g_DoubleBufferEnabled && g_BackBuffer)
-            ? (uint8_t*)g_BackBuffer
-            : (uint8_t*)g_vbe_screen->physical_buffer;
-
-        for (int y = g_vbe_screen->height - pixel_lines; y < g_vbe_screen->height; y++) {
-            uint32_t* line = (uint32_t*)(base_ptr + y * pitch);
-            if (bg_color == 0) {
-                memset(line, 0, g_vbe_screen->width * 4);
-            } else {
-                for (int x = 0; x < g_vbe_screen->width; x++) {
-                    line[x] = bg_color;
-                }
-            }
-        }
-    }
     g_ScreenY -= lines;
-    if (g_DoubleBufferEnabled) graphics_swap_buffer();
+    if (g_ConsoleAutoSwap) console_present();
 }
 
+// For when something else has drawn over the console
 void console_refresh() {
-    for (int y = 0; y < g_ConsoleHeight; y++) {
-        for (int x = 0; x < g_ConsoleWidth; x++) {
-            draw_char_at(x, y, getchr(x, y), getcolor(x, y));
-        }
-    }
-    if (g_DoubleBufferEnabled) graphics_swap_buffer();
+    // Only VRAM was hit if the console has a back buffer
+    if (g_DoubleBufferEnabled) graphics_mark_all_dirty();
+    else console_invalidate();
+    console_swap();
 }
 
 void refresh_screen_color()
@@ -302,7 +344,7 @@ void refresh_screen_color()
             putcolor(x, y, DEFAULT_COLOR);
         }
     }
-    if (g_DoubleBufferEnabled) graphics_swap_buffer();
+    console_swap();
 }
 
 static void redraw_from_scrollback() {
@@ -324,7 +366,7 @@ static void redraw_from_scrollback() {
         }
     }
     setcursor(0, g_ConsoleHeight - 1);
-    if (g_DoubleBufferEnabled) graphics_swap_buffer();
+    console_swap();
 }
 
 void view_scrollback_up() {
@@ -349,7 +391,7 @@ void view_scrollback_down() {
         scrollback_view = 0;
         in_scrollback_mode = false;
         memcpy(g_ScreenBuffer, live_screen_backup, g_ConsoleWidth * g_ConsoleHeight * 2);
-        console_refresh();
+        console_swap();
         setcursor(g_ScreenX, g_ScreenY);
         return;
     }
@@ -401,30 +443,118 @@ void putc(char c)
 
     setcursor(g_ScreenX, g_ScreenY);
 
-    if (g_ConsoleDelay > 0)
+    if (g_ConsoleDelay > 0) {
+        // Typewriter mode shows every character as it lands
+        if (g_DoubleBufferEnabled) console_swap();
         sleep_ms(g_ConsoleDelay);
+        return;
+    }
 
-    if (g_ConsoleAutoSwap && g_DoubleBufferEnabled)
-        graphics_swap_buffer();
+    if (g_ConsoleAutoSwap)
+        console_present();
 }
 
-void puts(const char* str)
+// Stores a run of printable characters on the current row. The next
+// present draws them.
+static void console_put_run(const char* str, int count)
 {
+    if (g_ScreenBuffer) {
+        uint8_t* cell = g_ScreenBuffer + 2 * (g_ScreenY * g_ConsoleWidth + g_ScreenX);
+        for (int i = 0; i < count; i++)
+            cell[2 * i] = str[i];
+    }
+
+    g_ScreenX += count;
+    if (g_ScreenX >= g_ConsoleWidth)
+    {
+        g_ScreenY++;
+        g_ScreenX = 0;
+    }
+    if (g_ScreenY >= g_ConsoleHeight)
+        scrollback(1);
+}
+
+void console_write(const char* str, int len)
+{
+    // Typewriter mode goes character by character on purpose
+    if (g_ConsoleDelay > 0) {
+        for (int i = 0; i < len; i++) putc(str[i]);
+        return;
+    }
+
     bool prev = g_ConsoleAutoSwap;
-    if (g_ConsoleDelay == 0) g_ConsoleAutoSwap = false;
+    g_ConsoleAutoSwap = false;
 
-    while(*str)
+    int i = 0;
+    while (i < len)
     {
-        putc(*str);
-        str++;
+        char c = str[i];
+        if (c == '\n' || c == '\b' || c == '\t' || c == '\r') {
+            putc(c);
+            i++;
+            continue;
+        }
+
+        // Everything else lands in a cell; batch up to the end of the row
+        int run = 1;
+        int room = g_ConsoleWidth - g_ScreenX;
+        while (run < room && i + run < len) {
+            c = str[i + run];
+            if (c == '\n' || c == '\b' || c == '\t' || c == '\r') break;
+            run++;
+        }
+        console_put_run(str + i, run);
+        i += run;
     }
 
+    setcursor(g_ScreenX, g_ScreenY);
+
     g_ConsoleAutoSwap = prev;
-    if (g_ConsoleAutoSwap && g_DoubleBufferEnabled)
-        graphics_swap_buffer();
+    if (g_ConsoleAutoSwap)
+        console_present();
 }
 
-void printf_unsigned(unsigned long long number, int radix, int width, char padding, bool uppercase)
+void puts(const char* str)
+{
+    console_write(str, strlen(str));
+}
+
+#define PRINTF_STATE_NORMAL         0
+#define PRINTF_STATE_LENGTH         1
+#define PRINTF_STATE_LENGTH_SHORT   2
+#define PRINTF_STATE_LENGTH_LONG    3
+#define PRINTF_STATE_SPEC           4
+#define PRINTF_STATE_FLAGS          5
+#define PRINTF_STATE_WIDTH          6
+
+#define PRINTF_LENGTH_DEFAULT       0
+#define PRINTF_LENGTH_SHORT_SHORT   1
+#define PRINTF_LENGTH_SHORT         2
+#define PRINTF_LENGTH_LONG          3
+#define PRINTF_LENGTH_LONG_LONG     4
+
+// Where formatted output goes. sprintf writes straight into the caller's
+// string (size 0, never flushed); printf fills a line buffer and hands it to
+// the console each time it fills up.
+typedef struct format_out {
+    char* buffer;
+    int pos;
+    int size;
+    int total;
+    void (*flush)(struct format_out* out);
+} format_out_t;
+
+static inline void format_putc(format_out_t* out, char c)
+{
+    if (out->size && out->pos == out->size) {
+        out->flush(out);
+        out->pos = 0;
+    }
+    out->buffer[out->pos++] = c;
+    out->total++;
+}
+
+static void format_unsigned(format_out_t* out, unsigned long long number, int radix, int width, char padding, bool uppercase)
 {
     char buffer[64];
     int pos = 0;
@@ -441,74 +571,78 @@ void printf_unsigned(unsigned long long number, int radix, int width, char paddi
     // Print padding
     while (pos < width)
     {
-        putc(padding);
+        format_putc(out, padding);
         width--;
     }
 
     // print number in reverse order
     while (--pos >= 0)
-        putc(buffer[pos]);
+        format_putc(out, buffer[pos]);
 }
 
-void printf_signed(long long number, int radix, int width, char padding, bool uppercase)
+static void format_signed(format_out_t* out, long long number, int radix, int width, char padding, bool uppercase)
 {
-    if (number < 0)
-    {
-        if (padding == '0')
-        {
-            putc('-');
-            printf_unsigned(-number, radix, width > 0 ? width - 1 : 0, padding, uppercase);
-        }
-        else
-        {
-            // For space padding, we need to print spaces before the negative sign
-            char buffer[32];
-            int pos = 0;
-            unsigned long long abs_val = -number;
-            const char* hexChars = uppercase ? "0123456789ABCDEF" : "0123456789abcdef";
-            
-            do {
-                buffer[pos++] = hexChars[abs_val % radix];
-                abs_val /= radix;
-            } while (abs_val > 0);
-
-            // padding = width - (digits + sign)
-            while (pos + 1 < width)
-            {
-                putc(padding);
-                width--;
-            }
+    if (number >= 0) {
+        format_unsigned(out, number, radix, width, padding, uppercase);
+        return;
+    }
 
-            putc('-');
-            while (--pos >= 0)
-                putc(buffer[pos]);
-        }
+    unsigned long long abs_val = -(unsigned long long)number;
+    if (padding == '0')
+    {
+        // Zeros go between the sign and the digits
+        format_putc(out, '-');
+        format_unsigned(out, abs_val, radix, width > 0 ? width - 1 : 0, padding, uppercase);
+        return;
     }
-    else printf_unsigned(number, radix, width, padding, uppercase);
-}
 
-#define PRINTF_STATE_NORMAL         0
-#define PRINTF_STATE_LENGTH         1
-#define PRINTF_STATE_LENGTH_SHORT   2
-#define PRINTF_STATE_LENGTH_LONG    3
-#define PRINTF_STATE_SPEC           4
-#define PRINTF_STATE_FLAGS          5
-#define PRINTF_STATE_WIDTH          6
+    // For space padding, we need to print spaces before the negative sign
+    char buffer[64];
+    int pos = 0;
+    const char* hexChars = uppercase ? "0123456789ABCDEF" : "0123456789abcdef";
+    do {
+        buffer[pos++] = hexChars[abs_val % radix];
+        abs_val /= radix;
+    } while (abs_val > 0);
 
-#define PRINTF_LENGTH_DEFAULT       0
-#define PRINTF_LENGTH_SHORT_SHORT   1
-#define PRINTF_LENGTH_SHORT         2
-#define PRINTF_LENGTH_LONG          3
-#define PRINTF_LENGTH_LONG_LONG     4
+    // padding = width - (digits + sign)
+    while (pos + 1 < width)
+    {
+        format_putc(out, padding);
+        width--;
+    }
 
-void printf(const char* fmt, ...)
+    format_putc(out, '-');
+    while (--pos >= 0)
+        format_putc(out, buffer[pos]);
+}
+
+// Basic double to string for cJSON support
+static void format_float(format_out_t* out, double number, int precision)
 {
-    bool prev = g_ConsoleAutoSwap;
-    if (g_ConsoleDelay == 0) g_ConsoleAutoSwap = false;
+    if (number < 0) {
+        format_putc(out, '-');
+        number = -number;
+    }
 
-    va_list args;
-    va_start(args, fmt);
+    long long int_part = (long long)number;
+    format_signed(out, int_part, 10, 0, ' ', false);
 
+    if (precision > 0) {
+        format_putc(out, '.');
+        double diff = number - (double)int_part;
+        while (precision--) {
+            diff *= 10;
+            int digit = (int)diff;
+            format_putc(out, digit + '0');
+            diff -= digit;
+        }
+    }
+}
+
+// The one formatter behind printf and sprintf
+static void format(format_out_t* out, const char* fmt, va_list args)
+{
     int state = PRINTF_STATE_NORMAL;
     int length = PRINTF_LENGTH_DEFAULT;
     int radix = 10;
@@ -530,7 +664,7 @@ void printf(const char* fmt, ...)
                                 padding = ' ';
                                 uppercase = false;
                                 break;
-                    default:    putc(*fmt);
+                    default:    format_putc(out, *fmt);
                                 break;
                 }
                 break;
@@ -600,14 +734,18 @@ void printf(const char* fmt, ...)
             PRINTF_STATE_SPEC_:
                 switch (*fmt)
                 {
-                    case 'c':   putc((char)va_arg(args, int));
+                    case 'c':   format_putc(out, (char)va_arg(args, int));
                                 break;
 
-                    case 's':   
-                                puts(va_arg(args, const char*));
+                    case 's':
+                    {
+                                const char* s = va_arg(args, const char*);
+                                if (!s) s = "(null)";
+                                while (*s) format_putc(out, *s++);
                                 break;
+                    }
 
-                    case '%':   putc('%');
+                    case '%':   format_putc(out, '%');
                                 break;
 
                     case 'd':
@@ -627,6 +765,10 @@ void printf(const char* fmt, ...)
                     case 'o':   radix = 8; sign = false; number = true;
                                 break;
 
+                    case 'f':
+                    case 'g':   format_float(out, va_arg(args, double), 6);
+                                break;
+
                     // ignore invalid spec
                     default:    break;
                 }
@@ -637,15 +779,19 @@ void printf(const char* fmt, ...)
                     {
                         switch (length)
                         {
-                        case PRINTF_LENGTH_SHORT_SHORT:
-                        case PRINTF_LENGTH_SHORT:
-                        case PRINTF_LENGTH_DEFAULT:     printf_signed(va_arg(args, int), radix, width, padding, uppercase);
+                        case PRINTF_LENGTH_SHORT_SHORT: format_signed(out, (signed char)va_arg(args, int), radix, width, padding, uppercase);
+                                                        break;
+
+                        case PRINTF_LENGTH_SHORT:       format_signed(out, (short)va_arg(args, int), radix, width, padding, uppercase);
                                                         break;
 
-                        case PRINTF_LENGTH_LONG:        printf_signed(va_arg(args, long), radix, width, padding, uppercase);
+                        case PRINTF_LENGTH_DEFAULT:     format_signed(out, va_arg(args, int), radix, width, padding, uppercase);
                                                         break;
 
-                        case PRINTF_LENGTH_LONG_LONG:   printf_signed(va_arg(args, long long), radix, width, padding, uppercase);
+                        case PRINTF_LENGTH_LONG:        format_signed(out, va_arg(args, long), radix, width, padding, uppercase);
+                                                        break;
+
+                        case PRINTF_LENGTH_LONG_LONG:   format_signed(out, va_arg(args, long long), radix, width, padding, uppercase);
                                                         break;
                         }
                     }
@@ -653,15 +799,19 @@ void printf(const char* fmt, ...)
                     {
                         switch (length)
                         {
-                        case PRINTF_LENGTH_SHORT_SHORT:
-                        case PRINTF_LENGTH_SHORT:
-                        case PRINTF_LENGTH_DEFAULT:     printf_unsigned(va_arg(args, unsigned int), radix, width, padding, uppercase);
+                        case PRINTF_LENGTH_SHORT_SHORT: format_unsigned(out, (unsigned char)va_arg(args, unsigned int), radix, width, padding, uppercase);
+                                                        break;
+
+                        case PRINTF_LENGTH_SHORT:       format_unsigned(out, (unsigned short)va_arg(args, unsigned int), radix, width, padding, uppercase);
+                                                        break;
+
+                        case PRINTF_LENGTH_DEFAULT:     format_unsigned(out, va_arg(args, unsigned int), radix, width, padding, uppercase);
                                                         break;
                                                         
-                        case PRINTF_LENGTH_LONG:        printf_unsigned(va_arg(args, unsigned  long), radix, width, padding, uppercase);
+                        case PRINTF_LENGTH_LONG:        format_unsigned(out, va_arg(args, unsigned  long), radix, width, padding, uppercase);
                                                         break;
 
-                        case PRINTF_LENGTH_LONG_LONG:   printf_unsigned(va_arg(args, unsigned  long long), radix, width, padding, uppercase);
+                        case PRINTF_LENGTH_LONG_LONG:   format_unsigned(out, va_arg(args, unsigned  long long), radix, width, padding, uppercase);
                                                         break;
                         }
                     }
@@ -681,12 +831,31 @@ void printf(const char* fmt, ...)
 
         fmt++;
     }
+}
+
+static void printf_flush(format_out_t* out)
+{
+    console_write(out->buffer, out->pos);
+}
+
+void printf(const char* fmt, ...)
+{
+    // One present for the whole call, however many line buffers it takes
+    bool prev = g_ConsoleAutoSwap;
+    g_ConsoleAutoSwap = false;
+
+    char line[CONSOLE_LINE_BUFFER];
+    format_out_t out = { line, 0, sizeof(line), 0, printf_flush };
 
+    va_list args;
+    va_start(args, fmt);
+    format(&out, fmt, args);
     va_end(args);
+    printf_flush(&out);
 
     g_ConsoleAutoSwap = prev;
-    if (g_ConsoleAutoSwap && g_DoubleBufferEnabled)
-        graphics_swap_buffer();
+    if (g_ConsoleAutoSwap)
+        console_present();
 }
 
 void print_buffer(const char* msg, const void* buffer, uint32_t count)
@@ -702,130 +871,11 @@ void print_buffer(const char* msg, const void* buffer, uint32_t count)
     puts("\n");
 }
 
-// SprintF implementation that writes to a string buffer instead of the console and i want to die now please and thank you
-static void sprintf_unsigned(char** out, unsigned long long number, int radix, int width, char padding, bool uppercase)
-{
-    char buffer[64];
-    int pos = 0;
-    const char* hexChars = uppercase ? "0123456789ABCDEF" : "0123456789abcdef";
-
-    do {
-        buffer[pos++] = hexChars[number % radix];
-        number /= radix;
-    } while (number > 0);
-
-    while (pos < width) {
-        *(*out)++ = padding;
-        width--;
-    }
-
-    while (--pos >= 0)
-        *(*out)++ = buffer[pos];
-}
-
-static void sprintf_signed(char** out, long long number, int radix, int width, char padding, bool uppercase)
-{
-    if (number < 0) {
-        *(*out)++ = '-';
-        sprintf_unsigned(out, -number, radix, width > 0 ? width - 1 : 0, padding, uppercase);
-    } else {
-        sprintf_unsigned(out, number, radix, width, padding, uppercase);
-    }
-}
-
-// Basic double to string for cJSON support
-static void sprintf_float(char** out, double number, int precision) {
-    if (number < 0) {
-        *(*out)++ = '-';
-        number = -number;
-    }
-
-    long long int_part = (long long)number;
-    sprintf_signed(out, int_part, 10, 0, ' ', false);
-
-    if (precision > 0) {
-        *(*out)++ = '.';
-        double diff = number - (double)int_part;
-        while (precision--) {
-            diff *= 10;
-            int digit = (int)diff;
-            *(*out)++ = digit + '0';
-            diff -= digit;
-        }
-    }
-}
-
 int vsprintf(char* str, const char* fmt, va_list args) {
-    char* start = str;
-    int state = PRINTF_STATE_NORMAL;
-    int length = PRINTF_LENGTH_DEFAULT;
-    int radix = 10;
-    bool sign = false;
-    bool number = false;
-    bool uppercase = false;
-    int width = 0;
-    char padding = ' ';
-
-    while (*fmt) {
-        switch (state) {
-            case PRINTF_STATE_NORMAL:
-                if (*fmt == '%') {
-                    state = PRINTF_STATE_FLAGS;
-                    width = 0; padding = ' '; uppercase = false;
-                } else {
-                    *str++ = *fmt;
-                }
-                break;
-
-            case PRINTF_STATE_FLAGS:
-                if (*fmt == '0') { padding = '0'; state = PRINTF_STATE_WIDTH; }
-                else { state = PRINTF_STATE_WIDTH; goto WIDTH; }
-                break;
-
-            case PRINTF_STATE_WIDTH:
-            WIDTH:
-                if (*fmt >= '0' && *fmt <= '9') width = width * 10 + (*fmt - '0');
-                else { state = PRINTF_STATE_LENGTH; goto LENGTH; }
-                break;
-
-            case PRINTF_STATE_LENGTH:
-            LENGTH:
-                if (*fmt == 'h') state = PRINTF_STATE_LENGTH_SHORT;
-                else if (*fmt == 'l') state = PRINTF_STATE_LENGTH_LONG;
-                else { state = PRINTF_STATE_SPEC; goto SPEC; }
-                break;
-
-            case PRINTF_STATE_SPEC:
-            SPEC:
-                number = false;
-                switch (*fmt) {
-                    case 'c': *str++ = (char)va_arg(args, int); break;
-                    case 's': {
-                        char* s = va_arg(args, char*);
-                        while (*s) *str++ = *s++;
-                        break;
-                    }
-                    case 'd': case 'i': radix = 10; sign = true; number = true; break;
-                    case 'u': radix = 10; sign = false; number = true; break;
-                    case 'X': uppercase = true; radix = 16; sign = false; number = true; break;
-                    case 'x': radix = 16; sign = false; number = true; break;
-                    case 'f': case 'g':
-                        sprintf_float(&str, va_arg(args, double), 6);
-                        break;
-                    case '%': *str++ = '%'; break;
-                }
-
-                if (number) {
-                    if (sign) sprintf_signed(&str, va_arg(args, long long), radix, width, padding, uppercase);
-                    else sprintf_unsigned(&str, va_arg(args, unsigned long long), radix, width, padding, uppercase);
-                }
-                state = PRINTF_STATE_NORMAL;
-                break;
-        }
-        fmt++;
-    }
-    *str = '\0';
-    return str - start;
+    format_out_t out = { str, 0, 0, 0, NULL };
+    format(&out, fmt, args);
+    str[out.pos] = '\0';
+    return out.total;
 }
 
 int sprintf(char* str, const char* format, ...)
@@ -3,6 +3,13 @@
 #include "stdbool.h"
 #include "arch/i686/screen_defs.h"
 
+// Console output is presented at most once per frame (the timer runs at 100 Hz)
+#define CONSOLE_FRAME_MS        16
+// printf formats into a line buffer of this size before drawing
+#define CONSOLE_LINE_BUFFER     256
+// Longest run of changed cells the renderer draws in one call
+#define CONSOLE_RENDER_SPAN     256
+
 extern bool g_ConsoleAutoSwap;
 extern uint32_t g_ConsoleDelay;
 
@@ -11,6 +18,10 @@ void console_set_font_scale(int scale);
 void clrscr();
 void putc(char c);
 void puts(const char* str);
+// Draws `len` characters with a single present at the end
+void console_write(const char* str, int len);
+// Presents output that was held back by frame pacing. Call before waiting.
+void console_flush();
 void printf(const char* fmt, ...);
 void print_buffer(const char* msg, const void* buffer, uint32_t count);
 char getchr(int x, int y);
@@ -21,6 +32,8 @@ void setcursor(int x, int y);
 void scrollback(int lines);
 void scrollforward(int lines);
 void console_refresh();
+// Forgets what's on screen so the next present redraws every cell
+void console_invalidate();
 void refresh_screen_color();
 
 void view_scrollback_up();
@@ -0,0 +1,54 @@
+#include "lockstat.h"
+#include "spinlock.h"
+#include "stddef.h"
+
+// Unnamed, so taking it never registers anything
+static spinlock_t g_RegistryLock = SPINLOCK_INIT;
+static lock_stats_t* g_Registered = NULL;
+
+void lock_stats_register(lock_stats_t* stats) {
+    uint32_t flags = spin_lock_irqsave(&g_RegistryLock);
+    // Two CPUs can race here for the same lock's first acquisition
+    if (!stats->registered) {
+        stats->next = g_Registered;
+        g_Registered = stats;
+        stats->registered = true;
+    }
+    spin_unlock_irqrestore(&g_RegistryLock, flags);
+}
+
+int lock_stats_snapshot(lock_stats_info_t* out, int max) {
+    uint32_t flags = spin_lock_irqsave(&g_RegistryLock);
+    int count = 0;
+    for (lock_stats_t* stats = g_Registered; stats && count < max; stats = stats->next) {
+        lock_stats_info_t info;
+        info.name = stats->name;
+        info.kind = stats->kind;
+        info.acquisitions = stats->acquisitions;
+        info.contended = stats->contended;
+        info.waits = stats->waits;
+        info.max_hold_cycles = stats->max_hold_cycles;
+
+        // Insertion sort by contention; the list is short
+        int i = count++;
+        while (i > 0 && (out[i - 1].contended < info.contended ||
+                         (out[i - 1].contended == info.contended && out[i - 1].waits < info.waits))) {
+            out[i] = out[i - 1];
+            i--;
+        }
+        out[i] = info;
+    }
+    spin_unlock_irqrestore(&g_RegistryLock, flags);
+    return count;
+}
+
+void lock_stats_reset() {
+    uint32_t flags = spin_lock_irqsave(&g_RegistryLock);
+    for (lock_stats_t* stats = g_Registered; stats; stats = stats->next) {
+        stats->acquisitions = 0;
+        stats->contended = 0;
+        stats->waits = 0;
+        stats->max_hold_cycles = 0;
+    }
+    spin_unlock_irqrestore(&g_RegistryLock, flags);
+}
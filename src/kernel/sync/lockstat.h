@@ -0,0 +1,101 @@
+#pragma once
+
+#include <stdint.h>
+#include "stdbool.h"
+#include "stddef.h"
+#include <arch/i686/cpu.h>
+
+// Contention statistics for named locks, compiled in with LOCK_STATS (see
+// the Makefile) and listed by the `locks` command.
+//
+// A lock is counted only if it was given a name; unnamed locks (one per
+// wait queue, say) cost nothing beyond the empty field. A named lock joins
+// the list on its first acquisition and stays there, so it must never be
+// freed. Counters are updated while the lock is held and read without it,
+// which is good enough for finding the hot ones.
+
+typedef enum {
+    LOCK_KIND_SPIN,
+    LOCK_KIND_TICKET,
+    LOCK_KIND_RW,
+    LOCK_KIND_MUTEX,
+} lock_kind_t;
+
+typedef struct lock_stats {
+    const char* name;               // NULL: not counted
+    lock_kind_t kind;
+    volatile bool registered;
+    struct lock_stats* next;
+    uint64_t acquisitions;
+    uint64_t contended;             // acquisitions that found the lock taken
+    uint64_t waits;                 // spin iterations, or sleeps for mutexes and rwlocks
+    uint64_t max_hold_cycles;       // exclusive holds only
+    uint64_t acquired_at;           // TSC at the last exclusive acquisition
+} lock_stats_t;
+
+#define LOCK_STATS_INIT(lock_name, lock_kind) {   \
+    .name = (lock_name),                            \
+    .kind = (lock_kind),                            \
+    .registered = false,                            \
+    .next = NULL,                                   \
+    .acquisitions = 0,                              \
+    .contended = 0,                                 \
+    .waits = 0,                                     \
+    .max_hold_cycles = 0,                           \
+    .acquired_at = 0,                               \
+}
+
+#define LOCK_STATS_MAX_INFO 32
+
+typedef struct {
+    const char* name;
+    lock_kind_t kind;
+    uint64_t acquisitions;
+    uint64_t contended;
+    uint64_t waits;
+    uint64_t max_hold_cycles;
+} lock_stats_info_t;
+
+void lock_stats_register(lock_stats_t* stats);
+// Copies out up to `max` named locks, most contended first. Returns 0 when
+// built without LOCK_STATS.
+int lock_stats_snapshot(lock_stats_info_t* out, int max);
+// Zeroes every counter, e.g. before a workload of interest
+void lock_stats_reset();
+
+#ifdef LOCK_STATS
+
+// Call with the lock just taken exclusively
+static inline void lock_stats_acquired(lock_stats_t* stats, uint32_t waits)
+{
+    if (!stats->name) return;
+    if (!stats->registered) lock_stats_register(stats);
+    stats->acquisitions++;
+    if (waits) {
+        stats->contended++;
+        stats->waits += waits;
+    }
+    stats->acquired_at = i686_ReadTSC();
+}
+
+// Shared holders overlap, so they don't stamp a hold time
+static inline void lock_stats_shared(lock_stats_t* stats, uint32_t waits)
+{
+    if (!stats->name) return;
+    if (!stats->registered) lock_stats_register(stats);
+    stats->acquisitions++;
+    if (waits) {
+        stats->contended++;
+        stats->waits += waits;
+    }
+}
+
+// Call while still holding the lock
+static inline void lock_stats_released(lock_stats_t* stats)
+{
+    if (!stats->name) return;
+    uint64_t held = i686_ReadTSC() - stats->acquired_at;
+    if (held > stats->max_hold_cycles) stats->max_hold_cycles = held;
+}
+
+#endif
@@ -0,0 +1,102 @@
+#include "mutex.h"
+#include "stddef.h"
+
+void mutex_init(mutex_t* mutex) {
+    spin_init(&mutex->guard);
+    mutex->locked = false;
+    mutex->owner = NULL;
+    wait_queue_init(&mutex->waiters);
+#ifdef LOCK_STATS
+    mutex->stats = (lock_stats_t)LOCK_STATS_INIT(NULL, LOCK_KIND_MUTEX);
+#endif
+}
+
+void mutex_init_named(mutex_t* mutex, const char* name) {
+    mutex_init(mutex);
+#ifdef LOCK_STATS
+    mutex->stats.name = name;
+#else
+    (void)name;
+#endif
+}
+
+// Guard held; sleeps until the mutex is free
+static void mutex_acquire_locked(mutex_t* mutex) {
+    uint32_t sleeps = 0;
+    while (mutex->locked) {
+        wait_queue_wait(&mutex->waiters, &mutex->guard);
+        sleeps++;
+    }
+    mutex->locked = true;
+    mutex->owner = thread_current();
+#ifdef LOCK_STATS
+    lock_stats_acquired(&mutex->stats, sleeps);
+#endif
+}
+
+// Guard held. Returns whether anyone needs waking once the guard is dropped;
+// a wake can switch threads, which mustn't happen with the guard held.
+static bool mutex_release_locked(mutex_t* mutex) {
+#ifdef LOCK_STATS
+    lock_stats_released(&mutex->stats);
+#endif
+    mutex->locked = false;
+    mutex->owner = NULL;
+    // Waiters queue with the guard held, so this can't miss one
+    return !wait_queue_empty(&mutex->waiters);
+}
+
+void mutex_lock(mutex_t* mutex) {
+    uint32_t flags = spin_lock_irqsave(&mutex->guard);
+    mutex_acquire_locked(mutex);
+    spin_unlock_irqrestore(&mutex->guard, flags);
+}
+
+bool mutex_trylock(mutex_t* mutex) {
+    uint32_t flags = spin_lock_irqsave(&mutex->guard);
+    bool taken = !mutex->locked;
+    if (taken) mutex_acquire_locked(mutex);
+    spin_unlock_irqrestore(&mutex->guard, flags);
+    return taken;
+}
+
+void mutex_unlock(mutex_t* mutex) {
+    uint32_t flags = spin_lock_irqsave(&mutex->guard);
+    bool wake = mutex_release_locked(mutex);
+    spin_unlock_irqrestore(&mutex->guard, flags);
+
+    // The woken thread retries; someone else may get in first, which is fine
+    if (wake) wait_queue_wake_one(&mutex->waiters);
+}
+
+bool mutex_held(mutex_t* mutex) {
+    return mutex->locked && mutex->owner == thread_current();
+}
+
+void condvar_init(condvar_t* cond) {
+    wait_queue_init(&cond->waiters);
+}
+
+void condvar_wait(condvar_t* cond, mutex_t* mutex) {
+    uint32_t flags = spin_lock_irqsave(&mutex->guard);
+    // Queued before the mutex is released: a signaller has to take the
+    // mutex to change the condition, so it can't signal before we're queued
+    wait_queue_prepare(&cond->waiters);
+    bool wake = mutex_release_locked(mutex);
+    spin_unlock(&mutex->guard);
+
+    if (wake) wait_queue_wake_one(&mutex->waiters);
+    thread_block();
+
+    spin_lock(&mutex->guard);
+    mutex_acquire_locked(mutex);
+    spin_unlock_irqrestore(&mutex->guard, flags);
+}
+
+void condvar_signal(condvar_t* cond) {
+    wait_queue_wake_one(&cond->waiters);
+}
+
+void condvar_broadcast(condvar_t* cond) {
+    wait_queue_wake_all(&cond->waiters);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "stdbool.h"
+#include "spinlock.h"
+#include <sched/wait.h>
+
+// Sleeping locks for thread context. A thread that finds the mutex taken
+// blocks on its wait queue instead of spinning, so it may be held across
+// disk I/O or sleep_ms(). Not for interrupt handlers, and not recursive.
+//
+// Condition variables pair with a mutex in the usual way:
+//
+//     mutex_lock(&mutex);
+//     while (!condition) condvar_wait(&cond, &mutex);
+//     ...
+//     mutex_unlock(&mutex);
+//
+// and whoever changes the condition does so holding the same mutex before
+// calling condvar_signal/broadcast.
+
+typedef struct {
+    spinlock_t guard;               // everything below
+    bool locked;
+    thread_t* owner;                // NULL before the scheduler runs
+    wait_queue_t waiters;
+#ifdef LOCK_STATS
+    lock_stats_t stats;
+#endif
+} mutex_t;
+
+#ifdef LOCK_STATS
+#define MUTEX_INIT_NAMED(name) { .guard = SPINLOCK_INIT, .locked = false, .owner = NULL, \
+                                 .waiters = WAIT_QUEUE_INIT, .stats = LOCK_STATS_INIT(name, LOCK_KIND_MUTEX) }
+#define MUTEX_INIT MUTEX_INIT_NAMED(NULL)
+#else
+#define MUTEX_INIT { .guard = SPINLOCK_INIT, .locked = false, .owner = NULL, .waiters = WAIT_QUEUE_INIT }
+#define MUTEX_INIT_NAMED(name) MUTEX_INIT
+#endif
+
+typedef struct {
+    wait_queue_t waiters;
+} condvar_t;
+
+#define CONDVAR_INIT { WAIT_QUEUE_INIT }
+
+void mutex_init(mutex_t* mutex);
+// `name` must outlive the mutex, and the mutex must never be freed
+void mutex_init_named(mutex_t* mutex, const char* name);
+void mutex_lock(mutex_t* mutex);
+bool mutex_trylock(mutex_t* mutex);
+void mutex_unlock(mutex_t* mutex);
+// Whether the calling thread holds it, for assertions
+bool mutex_held(mutex_t* mutex);
+
+void condvar_init(condvar_t* cond);
+// Unlocks `mutex`, sleeps until signalled, and locks it again. Wake-ups can
+// be spurious, so always wait in a loop on the condition.
+void condvar_wait(condvar_t* cond, mutex_t* mutex);
+void condvar_signal(condvar_t* cond);
+void condvar_broadcast(condvar_t* cond);
@@ -0,0 +1,80 @@
+#include "rwlock.h"
+#include "stddef.h"
+
+void rwlock_init(rwlock_t* lock) {
+    spin_init(&lock->guard);
+    lock->readers = 0;
+    lock->writer = false;
+    lock->writers_waiting = 0;
+    wait_queue_init(&lock->read_waiters);
+    wait_queue_init(&lock->write_waiters);
+#ifdef LOCK_STATS
+    lock->stats = (lock_stats_t)LOCK_STATS_INIT(NULL, LOCK_KIND_RW);
+#endif
+}
+
+void rwlock_init_named(rwlock_t* lock, const char* name) {
+    rwlock_init(lock);
+#ifdef LOCK_STATS
+    lock->stats.name = name;
+#else
+    (void)name;
+#endif
+}
+
+void rwlock_read_lock(rwlock_t* lock) {
+    uint32_t flags = spin_lock_irqsave(&lock->guard);
+    uint32_t sleeps = 0;
+    while (lock->writer || lock->writers_waiting) {
+        wait_queue_wait(&lock->read_waiters, &lock->guard);
+        sleeps++;
+    }
+    lock->readers++;
+#ifdef LOCK_STATS
+    lock_stats_shared(&lock->stats, sleeps);
+#endif
+    spin_unlock_irqrestore(&lock->guard, flags);
+}
+
+void rwlock_read_unlock(rwlock_t* lock) {
+    uint32_t flags = spin_lock_irqsave(&lock->guard);
+    lock->readers--;
+    bool wake_writer = lock->readers == 0 && lock->writers_waiting;
+    spin_unlock_irqrestore(&lock->guard, flags);
+
+    // Woken outside the guard: a wake can switch threads
+    if (wake_writer) wait_queue_wake_one(&lock->write_waiters);
+}
+
+void rwlock_write_lock(rwlock_t* lock) {
+    uint32_t flags = spin_lock_irqsave(&lock->guard);
+    uint32_t sleeps = 0;
+    // Counted while waiting, which holds back new readers
+    lock->writers_waiting++;
+    while (lock->writer || lock->readers) {
+        wait_queue_wait(&lock->write_waiters, &lock->guard);
+        sleeps++;
+    }
+    lock->writers_waiting--;
+    lock->writer = true;
+#ifdef LOCK_STATS
+    lock_stats_acquired(&lock->stats, sleeps);
+#endif
+    spin_unlock_irqrestore(&lock->guard, flags);
+}
+
+void rwlock_write_unlock(rwlock_t* lock) {
+    uint32_t flags = spin_lock_irqsave(&lock->guard);
+#ifdef LOCK_STATS
+    lock_stats_released(&lock->stats);
+#endif
+    lock->writer = false;
+    bool wake_writer = lock->writers_waiting != 0;
+    spin_unlock_irqrestore(&lock->guard, flags);
+
+    if (wake_writer) {
+        wait_queue_wake_one(&lock->write_waiters);
+    } else {
+        wait_queue_wake_all(&lock->read_waiters);
+    }
+}
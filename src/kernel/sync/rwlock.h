@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+#include "stdbool.h"
+#include "spinlock.h"
+#include <sched/wait.h>
+
+// Sleeping reader-writer lock for read-mostly data such as lookup caches:
+// any number of readers, or one writer. Waiting writers go first, so a
+// steady stream of readers can't starve them. Thread context only, not
+// recursive, and a reader can't upgrade to writer.
+
+typedef struct {
+    spinlock_t guard;               // everything below
+    uint32_t readers;
+    bool writer;
+    uint32_t writers_waiting;
+    wait_queue_t read_waiters;
+    wait_queue_t write_waiters;
+#ifdef LOCK_STATS
+    lock_stats_t stats;
+#endif
+} rwlock_t;
+
+#ifdef LOCK_STATS
+#define RWLOCK_INIT_NAMED(name) { .guard = SPINLOCK_INIT, .readers = 0, .writer = false, .writers_waiting = 0, \
+                                  .read_waiters = WAIT_QUEUE_INIT, .write_waiters = WAIT_QUEUE_INIT, \
+                                  .stats = LOCK_STATS_INIT(name, LOCK_KIND_RW) }
+#define RWLOCK_INIT RWLOCK_INIT_NAMED(NULL)
+#else
+#define RWLOCK_INIT { .guard = SPINLOCK_INIT, .readers = 0, .writer = false, .writers_waiting = 0, \
+                      .read_waiters = WAIT_QUEUE_INIT, .write_waiters = WAIT_QUEUE_INIT }
+#define RWLOCK_INIT_NAMED(name) RWLOCK_INIT
+#endif
+
+void rwlock_init(rwlock_t* lock);
+// `name` must outlive the lock, and the lock must never be freed
+void rwlock_init_named(rwlock_t* lock, const char* name);
+void rwlock_read_lock(rwlock_t* lock);
+void rwlock_read_unlock(rwlock_t* lock);
+void rwlock_write_lock(rwlock_t* lock);
+void rwlock_write_unlock(rwlock_t* lock);
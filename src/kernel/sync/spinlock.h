@@ -0,0 +1,113 @@
+#pragma once
+
+#include <stdint.h>
+#include "lockstat.h"
+
+// Busy-wait lock for short critical sections. Use the _irqsave variants for
+// any data that is also touched from interrupt handlers, otherwise an IRQ on
+// the same CPU can spin forever on a lock its own CPU already holds.
+//
+// Locks initialised with a name show up in the `locks` command; see
+// lockstat.h.
+
+#define EFLAGS_IF 0x200
+
+typedef struct {
+    volatile uint32_t locked;
+#ifdef LOCK_STATS
+    lock_stats_t stats;
+#endif
+} spinlock_t;
+
+#ifdef LOCK_STATS
+#define SPINLOCK_INIT { .locked = 0, .stats = LOCK_STATS_INIT(NULL, LOCK_KIND_SPIN) }
+#define SPINLOCK_INIT_NAMED(name) { .locked = 0, .stats = LOCK_STATS_INIT(name, LOCK_KIND_SPIN) }
+#else
+#define SPINLOCK_INIT { .locked = 0 }
+#define SPINLOCK_INIT_NAMED(name) SPINLOCK_INIT
+#endif
+
+static inline void spin_init(spinlock_t* lock)
+{
+    lock->locked = 0;
+#ifdef LOCK_STATS
+    lock->stats = (lock_stats_t)LOCK_STATS_INIT(NULL, LOCK_KIND_SPIN);
+#endif
+}
+
+// `name` must outlive the lock, and the lock must never be freed
+static inline void spin_init_named(spinlock_t* lock, const char* name)
+{
+    lock->locked = 0;
+#ifdef LOCK_STATS
+    lock->stats = (lock_stats_t)LOCK_STATS_INIT(name, LOCK_KIND_SPIN);
+#else
+    (void)name;
+#endif
+}
+
+// Disables interrupts and returns the previous EFLAGS so they can be restored.
+static inline uint32_t irq_save(void)
+{
+    uint32_t flags;
+    __asm__ volatile("pushfl\n\tpopl %0\n\tcli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+static inline int irq_enabled(void)
+{
+    uint32_t flags;
+    __asm__ volatile("pushfl\n\tpopl %0" : "=r"(flags));
+    return (flags & EFLAGS_IF) != 0;
+}
+
+static inline void irq_restore(uint32_t flags)
+{
+    if (flags & EFLAGS_IF)
+        __asm__ volatile("sti" : : : "memory");
+}
+
+static inline void spin_lock(spinlock_t* lock)
+{
+    uint32_t spins = 0;
+    while (__sync_lock_test_and_set(&lock->locked, 1)) {
+        // Spin on a plain read so we don't hammer the bus with locked ops
+        do {
+            __asm__ volatile("pause");
+            spins++;
+        } while (lock->locked);
+    }
+#ifdef LOCK_STATS
+    lock_stats_acquired(&lock->stats, spins);
+#endif
+}
+
+static inline int spin_trylock(spinlock_t* lock)
+{
+    if (__sync_lock_test_and_set(&lock->locked, 1)) return 0;
+#ifdef LOCK_STATS
+    lock_stats_acquired(&lock->stats, 0);
+#endif
+    return 1;
+}
+
+static inline void spin_unlock(spinlock_t* lock)
+{
+#ifdef LOCK_STATS
+    lock_stats_released(&lock->stats);
+#endif
+    __sync_lock_release(&lock->locked);
+}
+
+static inline uint32_t spin_lock_irqsave(spinlock_t* lock)
+{
+    uint32_t flags = irq_save();
+    spin_lock(lock);
+    return flags;
+}
+
+static inline void spin_unlock_irqrestore(spinlock_t* lock, uint32_t flags)
+{
+    spin_unlock(lock);
+    irq_restore(flags);
+}
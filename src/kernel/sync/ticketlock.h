@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdint.h>
+#include "spinlock.h"
+
+// Spinlock that hands out the lock in arrival order. Each waiter takes a
+// ticket and spins until `owner` reaches it, so no CPU can be starved by
+// others that happen to win the cache line more often. Same rules as
+// spinlock_t otherwise, _irqsave variants included.
+
+typedef struct {
+    volatile uint32_t next;         // next ticket to hand out
+    volatile uint32_t owner;        // ticket now holding the lock
+#ifdef LOCK_STATS
+    lock_stats_t stats;
+#endif
+} ticketlock_t;
+
+#ifdef LOCK_STATS
+#define TICKETLOCK_INIT { .next = 0, .owner = 0, .stats = LOCK_STATS_INIT(NULL, LOCK_KIND_TICKET) }
+#define TICKETLOCK_INIT_NAMED(name) { .next = 0, .owner = 0, .stats = LOCK_STATS_INIT(name, LOCK_KIND_TICKET) }
+#else
+#define TICKETLOCK_INIT { .next = 0, .owner = 0 }
+#define TICKETLOCK_INIT_NAMED(name) TICKETLOCK_INIT
+#endif
+
+static inline void ticket_lock(ticketlock_t* lock)
+{
+    uint32_t ticket = __sync_fetch_and_add(&lock->next, 1);
+    uint32_t spins = 0;
+    while (__atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE) != ticket) {
+        __asm__ volatile("pause");
+        spins++;
+    }
+#ifdef LOCK_STATS
+    lock_stats_acquired(&lock->stats, spins);
+#endif
+}
+
+static inline int ticket_trylock(ticketlock_t* lock)
+{
+    // Free exactly when no ticket is outstanding
+    uint32_t owner = __atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE);
+    if (!__sync_bool_compare_and_swap(&lock->next, owner, owner + 1)) return 0;
+#ifdef LOCK_STATS
+    lock_stats_acquired(&lock->stats, 0);
+#endif
+    return 1;
+}
+
+static inline void ticket_unlock(ticketlock_t* lock)
+{
+#ifdef LOCK_STATS
+    lock_stats_released(&lock->stats);
+#endif
+    // Only the holder writes owner, so no locked op is needed
+    __atomic_store_n(&lock->owner, lock->owner + 1, __ATOMIC_RELEASE);
+}
+
+static inline uint32_t ticket_lock_irqsave(ticketlock_t* lock)
+{
+    uint32_t flags = irq_save();
+    ticket_lock(lock);
+    return flags;
+}
+
+static inline void ticket_unlock_irqrestore(ticketlock_t* lock, uint32_t flags)
+{
+    ticket_unlock(lock);
+    irq_restore(flags);
+}
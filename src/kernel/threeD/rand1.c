@@ -5,7 +5,7 @@
 #include "memory.h"
 #include "stdlib.h"
 #include "time.h"
-#include "font.h"
+#include "glyph.h"
 #include "arch/i686/keyboard.h"
 #include "string.h"
 
@@ -25,57 +25,14 @@ void handle_rand4() {
     rand4_test();
 }
 
-// Helper to draw a single character to the VBE framebuffer
-static void draw_char_vbe(int x, int y, char c, uint32_t color) {
-    if (c < 32 || c > 127) return;
-    const uint8_t* glyph = font8x8_basic[c - 32];
-    for (int row = 0; row < 8; row++) {
-        for (int col = 0; col < 8; col++) {
-            if ((glyph[row] >> (7 - col)) & 1) {
-                draw_pixel(x + col, y + row, color);
-            }
-        }
-    }
-}
-
-// Helper to draw a string to the VBE framebuffer
-static void draw_string_vbe(int x, int y, const char* str, uint32_t color) {
-    while (*str) {
-        draw_char_vbe(x, y, *str, color);
-        x += 8;
-        str++;
-    }
-}
-
-// Helper to draw a character scaled by 1.4x (~11x11 pixels)
-static void draw_char_vbe_large(int x, int y, char c, uint32_t color) {
-    if (c < 32 || c > 127) return;
-    const uint8_t* glyph = font8x8_basic[c - 32];
-    // 8 * 1.4 = 11.2, we use 11
-    for (int row = 0; row < 11; row++) {
-        for (int col = 0; col < 11; col++) {
-            // Map 11x11 coordinate back to 8x8 bitmap
-            int src_x = (col * 8) / 11;
-            int src_y = (row * 8) / 11;
-            if ((glyph[src_y] >> (7 - src_x)) & 1) {
-                draw_pixel(x + col, y + row, color);
-            }
-        }
-    }
-}
-
-static void draw_string_vbe_large(int x, int y, const char* str, uint32_t color) {
-    while (*str) {
-        draw_char_vbe_large(x, y, *str, color);
-        // Offset by 11 pixels plus a 1-pixel gap
-        x += 12;
-        str++;
-    }
-}
-
 void rand1_test() {
     // A task to make a random pixel display based on a random seed and holds the screen until a key is pressed.
     printf("Random Pixel Test: Press any key to exit.\n");
+    if (!graphics_app_begin()) {
+        printf("Error: Not enough memory for the app surface.\n");
+        getch();
+        return;
+    }
 
     srand(get_uptime_ms());
 
@@ -84,18 +41,18 @@ void rand1_test() {
         int y = rand() % g_vbe_screen->height;
         uint32_t color = rand() % 0xFFFFFF;
         draw_pixel(x, y, color);
+        graphics_swap_buffer(); // Only the pixel's tile is dirty
     }
 
     getch(); // Consume the keypress that exited the loop
+    graphics_app_end();
 }
 
 void rand2_test() {
     // Fully black background version with double buffering
     printf("Random Pixel Test 2 (Black Background): Press any key to exit.\n");
-    clrscr();
-    graphics_set_double_buffering(true);
-    if (!g_DoubleBufferEnabled) {
-        printf("Error: Double buffering not available.\n");
+    if (!graphics_app_begin()) {
+        printf("Error: Not enough memory for the app surface.\n");
         getch();
         return;
     }
@@ -116,18 +73,14 @@ void rand2_test() {
     }
 
     getch(); // Consume the keypress that exited the loop
-    graphics_set_double_buffering(false);
-    clrscr();
+    graphics_app_end();
 }
 
 void rand3_test() {
     // Random pixels with a 3D "MM8-OS" logo overlay
     printf("Random Pixel Test 3 (3D Logo): Press any key to exit.\n");
-    clrscr();
-    graphics_set_double_buffering(true);
-
-    if (!g_DoubleBufferEnabled) {
-        printf("Error: Double buffering not available.\n");
+    if (!graphics_app_begin()) {
+        printf("Error: Not enough memory for the app surface.\n");
         getch();
         return;
     }
@@ -150,17 +103,16 @@ void rand3_test() {
 
         // 2. Draw 3D Logo (Shadow then Front)
         // Shadow
-        draw_string_vbe(logo_x + 2, logo_y + 2, logo, 0x00333333);
+        glyph_draw_string(logo_x + 2, logo_y + 2, logo, 0x00333333, 8, 8);
         // Front
-        draw_string_vbe(logo_x, logo_y, logo, 0x00FFFFFF);
+        glyph_draw_string(logo_x, logo_y, logo, 0x00FFFFFF, 8, 8);
 
         // 3. Swap to screen
         graphics_swap_buffer();
     }
 
     getch(); 
-    graphics_set_double_buffering(false);
-    clrscr();
+    graphics_app_end();
 }
 
 typedef struct {
@@ -172,15 +124,6 @@ typedef struct {
 
 void rand4_test() {
     printf("Random Pixel Test 4 (Life Cycle + Large Logo): Press any key to exit.\n");
-    clrscr();
-    graphics_set_double_buffering(true);
-
-    if (!g_DoubleBufferEnabled) {
-        printf("Error: Double buffering not available.\n");
-        getch();
-        return;
-    }
-
     #define MAX_PARTICLES 1000 //250 old, 1000 looks kewl but may be slow on some machines
     PixelLife* particles = (PixelLife*)malloc(sizeof(PixelLife) * MAX_PARTICLES);
     if (!particles) {
@@ -189,6 +132,13 @@ void rand4_test() {
         return;
     }
 
+    if (!graphics_app_begin()) {
+        printf("Error: Not enough memory for the app surface.\n");
+        free(particles);
+        getch();
+        return;
+    }
+
     memset(particles, 0, sizeof(PixelLife) * MAX_PARTICLES);
     srand(get_uptime_ms());
 
@@ -227,19 +177,19 @@ void rand4_test() {
             uint32_t final_color = (r << 16) | (g << 8) | b;
 
             // "Grow" the pixel: draw 2x2 if it's in the peak of its life
-            draw_pixel(particles[i].x, particles[i].y, final_color);
             if (intensity > 150) {
-                draw_pixel(particles[i].x + 1, particles[i].y, final_color);
-                draw_pixel(particles[i].x, particles[i].y + 1, final_color);
-                draw_pixel(particles[i].x + 1, particles[i].y + 1, final_color);
+                graphics_fill_rect(particles[i].x, particles[i].y, 2, 2, final_color);
+            } else {
+                draw_pixel(particles[i].x, particles[i].y, final_color);
             }
 
             particles[i].age++;
         }
 
         // Draw 3D Scaled Logo
-        draw_string_vbe_large(logo_x + 3, logo_y + 3, logo, 0x00222222); // Deep Shadow
-        draw_string_vbe_large(logo_x, logo_y, logo, 0x00FFFFFF);        // White Front
+        // 1.4x scale: 11x11 cells plus a 1-pixel gap
+        glyph_draw_string(logo_x + 3, logo_y + 3, logo, 0x00222222, 11, 12); // Deep Shadow
+        glyph_draw_string(logo_x, logo_y, logo, 0x00FFFFFF, 11, 12);         // White Front
 
         graphics_swap_buffer();
         
@@ -249,6 +199,5 @@ void rand4_test() {
 
     getch();
     free(particles);
-    graphics_set_double_buffering(false);
-    clrscr();
+    graphics_app_end();
 }
\ No newline at end of file
@@ -1,5 +1,14 @@
 #include "time.h"
 #include "stdio.h" // For printf, if needed for debugging
+#include <arch/i686/io.h>
+#include <arch/i686/cpu.h>
+#include <arch/i686/apic.h>
+#include <arch/i686/irq.h>
+#include <arch/i686/isr.h>
+#include <arch/i686/smp.h>
+#include <sync/spinlock.h>
+#include "timer.h"
+#include <sched/thread.h>
 
 // External global tick counter from main.c
 // This variable is incremented by the timer IRQ handler.
@@ -8,26 +17,166 @@ extern volatile uint32_t g_ticks;
 // Assuming a timer frequency of 100 Hz (100 ticks per second)
 // This value should match how your timer IRQ is configured.
 #define TIMER_FREQUENCY_HZ 100
+#define TIMER_TICK_NS (1000000000u / TIMER_FREQUENCY_HZ)
+
+// The PIT's input clock, and how the TSC is measured against it
+#define PIT_FREQUENCY_HZ 1193182
+#define TSC_CALIBRATE_MS 50
+#define TSC_CALIBRATE_RUNS 3
+
+// ns = cycles * g_NsMult >> TSC_NS_SHIFT. 22 bits keeps g_NsMult in 32 bits
+// down to a 1 MHz TSC while losing nothing that matters at GHz rates.
+#define TSC_NS_SHIFT 22
+
+static uint32_t g_TscKhz = 0;       // 0 until calibrated; PIT ticks are used until then
+static uint32_t g_NsMult = 0;
+static uint64_t g_TscBase = 0;      // TSC reading at calibration...
+static uint64_t g_NsBase = 0;       // ...and the uptime it stands for
+
+// Local APIC timer, measured against the TSC. Once it works the PIT stops
+// interrupting and the CPU only wakes for deadlines someone actually set.
+#define APIC_CALIBRATE_NS 10000000
+static uint32_t g_ApicKhz = 0;      // timer counts per ms; 0 while the PIT ticks
+
+// Every CPU has its own local APIC timer, armed for whenever the CPU idles
+// until. The boot CPU's also drives the timer wheel, so it's armed for the
+// earlier of that and the wheel's alarm.
+static uint64_t g_AlarmNs = TIME_NEVER;
+static uint64_t g_IdleNs[SMP_MAX_CPUS];
+
+/**
+ * @brief Counts TSC cycles while PIT channel 2 counts down `pit_count` input clocks.
+ *
+ * Channel 2 is the speaker channel; it's gated on with the speaker output off
+ * and its OUT pin (port 0x61 bit 5) goes high when the count runs out.
+ */
+static uint64_t time_measure_tsc(uint16_t pit_count) {
+    uint8_t port61 = i686_inb(0x61);
+    i686_outb(0x61, (port61 & ~0x02) | 0x01);
+
+    i686_outb(0x43, 0xB0); // Channel 2, LSB/MSB, mode 0 (interrupt on terminal count)
+    i686_outb(0x42, (uint8_t)(pit_count & 0xFF));
+    i686_outb(0x42, (uint8_t)(pit_count >> 8));
+
+    uint64_t start = i686_ReadTSC();
+    while (!(i686_inb(0x61) & 0x20));
+    uint64_t end = i686_ReadTSC();
+
+    i686_outb(0x61, port61);
+    return end - start;
+}
+
+static void time_calibrate_tsc() {
+    uint16_t pit_count = (uint16_t)((PIT_FREQUENCY_HZ * TSC_CALIBRATE_MS) / 1000);
+
+    // Take the shortest of a few runs; an SMI or a slow port read only ever adds cycles
+    uint32_t flags = irq_save();
+    uint64_t best = 0;
+    for (int i = 0; i < TSC_CALIBRATE_RUNS; i++) {
+        uint64_t cycles = time_measure_tsc(pit_count);
+        if (i == 0 || cycles < best) best = cycles;
+    }
+    irq_restore(flags);
+
+    uint64_t khz = best * PIT_FREQUENCY_HZ / pit_count / 1000;
+    if (khz < 1000 || khz > 0xFFFFFFFFu) return;
+
+    g_NsMult = (uint32_t)(((uint64_t)1000000 << TSC_NS_SHIFT) / khz);
+    g_NsBase = (uint64_t)g_ticks * TIMER_TICK_NS;
+    g_TscBase = i686_ReadTSC();
+    g_TscKhz = (uint32_t)khz;
+}
+
+static void time_calibrate_apic() {
+    if (!g_TscKhz || !i686_APIC_IsEnabled()) return;
+
+    uint32_t flags = irq_save();
+    i686_APIC_TimerOneShot(0xFFFFFFFF);
+    uint64_t end = time_now_ns() + APIC_CALIBRATE_NS;
+    while (time_now_ns() < end) {
+        __asm__ volatile("pause");
+    }
+    uint32_t counted = 0xFFFFFFFF - i686_APIC_TimerRemaining();
+    i686_APIC_TimerOneShot(0);
+    irq_restore(flags);
+
+    g_ApicKhz = (uint32_t)((uint64_t)counted * 1000000 / APIC_CALIBRATE_NS);
+}
+
+static void time_apic_interrupt(Registers* regs) {
+    i686_APIC_SendEndOfInterrupt();
+    // The other CPUs' timers only wake them from time_idle_until()
+    if (i686_SMP_CpuIndex() == 0) timer_interrupt();
+    i686_IRQ_RunTail();
+}
 
 /**
  * @brief Initializes the time module.
  *
- * Currently, the timer IRQ is set up in main.c. This function can be
- * used for future Real-Time Clock (RTC) initialization or other
- * time-related setup.
+ * The PIT itself is set up by HAL_Initialize() and its IRQ handler in main.c.
+ * Here the TSC is calibrated against it so time can be read at cycle
+ * resolution, and the local APIC timer against the TSC. With the APIC timer
+ * in place the PIT's tick is masked; it was only the reference.
  */
 void time_initialize() {
-    // For now, it just prints a message.
-    printf("Time module initialized.\n");
+    for (int cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        g_IdleNs[cpu] = TIME_NEVER;
+    }
+
+    if (i686_CPU_HasFeature(CPUID_EDX_TSC)) {
+        time_calibrate_tsc();
+    }
+    time_calibrate_apic();
+
+    if (g_TscKhz) {
+        printf("Time: TSC at %u.%03u MHz\n", g_TscKhz / 1000, g_TscKhz % 1000);
+    } else {
+        printf("Time: No usable TSC, using the %u Hz PIT.\n", TIMER_FREQUENCY_HZ);
+    }
+
+    if (g_ApicKhz) {
+        i686_ISR_RegisterHandler(APIC_TIMER_VECTOR, time_apic_interrupt);
+        i686_IRQ_Mask(0);
+        printf("Time: Local APIC timer at %u kHz, tickless idle (%s)\n", g_ApicKhz,
+               i686_APIC_HasTscDeadline() ? "TSC deadline" : "one-shot");
+    }
+}
+
+uint64_t time_cycles_to_ns(uint64_t cycles) {
+    // 64x32 multiply in two halves so the 96-bit product never overflows
+    uint64_t lo = (uint64_t)(uint32_t)cycles * g_NsMult;
+    uint64_t hi = (cycles >> 32) * g_NsMult;
+    return (lo >> TSC_NS_SHIFT) + (hi << (32 - TSC_NS_SHIFT));
+}
+
+uint64_t time_now_ns() {
+    if (!g_TscKhz) return (uint64_t)g_ticks * TIMER_TICK_NS;
+    return g_NsBase + time_cycles_to_ns(i686_ReadTSC() - g_TscBase);
+}
+
+// Inverse of time_now_ns(): the TSC value at uptime `ns`
+static uint64_t time_ns_to_cycles(uint64_t ns) {
+    if (ns < g_NsBase) return g_TscBase;
+    ns -= g_NsBase;
+    // Split so ns * kHz can't overflow
+    return g_TscBase + (ns / 1000000) * g_TscKhz + (ns % 1000000) * g_TscKhz / 1000000;
+}
+
+uint64_t time_now_cycles() {
+    return g_TscKhz ? i686_ReadTSC() : 0;
+}
+
+uint32_t time_tsc_khz() {
+    return g_TscKhz;
 }
 
 /**
  * @brief Returns the system uptime in milliseconds.
+ *
+ * Wraps after about 49 days; use time_now_ns() for anything longer-lived.
  */
 uint32_t get_uptime_ms() {
-    // Use uint64_t to prevent overflow during multiplication (happens after ~11 hours at 100Hz)
-    if (TIMER_FREQUENCY_HZ == 0) return 0;
-    return (uint32_t)(((uint64_t)g_ticks * 1000) / TIMER_FREQUENCY_HZ);
+    return (uint32_t)(time_now_ns() / 1000000);
 }
 
 /**
@@ -35,11 +184,7 @@ uint32_t get_uptime_ms() {
  * @return The number of seconds since the system started.
  */
 uint32_t get_uptime_seconds() {
-    // Avoid division by zero if TIMER_FREQUENCY_HZ is unexpectedly 0.
-    if (TIMER_FREQUENCY_HZ == 0) {
-        return 0;
-    }
-    return g_ticks / TIMER_FREQUENCY_HZ;
+    return (uint32_t)(time_now_ns() / 1000000000);
 }
 
 /**
@@ -57,38 +202,153 @@ bool time_is_periodic(uint32_t* last_ms, uint32_t interval_ms) {
     return false;
 }
 
+// Programs the local APIC to interrupt at `deadline_ns`
+static void time_arm(uint64_t deadline_ns) {
+    if (i686_APIC_HasTscDeadline()) {
+        i686_APIC_TimerDeadline(time_ns_to_cycles(deadline_ns));
+        return;
+    }
+
+    uint64_t now = time_now_ns();
+    uint64_t delta = deadline_ns > now ? deadline_ns - now : 0;
+    // A wake-up after the counter runs out is harmless, the caller re-arms
+    uint64_t count = delta / 1000 * g_ApicKhz / 1000;
+    if (count > 0xFFFFFFFF) count = 0xFFFFFFFF;
+    if (count == 0) count = 1;
+    i686_APIC_TimerOneShot((uint32_t)count);
+}
+
+// Rearms this CPU's timer. Interrupts must be off.
+static void time_rearm() {
+    uint32_t cpu = i686_SMP_CpuIndex();
+    uint64_t deadline = g_IdleNs[cpu];
+    if (cpu == 0 && g_AlarmNs < deadline) deadline = g_AlarmNs;
+    if (deadline != TIME_NEVER) {
+        time_arm(deadline);
+    } else if (i686_APIC_HasTscDeadline()) {
+        i686_APIC_TimerDeadline(0);
+    } else {
+        i686_APIC_TimerOneShot(0);
+    }
+}
+
 /**
- * @brief Pauses execution for the specified number of milliseconds using busy-waiting.
- * @param milliseconds The number of milliseconds to sleep.
+ * @brief Sets when the timer wheel next needs the timer interrupt.
  *
- * This function busy-waits, consuming CPU cycles. In a multi-tasking OS,
- * a more efficient approach would involve yielding the CPU to other tasks.
+ * TIME_NEVER means never. On the PIT the periodic tick covers it anyway.
+ * Called with interrupts off. Only the boot CPU's timer runs the wheel, so
+ * another CPU pokes it with a timer interrupt and lets it rearm itself.
  */
-void sleep_ms(uint32_t milliseconds) {
-    if (milliseconds == 0) {
+void time_set_alarm(uint64_t deadline_ns) {
+    g_AlarmNs = deadline_ns;
+    if (!g_ApicKhz) return;
+    if (i686_SMP_CpuIndex() == 0) {
+        time_rearm();
+    } else {
+        i686_SMP_SendIPI(0, APIC_TIMER_VECTOR);
+    }
+}
+
+/**
+ * @brief Halts until any interrupt arrives or time_now_ns() reaches `deadline_ns`.
+ *
+ * With the local APIC timer nothing else wakes an idle CPU, so the deadline
+ * is programmed first. Without it the periodic PIT tick bounds the wait.
+ * Must be called with interrupts enabled.
+ */
+void time_idle_until(uint64_t deadline_ns) {
+    if (!g_ApicKhz) {
+        __asm__ volatile("hlt");
         return;
     }
 
-    // Calculate the target number of ticks. Use uint64_t for intermediate calculation
-    // to prevent overflow for large `milliseconds` values before division.
-    uint64_t target_ticks_increment = ((uint64_t)milliseconds * TIMER_FREQUENCY_HZ) / 1000;
-    if (target_ticks_increment == 0 && milliseconds > 0) {
-        target_ticks_increment = 1; // Ensure at least one tick for non-zero milliseconds
+    // Check and arm with interrupts off, or the timer could fire before the
+    // hlt and leave us asleep past the deadline. sti only takes effect after
+    // the next instruction, so nothing gets in between it and the hlt.
+    __asm__ volatile("cli");
+    if (time_now_ns() < deadline_ns) {
+        uint32_t cpu = i686_SMP_CpuIndex();
+        g_IdleNs[cpu] = deadline_ns;
+        time_rearm();
+        __asm__ volatile("sti\n\thlt" : : : "memory");
+        __asm__ volatile("cli");
+        // The thread may have been switched out and be back on another
+        // CPU; the slot is cleared unless someone there reused it meanwhile
+        if (g_IdleNs[cpu] == deadline_ns) g_IdleNs[cpu] = TIME_NEVER;
     }
-    uint32_t target_ticks = g_ticks + (uint32_t)target_ticks_increment;
+    __asm__ volatile("sti");
+}
 
-    while (g_ticks < target_ticks) {
-        // Wait for next interrupt (likely the timer) to save CPU cycles   Way break stuff
-        __asm__ volatile("hlt");
+/**
+ * @brief Pauses execution until time_now_ns() reaches `deadline_ns`.
+ *
+ * Once threads are running, the thread blocks for most of the wait so
+ * others can use the CPU. The rest idles until the deadline when the local
+ * APIC timer can wake us. On the PIT it halts while at least a whole tick
+ * remains, since the tick is what wakes us, then spins out the rest on the
+ * TSC so the wait ends on time rather than on the next 10 ms boundary.
+ */
+void sleep_until_ns(uint64_t deadline_ns) {
+    // Don't leave paced console output hidden for the whole wait
+    console_flush();
+
+    // Timers fire up to a tick late (the wheel's, or the PIT's when it
+    // drives the wheel), so block for all but that; the loop finishes on time
+    uint64_t slack = g_ApicKhz ? TIMER_WHEEL_TICK_NS : TIMER_TICK_NS;
+    if (irq_enabled() && deadline_ns > time_now_ns() + slack) {
+        thread_sleep_until(deadline_ns - slack);
+    }
+
+    for (;;) {
+        uint64_t now = time_now_ns();
+        if (now >= deadline_ns) break;
+
+        if (!irq_enabled()) {
+            __asm__ volatile("pause");
+        } else if (g_ApicKhz || !g_TscKhz || deadline_ns - now > TIMER_TICK_NS) {
+            time_idle_until(deadline_ns);
+        } else {
+            __asm__ volatile("pause");
+        }
+    }
+}
+
+/**
+ * @brief Pauses execution for the specified number of milliseconds.
+ * @param milliseconds The number of milliseconds to sleep.
+ *
+ * In a multi-tasking OS, a more efficient approach would involve yielding
+ * the CPU to other tasks.
+ */
+void sleep_ms(uint32_t milliseconds) {
+    if (milliseconds == 0) {
+        return;
     }
+    sleep_until_ns(time_now_ns() + (uint64_t)milliseconds * 1000000);
 }
 
 /**
- * @brief Pauses execution for the specified number of seconds using busy-waiting.
+ * @brief Pauses execution for the specified number of seconds.
  * @param seconds The number of seconds to sleep.
  *
  * This function internally calls `sleep_ms`.
  */
 void sleep_seconds(uint32_t seconds) {
     sleep_ms(seconds * 1000);
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Sleeps until the next frame of a fixed-rate loop is due.
+ * @param next_ns When the next frame is due; advanced by `period_ns`.
+ * @param period_ns The frame period in nanoseconds.
+ */
+void time_pace(uint64_t* next_ns, uint64_t period_ns) {
+    uint64_t now = time_now_ns();
+    if (*next_ns + period_ns < now) {
+        // Too far behind to catch up; keep the rate from here on
+        *next_ns = now;
+    } else {
+        sleep_until_ns(*next_ns);
+    }
+    *next_ns += period_ns;
+}
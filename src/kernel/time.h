@@ -4,10 +4,23 @@
 #include <stdint.h>
 #include <stdbool.h>
 
-// Initializes time-related components (e.g., RTC, if present).
-// For now, the system timer is initialized in main.c.
+// Calibrates the TSC against the PIT and the local APIC timer against the
+// TSC. Call once interrupts are set up.
 void time_initialize();
 
+// Nanoseconds since boot. TSC based, so it resolves well below the 10 ms tick;
+// without a TSC it falls back to counting PIT ticks.
+uint64_t time_now_ns();
+
+// Raw TSC cycles, for timing short stretches of code. 0 without a TSC.
+uint64_t time_now_cycles();
+
+// Converts a TSC cycle count to nanoseconds
+uint64_t time_cycles_to_ns(uint64_t cycles);
+
+// Calibrated TSC frequency in kHz, 0 if there's no TSC
+uint32_t time_tsc_khz();
+
 // Returns the system uptime in milliseconds.
 uint32_t get_uptime_ms();
 
@@ -17,10 +30,28 @@ uint32_t get_uptime_seconds();
 // Helper for periodic loops. Returns true if interval_ms has passed since *last_ms.
 bool time_is_periodic(uint32_t* last_ms, uint32_t interval_ms);
 
-// Pauses execution for the specified number of milliseconds (busy-waits).
+// Pauses execution for the specified number of milliseconds.
 void sleep_ms(uint32_t milliseconds);
 
-// Pauses execution for the specified number of seconds (busy-waits).
+// Pauses execution for the specified number of seconds.
 void sleep_seconds(uint32_t seconds);
 
-#endif // TIME_H
\ No newline at end of file
+// Pauses execution until time_now_ns() reaches deadline_ns.
+void sleep_until_ns(uint64_t deadline_ns);
+
+// Halts until an interrupt or the deadline, whichever comes first. The idle
+// path: with the local APIC timer nothing else wakes the CPU.
+void time_idle_until(uint64_t deadline_ns);
+
+// A deadline that never comes
+#define TIME_NEVER ((uint64_t)-1)
+
+// Arms the timer interrupt for the timer wheel's next deadline (timer.c)
+void time_set_alarm(uint64_t deadline_ns);
+
+// Frame pacing. Sleeps until *next_ns, then schedules the following frame
+// period_ns later. A caller that fell a whole period behind starts over from
+// now instead of rushing frames to catch up.
+void time_pace(uint64_t* next_ns, uint64_t period_ns);
+
+#endif // TIME_H
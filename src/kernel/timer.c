@@ -0,0 +1,289 @@
+#include "timer.h"
+#include "time.h"
+#include "deferred.h"
+#include "stddef.h"
+#include <sync/spinlock.h>
+
+#define WHEEL_LEVELS        4
+#define WHEEL_BITS          6
+#define WHEEL_SLOTS         (1 << WHEEL_BITS)
+#define WHEEL_MASK          (WHEEL_SLOTS - 1)
+// Furthest a timer can be placed; later deadlines are re-added when they get there
+#define WHEEL_SPAN          ((uint64_t)1 << (WHEEL_BITS * WHEEL_LEVELS))
+
+typedef enum {
+    TIMER_FREE,
+    TIMER_WHEEL,
+    TIMER_READY,
+    TIMER_RUNNING,
+} timer_state_t;
+
+typedef struct timer_node {
+    struct timer_node* next;
+    struct timer_node** pprev;      // whatever points at us, so unlinking is O(1)
+    uint64_t deadline_ns;
+    uint64_t expires;               // wheel tick
+    timer_callback_t callback;
+    void* arg;
+    uint16_t generation;            // bumped on every reuse so stale ids miss
+    uint8_t state;
+    uint8_t level;                  // where it sits in the wheel
+    uint8_t slot;
+} timer_node_t;
+
+// Everything below; any CPU may add or cancel timers
+static spinlock_t g_TimerLock = SPINLOCK_INIT_NAMED("timer");
+
+static timer_node_t g_Timers[TIMER_MAX];
+static timer_node_t* g_FreeTimers = NULL;
+
+static timer_node_t* g_Wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+static uint64_t g_Occupied[WHEEL_LEVELS];   // bit per non-empty slot
+static uint64_t g_WheelTick = 0;            // last tick processed
+
+// Due timers in expiry order, waiting for timer_run_expired()
+static timer_node_t* g_Ready = NULL;
+static timer_node_t** g_ReadyTail = &g_Ready;
+static bool g_RunQueued = false;            // timer_run_expired() is in the deferred queue
+
+static void timer_link(timer_node_t** head, timer_node_t* node) {
+    node->next = *head;
+    if (node->next) node->next->pprev = &node->next;
+    node->pprev = head;
+    *head = node;
+}
+
+static void timer_unlink(timer_node_t* node) {
+    *node->pprev = node->next;
+    if (node->next) node->next->pprev = node->pprev;
+}
+
+// A cascade may hand back timers that expire on the current tick; they land
+// in the level 0 slot that's about to be processed
+static void timer_wheel_insert(timer_node_t* node) {
+    if (node->expires < g_WheelTick) node->expires = g_WheelTick;
+    uint64_t delta = node->expires - g_WheelTick;
+    if (delta >= WHEEL_SPAN) {
+        node->expires = g_WheelTick + WHEEL_SPAN - 1;
+        delta = WHEEL_SPAN - 1;
+    }
+
+    int level = 0;
+    while (delta >= ((uint64_t)1 << (WHEEL_BITS * (level + 1)))) level++;
+
+    int slot = (node->expires >> (WHEEL_BITS * level)) & WHEEL_MASK;
+
+    timer_link(&g_Wheel[level][slot], node);
+    g_Occupied[level] |= (uint64_t)1 << slot;
+    node->state = TIMER_WHEEL;
+    node->level = level;
+    node->slot = slot;
+}
+
+static void timer_wheel_remove(timer_node_t* node) {
+    timer_unlink(node);
+    if (!g_Wheel[node->level][node->slot]) {
+        g_Occupied[node->level] &= ~((uint64_t)1 << node->slot);
+    }
+}
+
+static void timer_ready_append(timer_node_t* node) {
+    node->next = NULL;
+    node->pprev = g_ReadyTail;
+    *g_ReadyTail = node;
+    g_ReadyTail = &node->next;
+    node->state = TIMER_READY;
+}
+
+static void timer_ready_remove(timer_node_t* node) {
+    if (g_ReadyTail == &node->next) g_ReadyTail = node->pprev;
+    timer_unlink(node);
+}
+
+static int timer_ctz64(uint64_t bits) {
+    uint32_t low = (uint32_t)bits;
+    return low ? __builtin_ctz(low) : 32 + __builtin_ctz((uint32_t)(bits >> 32));
+}
+
+// Next tick at which the wheel has something to do: the first occupied
+// level 0 slot, or the next boundary where the lowest occupied level cascades
+static uint64_t timer_next_tick() {
+    uint64_t next = TIME_NEVER;
+
+    if (g_Occupied[0]) {
+        int start = (g_WheelTick + 1) & WHEEL_MASK;
+        uint64_t bits = g_Occupied[0];
+        uint64_t rotated = start ? (bits >> start) | (bits << (WHEEL_SLOTS - start)) : bits;
+        next = g_WheelTick + 1 + timer_ctz64(rotated);
+    }
+
+    for (int level = 1; level < WHEEL_LEVELS; level++) {
+        if (!g_Occupied[level]) continue;
+        int shift = WHEEL_BITS * level;
+        uint64_t boundary = ((g_WheelTick >> shift) + 1) << shift;
+        if (boundary < next) next = boundary;
+        break;
+    }
+    return next;
+}
+
+// Re-files the slot of each level whose boundary `g_WheelTick` is on
+static void timer_cascade() {
+    for (int level = 1; level < WHEEL_LEVELS; level++) {
+        int shift = WHEEL_BITS * level;
+        if (g_WheelTick & (((uint64_t)1 << shift) - 1)) break;
+
+        int slot = (g_WheelTick >> shift) & WHEEL_MASK;
+        timer_node_t* node = g_Wheel[level][slot];
+        g_Wheel[level][slot] = NULL;
+        g_Occupied[level] &= ~((uint64_t)1 << slot);
+
+        while (node) {
+            timer_node_t* next = node->next;
+            timer_wheel_insert(node);
+            node = next;
+        }
+    }
+}
+
+static void timer_expire_slot(uint64_t now_ns) {
+    int slot = g_WheelTick & WHEEL_MASK;
+    timer_node_t* node = g_Wheel[0][slot];
+    g_Wheel[0][slot] = NULL;
+    g_Occupied[0] &= ~((uint64_t)1 << slot);
+
+    while (node) {
+        timer_node_t* next = node->next;
+        if (node->deadline_ns > now_ns) {
+            // Clamped to the wheel's span, or a tick early; not due yet
+            node->expires = (node->deadline_ns + TIMER_WHEEL_TICK_NS - 1) / TIMER_WHEEL_TICK_NS;
+            timer_wheel_insert(node);
+        } else {
+            timer_ready_append(node);
+        }
+        node = next;
+    }
+}
+
+static void timer_update_alarm() {
+    uint64_t next = timer_next_tick();
+    time_set_alarm(next == TIME_NEVER ? TIME_NEVER : next * TIMER_WHEEL_TICK_NS);
+}
+
+void timer_initialize() {
+    uint32_t flags = spin_lock_irqsave(&g_TimerLock);
+    for (int i = TIMER_MAX - 1; i >= 0; i--) {
+        g_Timers[i].state = TIMER_FREE;
+        g_Timers[i].next = g_FreeTimers;
+        g_FreeTimers = &g_Timers[i];
+    }
+    g_WheelTick = time_now_ns() / TIMER_WHEEL_TICK_NS;
+    spin_unlock_irqrestore(&g_TimerLock, flags);
+}
+
+timer_id_t timer_add(uint64_t deadline_ns, timer_callback_t callback, void* arg) {
+    if (!callback) return TIMER_INVALID;
+
+    uint32_t flags = spin_lock_irqsave(&g_TimerLock);
+    timer_node_t* node = g_FreeTimers;
+    if (!node) {
+        spin_unlock_irqrestore(&g_TimerLock, flags);
+        return TIMER_INVALID;
+    }
+    g_FreeTimers = node->next;
+
+    node->deadline_ns = deadline_ns;
+    node->expires = (deadline_ns + TIMER_WHEEL_TICK_NS - 1) / TIMER_WHEEL_TICK_NS;
+    node->callback = callback;
+    node->arg = arg;
+    node->generation++;
+
+    // The current tick's slot may already be done; a deadline that has
+    // passed goes in the next one, and the alarm for it fires right away
+    if (node->expires <= g_WheelTick) node->expires = g_WheelTick + 1;
+    timer_wheel_insert(node);
+    timer_update_alarm();
+
+    timer_id_t id = ((uint32_t)node->generation << 16) | (uint32_t)(node - g_Timers + 1);
+    spin_unlock_irqrestore(&g_TimerLock, flags);
+    return id;
+}
+
+bool timer_cancel(timer_id_t id) {
+    uint32_t index = (id & 0xFFFF) - 1;
+    if (id == TIMER_INVALID || index >= TIMER_MAX) return false;
+
+    uint32_t flags = spin_lock_irqsave(&g_TimerLock);
+    timer_node_t* node = &g_Timers[index];
+    bool pending = node->generation == (id >> 16) &&
+                   (node->state == TIMER_WHEEL || node->state == TIMER_READY);
+    if (pending) {
+        if (node->state == TIMER_WHEEL) {
+            timer_wheel_remove(node);
+        } else {
+            timer_ready_remove(node);
+        }
+        node->state = TIMER_FREE;
+        node->next = g_FreeTimers;
+        g_FreeTimers = node;
+    }
+    spin_unlock_irqrestore(&g_TimerLock, flags);
+    return pending;
+}
+
+static void timer_run_deferred(void* arg) {
+    timer_run_expired();
+}
+
+void timer_interrupt() {
+    spin_lock(&g_TimerLock);
+    uint64_t now_ns = time_now_ns();
+    uint64_t target = now_ns / TIMER_WHEEL_TICK_NS;
+
+    while (g_WheelTick < target) {
+        uint64_t next = timer_next_tick();
+        if (next > target) {
+            // Nothing scheduled in between, so nothing to cascade either
+            g_WheelTick = target;
+            break;
+        }
+        g_WheelTick = next;
+        timer_cascade();
+        timer_expire_slot(now_ns);
+    }
+
+    if (g_Ready && !g_RunQueued) {
+        g_RunQueued = deferred_queue(timer_run_deferred, NULL);
+    }
+    timer_update_alarm();
+    spin_unlock(&g_TimerLock);
+}
+
+void timer_run_expired() {
+    uint32_t flags = spin_lock_irqsave(&g_TimerLock);
+    g_RunQueued = false;
+    spin_unlock_irqrestore(&g_TimerLock, flags);
+
+    for (;;) {
+        uint32_t flags = spin_lock_irqsave(&g_TimerLock);
+        timer_node_t* node = g_Ready;
+        if (!node) {
+            spin_unlock_irqrestore(&g_TimerLock, flags);
+            break;
+        }
+        timer_ready_remove(node);
+        node->state = TIMER_RUNNING;
+        timer_callback_t callback = node->callback;
+        void* arg = node->arg;
+        spin_unlock_irqrestore(&g_TimerLock, flags);
+
+        callback(arg);
+
+        // Free only afterwards so a cancel from inside the callback is a no-op
+        flags = spin_lock_irqsave(&g_TimerLock);
+        node->state = TIMER_FREE;
+        node->next = g_FreeTimers;
+        g_FreeTimers = node;
+        spin_unlock_irqrestore(&g_TimerLock, flags);
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Kernel timers on a hierarchical timing wheel.
+//
+// Four levels of 64 slots with 1 ms ticks; a level n slot is 64^n ticks
+// wide. Adding and cancelling are O(1), and expiry only ever looks at one
+// slot per level, skipping stretches where the wheel is empty. Due timers
+// are collected in the timer interrupt and their callbacks run as deferred
+// work (deferred.h), past the EOI with interrupts enabled.
+
+#define TIMER_MAX               128
+#define TIMER_WHEEL_TICK_NS     1000000
+#define TIMER_INVALID           0
+
+typedef uint32_t timer_id_t;
+typedef void (*timer_callback_t)(void* arg);
+
+// Starts the wheel at the current time. Call after time_initialize().
+void timer_initialize();
+
+// Calls callback(arg) once, after time_now_ns() reaches deadline_ns.
+// Returns TIMER_INVALID when all TIMER_MAX timers are in use.
+timer_id_t timer_add(uint64_t deadline_ns, timer_callback_t callback, void* arg);
+
+// Stops a timer before it fires. Returns false if it already ran, is
+// running or the id is stale.
+bool timer_cancel(timer_id_t id);
+
+// Called from the boot CPU's timer interrupt with interrupts off: moves due
+// timers to the run list and asks time.c for the next wake-up.
+void timer_interrupt();
+
+// Runs the callbacks of due timers. Queued as deferred work by
+// timer_interrupt(); only call it from deferred context.
+void timer_run_expired();
+
+#endif // TIMER_H
@@ -9,6 +9,13 @@ typedef struct {
     uint16_t pitch;
     uint8_t  bpp;
     uint32_t physical_buffer;
+    // Channel sizes (bits) and positions from the VBE mode info
+    uint8_t  red_mask;
+    uint8_t  red_position;
+    uint8_t  green_mask;
+    uint8_t  green_position;
+    uint8_t  blue_mask;
+    uint8_t  blue_position;
 } __attribute__((packed)) VbeScreenInfo;
 
 // This will be a pointer to the VBE info structure passed by the bootloader.
@@ -0,0 +1,164 @@
+#include "vmm.h"
+#include "memory.h"
+#include <arch/i686/io.h>
+#include <arch/i686/paging.h>
+#include <sync/spinlock.h>
+
+#define VMM_FRAME_COUNT  (VMM_FRAME_POOL_SIZE / VMM_PAGE_SIZE)
+#define VMM_REGION_PAGES (VMM_REGION_SIZE / VMM_PAGE_SIZE)
+
+// One bit per physical frame and one bit per virtual page, set = in use
+static uint32_t g_FrameBitmap[VMM_FRAME_COUNT / 32];
+static uint32_t g_RegionBitmap[VMM_REGION_PAGES / 32];
+
+// Frames of the pool that are backed by RAM; 0 turns the pool off and
+// large allocations go to the list heap
+static uint32_t g_FrameCount = 0;
+static uint32_t g_FramesUsed = 0;
+static uint32_t g_FrameHint = 0;     // word index where the last frame search stopped
+static spinlock_t g_VmmLock = SPINLOCK_INIT_NAMED("vmm");
+
+static inline bool bitmap_test(const uint32_t* bitmap, uint32_t bit) {
+    return bitmap[bit / 32] & (1u << (bit % 32));
+}
+
+static inline void bitmap_set(uint32_t* bitmap, uint32_t bit) {
+    bitmap[bit / 32] |= 1u << (bit % 32);
+}
+
+static inline void bitmap_clear(uint32_t* bitmap, uint32_t bit) {
+    bitmap[bit / 32] &= ~(1u << (bit % 32));
+}
+
+// RAM above 16MB as the BIOS left it in CMOS, in 64KB units. The bootloader
+// doesn't pass a memory map, and this covers everything below 4GB.
+static uint32_t vmm_cmos_ram_top() {
+    i686_outb(0x70, 0x34);
+    uint32_t low = i686_inb(0x71);
+    i686_outb(0x70, 0x35);
+    uint32_t high = i686_inb(0x71);
+    return 0x1000000u + ((high << 8) | low) * 0x10000u;
+}
+
+void vmm_initialize() {
+    memset(g_FrameBitmap, 0, sizeof(g_FrameBitmap));
+    memset(g_RegionBitmap, 0, sizeof(g_RegionBitmap));
+    g_FramesUsed = 0;
+    g_FrameHint = 0;
+
+    // Only hand out frames that exist; writes to missing RAM just vanish
+    uint32_t ram_top = vmm_cmos_ram_top();
+    uint32_t pool_size = 0;
+    if (ram_top > VMM_FRAME_POOL_BASE) {
+        pool_size = ram_top - VMM_FRAME_POOL_BASE;
+        if (pool_size > VMM_FRAME_POOL_SIZE) pool_size = VMM_FRAME_POOL_SIZE;
+    }
+    // Whole bitmap words, so the search never looks past the end
+    g_FrameCount = (pool_size / VMM_PAGE_SIZE) & ~31u;
+}
+
+// Frames don't need to be contiguous, so any clear bit will do. Caller holds g_VmmLock.
+static uint32_t vmm_frame_alloc_locked() {
+    const uint32_t words = g_FrameCount / 32;
+    for (uint32_t n = 0; n < words; n++) {
+        uint32_t w = (g_FrameHint + n) % words;
+        if (g_FrameBitmap[w] == 0xFFFFFFFF) continue;
+
+        uint32_t bit = __builtin_ctz(~g_FrameBitmap[w]);
+        g_FrameBitmap[w] |= 1u << bit;
+        g_FrameHint = w;
+        g_FramesUsed++;
+        return VMM_FRAME_POOL_BASE + (w * 32 + bit) * VMM_PAGE_SIZE;
+    }
+    return 0;
+}
+
+static void vmm_frame_free_locked(uint32_t phys) {
+    uint32_t frame = (phys - VMM_FRAME_POOL_BASE) / VMM_PAGE_SIZE;
+    bitmap_clear(g_FrameBitmap, frame);
+    g_FramesUsed--;
+}
+
+// First fit for `pages` contiguous virtual pages, returns the first page index or -1
+static int32_t vmm_region_find_locked(uint32_t pages) {
+    uint32_t run = 0;
+    for (uint32_t page = 0; page < VMM_REGION_PAGES; page++) {
+        // Skip fully used words in one step
+        if (page % 32 == 0 && g_RegionBitmap[page / 32] == 0xFFFFFFFF) {
+            run = 0;
+            page += 31;
+            continue;
+        }
+        if (bitmap_test(g_RegionBitmap, page)) {
+            run = 0;
+            continue;
+        }
+        if (++run == pages) {
+            return (int32_t)(page + 1 - pages);
+        }
+    }
+    return -1;
+}
+
+void* vmm_alloc(size_t size) {
+    if (size == 0) return NULL;
+    uint32_t pages = (size + VMM_PAGE_SIZE - 1) / VMM_PAGE_SIZE;
+
+    uint32_t flags = spin_lock_irqsave(&g_VmmLock);
+
+    if (g_FrameCount - g_FramesUsed < pages) {
+        spin_unlock_irqrestore(&g_VmmLock, flags);
+        return NULL;
+    }
+
+    int32_t first = vmm_region_find_locked(pages);
+    if (first < 0) {
+        spin_unlock_irqrestore(&g_VmmLock, flags);
+        return NULL;
+    }
+
+    uint32_t virt = VMM_REGION_BASE + (uint32_t)first * VMM_PAGE_SIZE;
+    for (uint32_t i = 0; i < pages; i++) {
+        bitmap_set(g_RegionBitmap, first + i);
+        i686_Paging_Map_Range(virt + i * VMM_PAGE_SIZE, vmm_frame_alloc_locked(), VMM_PAGE_SIZE);
+    }
+
+    spin_unlock_irqrestore(&g_VmmLock, flags);
+    return (void*)virt;
+}
+
+void vmm_free(void* ptr, size_t size) {
+    if (!ptr) return;
+    uint32_t virt = (uint32_t)ptr & ~(VMM_PAGE_SIZE - 1);
+    uint32_t pages = (size + VMM_PAGE_SIZE - 1) / VMM_PAGE_SIZE;
+    uint32_t first = (virt - VMM_REGION_BASE) / VMM_PAGE_SIZE;
+
+    uint32_t flags = spin_lock_irqsave(&g_VmmLock);
+    for (uint32_t i = 0; i < pages; i++) {
+        uint32_t page_virt = virt + i * VMM_PAGE_SIZE;
+        vmm_frame_free_locked(i686_Paging_Get_Physical(page_virt));
+        i686_Paging_Unmap_Range(page_virt, VMM_PAGE_SIZE);
+    }
+    spin_unlock_irqrestore(&g_VmmLock, flags);
+
+    // Other CPUs may still map the range to the old frames. It's only
+    // handed out again once they've flushed, and the wait can't happen
+    // under the lock.
+    i686_Paging_FlushOtherCpus();
+
+    flags = spin_lock_irqsave(&g_VmmLock);
+    for (uint32_t i = 0; i < pages; i++) {
+        bitmap_clear(g_RegionBitmap, first + i);
+    }
+    spin_unlock_irqrestore(&g_VmmLock, flags);
+}
+
+bool vmm_owns(const void* ptr) {
+    uint32_t addr = (uint32_t)ptr;
+    return addr >= VMM_REGION_BASE && addr < VMM_REGION_BASE + VMM_REGION_SIZE;
+}
+
+void vmm_get_stats(uint32_t* frames_used, uint32_t* frames_total) {
+    *frames_used = g_FramesUsed;
+    *frames_total = g_FrameCount;
+}
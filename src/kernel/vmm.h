@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "stdbool.h"
+
+// Page-granular allocator for large buffers. Physical frames come from a pool
+// above the 512MB identity map and are mapped into a dedicated virtual window,
+// so big allocations never share (or fragment) the small-object heap. The
+// pool is cut down to the RAM that's actually there, and is empty on
+// machines with 512MB or less.
+
+#define VMM_PAGE_SIZE        4096
+#define VMM_FRAME_POOL_BASE  0x20000000u  // 512MB, first byte past the identity map
+#define VMM_FRAME_POOL_SIZE  0x20000000u  // up to 512MB of frames
+#define VMM_REGION_BASE      0x60000000u  // virtual window for mapped allocations
+#define VMM_REGION_SIZE      0x20000000u
+
+void vmm_initialize();
+
+// Maps enough fresh pages to hold `size` bytes, returns a page-aligned pointer or NULL
+void* vmm_alloc(size_t size);
+void vmm_free(void* ptr, size_t size);
+bool vmm_owns(const void* ptr);
+
+void vmm_get_stats(uint32_t* frames_used, uint32_t* frames_total);